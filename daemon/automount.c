@@ -311,23 +311,11 @@ static int walk_tree(const char *base, int (*fn) (struct autofs_point *ap,
 	return 0;
 }
 
-static int rm_unwanted_fn(struct autofs_point *ap,
-			  const char *file, const struct stat *st,
-			  int when, void *arg)
+static int rm_unwanted_one(struct autofs_point *ap, const char *file, dev_t dev)
 {
-	dev_t dev = *(dev_t *) arg;
 	char buf[MAX_ERR_BUF];
 	struct stat newst;
 
-	if (!st)
-		return 0;
-
-	if (when == 0) {
-		if (st->st_dev != dev)
-			return 0;
-		return 1;
-	}
-
 	if (lstat(file, &newst)) {
 		crit(ap->logopt,
 		     "unable to stat file, possible race condition");
@@ -360,9 +348,78 @@ static int rm_unwanted_fn(struct autofs_point *ap,
 	return 1;
 }
 
+/*
+ * Remove the directories and symlinks below base, base itself if
+ * incl is set. Mount points are left alone and d_type is used to
+ * find the directories to descend into, the device of each entry
+ * is still checked by rm_unwanted_one() before it's removed.
+ */
+static int rm_unwanted_walk(struct autofs_point *ap, const char *base,
+			    unsigned char type, int incl)
+{
+	char buf[PATH_MAX + 1];
+
+	if (type == DT_UNKNOWN) {
+		struct stat st;
+
+		if (lstat(base, &st) == -1)
+			return -1;
+		type = IFTODT(st.st_mode);
+	}
+
+	if (type == DT_DIR) {
+		struct dirent **de;
+		int n;
+
+		n = scandir(base, &de, 0, alphasort);
+		if (n < 0)
+			return -1;
+
+		while (n--) {
+			int ret, size;
+
+			if (strcmp(de[n]->d_name, ".") == 0 ||
+			    strcmp(de[n]->d_name, "..") == 0) {
+				free(de[n]);
+				continue;
+			}
+
+			size = sizeof(buf);
+			ret = cat_path(buf, size, base, de[n]->d_name);
+			if (!ret) {
+				do {
+					free(de[n]);
+				} while (n--);
+				free(de);
+				return -1;
+			}
+
+			if (!is_mounted(_PATH_MOUNTED, buf, MNTS_ALL))
+				rm_unwanted_walk(ap, buf, de[n]->d_type, 1);
+			free(de[n]);
+		}
+		free(de);
+	}
+	if (incl)
+		rm_unwanted_one(ap, base, ap->dev);
+
+	return 0;
+}
+
 void rm_unwanted(struct autofs_point *ap, const char *path, int incl)
 {
-	walk_tree(path, rm_unwanted_fn, incl, ap, &ap->dev);
+	struct stat st;
+
+	if (!is_mounted(_PATH_MOUNTED, path, MNTS_REAL) &&
+	    lstat(path, &st) != -1 && st.st_dev == ap->dev)
+		rm_unwanted_walk(ap, path, IFTODT(st.st_mode), incl);
+}
+
+static void mnt_snapshot_cleanup(void *arg)
+{
+	struct mnt_snapshot *snap = (struct mnt_snapshot *) arg;
+	mnt_snapshot_put(snap);
+	return;
 }
 
 struct counter_args {
@@ -384,10 +441,99 @@ static int counter_fn(struct autofs_point *ap, const char *file,
 	return 1;
 }
 
-/* Count mounted filesystems and symlinks */
+/*
+ * Count the symlinks below path, which aren't in the mount table.
+ * Directories that are mount points, which have been counted from
+ * the mount table, aren't descended into.
+ */
+static int count_symlinks(struct mnt_snapshot *snap, const char *path)
+{
+	char buf[PATH_MAX + 1];
+	struct dirent *de;
+	struct stat st;
+	unsigned char type;
+	int count = 0;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((de = readdir(dir))) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+
+		type = de->d_type;
+		if (type == DT_LNK) {
+			count++;
+			continue;
+		}
+
+		if (type != DT_DIR && type != DT_UNKNOWN)
+			continue;
+
+		if (!cat_path(buf, sizeof(buf), path, de->d_name))
+			continue;
+
+		if (type == DT_UNKNOWN) {
+			if (lstat(buf, &st) == -1)
+				continue;
+			if (S_ISLNK(st.st_mode)) {
+				count++;
+				continue;
+			}
+			if (!S_ISDIR(st.st_mode))
+				continue;
+		}
+
+		if (!tree_snapshot_is_mounted(&snap, buf, MNTS_ALL))
+			count += count_symlinks(snap, buf);
+	}
+	closedir(dir);
+
+	return count;
+}
+
+/*
+ * Count mounted filesystems and symlinks. If the mount table hasn't
+ * changed since the shared mount snapshot was made the mounts are
+ * counted from it, otherwise the directories under path are walked.
+ * The snapshot is never made here because count_mounts() is mostly
+ * called just after an umount has changed the mount table.
+ */
 int count_mounts(struct autofs_point *ap, const char *path, dev_t dev)
 {
 	struct counter_args counter;
+	struct mnt_snapshot *snap;
+	struct stat st;
+	int count;
+
+	/* Nothing below a mount on path itself is looked at */
+	if (is_mounted(_PATH_MOUNTED, path, MNTS_REAL))
+		return 1;
+
+	if (lstat(path, &st) == -1)
+		return 0;
+
+	if (S_ISLNK(st.st_mode) || (S_ISDIR(st.st_mode) && st.st_dev != dev))
+		return 1;
+
+	if (!S_ISDIR(st.st_mode))
+		return 0;
+
+	count = -1;
+	snap = mnt_snapshot_get_current();
+	if (snap) {
+		pthread_cleanup_push(mnt_snapshot_cleanup, snap);
+		count = mnt_snapshot_count_mounts(snap, path);
+		if (count != -1)
+			count += count_symlinks(snap, path);
+		pthread_cleanup_pop(1);
+	}
+
+	if (count != -1)
+		return count;
 
 	counter.count = 0;
 	counter.dev = dev;
@@ -764,6 +910,79 @@ static char *automount_path_to_fifo(unsigned logopt, const char *path)
 	return fifo_name;
 }
 
+static char *automount_path_to_stats(unsigned logopt, const char *path)
+{
+	char *fifo_name, *stats_name;
+
+	fifo_name = automount_path_to_fifo(logopt, path);
+	if (!fifo_name)
+		return NULL;
+
+	stats_name = malloc(strlen(fifo_name) + 7);
+	if (stats_name) {
+		strcpy(stats_name, fifo_name);
+		strcat(stats_name, ".stats");
+	}
+	free(fifo_name);
+
+	return stats_name;
+}
+
+/*
+ * Write the mount latency statistics of an autofs point to a file
+ * next to its fifo, replacing the file in one go so a reader never
+ * sees part of it.
+ */
+static void write_mount_stats(struct autofs_point *ap)
+{
+	char buf[MAX_ERR_BUF];
+	char *stats_name, *tmp_name;
+	FILE *f;
+	int fd;
+
+	stats_name = automount_path_to_stats(ap->logopt, ap->path);
+	if (!stats_name) {
+		error(ap->logopt, "failed to allocate stats file name");
+		return;
+	}
+
+	tmp_name = malloc(strlen(stats_name) + 5);
+	if (!tmp_name) {
+		error(ap->logopt, "failed to allocate stats file name");
+		free(stats_name);
+		return;
+	}
+	strcpy(tmp_name, stats_name);
+	strcat(tmp_name, ".tmp");
+
+	fd = open(tmp_name, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
+	if (fd == -1 || !(f = fdopen(fd, "w"))) {
+		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+		error(ap->logopt, "failed to open %s: %s", tmp_name, estr);
+		if (fd != -1)
+			close(fd);
+		goto out;
+	}
+
+	if (mount_stats_write(ap, f) || fclose(f)) {
+		error(ap->logopt, "failed to write %s", tmp_name);
+		unlink(tmp_name);
+		goto out;
+	}
+
+	if (rename(tmp_name, stats_name)) {
+		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+		error(ap->logopt, "failed to rename %s: %s", tmp_name, estr);
+		unlink(tmp_name);
+		goto out;
+	}
+
+	debug(ap->logopt, "wrote mount stats to %s", stats_name);
+out:
+	free(tmp_name);
+	free(stats_name);
+}
+
 static int create_logpri_fifo(struct autofs_point *ap)
 {
 	int ret = -1;
@@ -867,6 +1086,11 @@ static void handle_fifo_message(struct autofs_point *ap, int fd)
 		return;
 	}
 
+	if (buffer[0] == 's') {
+		write_mount_stats(ap);
+		return;
+	}
+
 	errno = 0;
 	pri = strtol(buffer, &end, 10);
 	if ((pri == LONG_MIN || pri == LONG_MAX) && errno == ERANGE) {
@@ -909,23 +1133,10 @@ static void handle_fifo_message(struct autofs_point *ap, int fd)
 	}
 }
 
-static int set_log_priority(const char *path, int priority)
+static int write_fifo_message(const char *path, const char *buf, size_t len)
 {
-	int fd;
 	char *fifo_name;
-	char buf[2];
-
-	if (priority > LOG_DEBUG || priority < LOG_EMERG) {
-		fprintf(stderr, "Log priority %d is invalid.\n", priority);
-		fprintf(stderr, "Please spcify a number in the range 0-7.\n");
-		return -1;
-	}
-
-	/*
-	 * This is an ascii based protocol, so we want the string
-	 * representation of the integer log priority.
-	 */
-	snprintf(buf, sizeof(buf), "%d", priority);
+	int fd;
 
 	fifo_name = automount_path_to_fifo(LOGOPT_NONE, path);
 	if (!fifo_name) {
@@ -948,8 +1159,7 @@ static int set_log_priority(const char *path, int priority)
 		return -1;
 	}
 
-	if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
-		fprintf(stderr, "Failed to change logging priority.  ");
+	if (write(fd, buf, len) != len) {
 		fprintf(stderr, "write to fifo failed: %s.\n",
 			strerror(errno));
 		close(fd);
@@ -958,11 +1168,81 @@ static int set_log_priority(const char *path, int priority)
 	}
 	close(fd);
 	free(fifo_name);
+
+	return 0;
+}
+
+static int set_log_priority(const char *path, int priority)
+{
+	char buf[2];
+
+	if (priority > LOG_DEBUG || priority < LOG_EMERG) {
+		fprintf(stderr, "Log priority %d is invalid.\n", priority);
+		fprintf(stderr, "Please spcify a number in the range 0-7.\n");
+		return -1;
+	}
+
+	/*
+	 * This is an ascii based protocol, so we want the string
+	 * representation of the integer log priority.
+	 */
+	snprintf(buf, sizeof(buf), "%d", priority);
+
+	if (write_fifo_message(path, buf, sizeof(buf)) < 0) {
+		fprintf(stderr, "Failed to change logging priority.\n");
+		return -1;
+	}
 	fprintf(stdout, "Successfully set log priority for %s.\n", path);
 
 	return 0;
 }
 
+/* Ask the daemon for the mount statistics of a path and print them */
+static int show_mount_stats(const char *path)
+{
+	char *stats_name;
+	char buf[PIPE_BUF];
+	FILE *f = NULL;
+	size_t len;
+	int i;
+
+	stats_name = automount_path_to_stats(LOGOPT_NONE, path);
+	if (!stats_name) {
+		fprintf(stderr, "%s: Failed to allocate memory!\n",
+			__FUNCTION__);
+		return -1;
+	}
+	unlink(stats_name);
+
+	if (write_fifo_message(path, "s", 2) < 0) {
+		fprintf(stderr, "Failed to request mount statistics.\n");
+		free(stats_name);
+		return -1;
+	}
+
+	/* The daemon renames the file into place once it's written */
+	for (i = 0; i < 50; i++) {
+		f = fopen(stats_name, "r");
+		if (f)
+			break;
+		usleep(100000);
+	}
+
+	if (!f) {
+		fprintf(stderr, "No mount statistics received for %s.\n", path);
+		free(stats_name);
+		return -1;
+	}
+
+	while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+		fwrite(buf, 1, len, stdout);
+	fclose(f);
+	unlink(stats_name);
+	free(stats_name);
+
+	return 0;
+}
+
 static int get_pkt(struct autofs_point *ap, union autofs_v5_packet_union *pkt)
 {
 	struct pollfd fds[3];
@@ -1455,6 +1735,10 @@ static void *statemachine(void *arg)
 
 		case SIGHUP:
 			do_hup_signal(master_list, monotonic_time(NULL));
+			mount_pool_log_stats(master_list->logopt);
+			mount_latency_log_stats(master_list->logopt);
+			mnt_table_log_stats(master_list->logopt);
+			log_async_log_stats(master_list->logopt);
 			break;
 
 		default:
@@ -1831,6 +2115,8 @@ static void usage(void)
 		"			specify global mount options\n"
 		"	-l --set-log-priority priority path [path,...]\n"
 		"			set daemon log verbosity\n"
+		"	-s --mount-stats path [path,...]\n"
+		"			show daemon mount latency statistics\n"
 		"	-C --dont-check-daemon\n"
 		"			don't check if daemon is already running\n"
 		"	-F --force	forceably clean up known automounts at start\n"
@@ -2002,12 +2288,13 @@ int main(int argc, char *argv[])
 {
 	int res, opt, status;
 	int logpri = -1;
+	int show_stats = 0;
 	unsigned ghost, logging, daemon_check;
 	unsigned dumpmaps, foreground, have_global_options;
 	time_t timeout;
 	time_t age = monotonic_time(NULL);
 	struct rlimit rlim;
-	const char *options = "+hp:t:vmdD:fVrO:l:n:CF";
+	const char *options = "+hp:t:vmdD:fVrO:l:n:sCF";
 	static const struct option long_options[] = {
 		{"help", 0, 0, 'h'},
 		{"pid-file", 1, 0, 'p'},
@@ -2022,6 +2309,7 @@ int main(int argc, char *argv[])
 		{"global-options", 1, 0, 'O'},
 		{"version", 0, 0, 'V'},
 		{"set-log-priority", 1, 0, 'l'},
+		{"mount-stats", 0, 0, 's'},
 		{"dont-check-daemon", 0, 0, 'C'},
 		{"force", 0, 0, 'F'},
 		{0, 0, 0, 0}
@@ -2130,6 +2418,10 @@ int main(int argc, char *argv[])
 			}
 			break;
 
+		case 's':
+			show_stats = 1;
+			break;
+
 		case 'C':
 			daemon_check = 0;
 			break;
@@ -2161,6 +2453,21 @@ int main(int argc, char *argv[])
 	argv += optind;
 	argc -= optind;
 
+	if (show_stats) {
+		int exit_code = 0;
+		int i;
+
+		for (i = 0; i < argc; i++) {
+			if (show_mount_stats(argv[i]) < 0)
+				exit_code = 1;
+		}
+		if (argc < 1) {
+			fprintf(stderr, "--mount-stats requires a path.\n");
+			exit_code = 1;
+		}
+		exit(exit_code);
+	}
+
 	if (logpri >= 0) {
 		int exit_code = 0;
 		int i;
@@ -2383,6 +2690,21 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	if (!mount_pool_start_handler()) {
+		logerr("%s: failed to create mount pool!", program);
+		master_kill(master_list);
+		res = write(start_pipefd[1], pst_stat, sizeof(*pst_stat));
+		close(start_pipefd[1]);
+		release_flag_file();
+		macro_free_global_table();
+		exit(1);
+	}
+
+	if (!log_async_start(defaults_get_log_queue_size(),
+			     defaults_get_log_rate_limit()))
+		logerr("%s: failed to create log writer, "
+		       "logging directly", program);
+
 #if defined(WITH_LDAP) && defined(LIBXML2_WORKAROUND)
 	void *dh_xml2 = dlopen("libxml2.so", RTLD_NOW);
 	if (!dh_xml2)
@@ -2427,6 +2749,7 @@ int main(int argc, char *argv[])
 		unlink(pid_file);
 		pid_file = NULL;
 	}
+	log_async_stop();
 	defaults_conf_release();
 	closelog();
 	release_flag_file();
@@ -40,6 +40,8 @@
 
 /* Attribute to create detached thread */
 extern pthread_attr_t th_attr_detached;
+/* Attribute to create joinable thread */
+extern pthread_attr_t th_attr;
 
 struct mnt_params {
 	char *options;
@@ -75,10 +77,37 @@ static void key_mnt_params_init(void)
 	return;
 }
 
-static void mnts_cleanup(void *arg)
+/*
+ * The cached mount options are specific to the autofs mount the
+ * thread last worked on so threads that are reused for requests
+ * must discard them.
+ */
+void clear_mnt_params(void)
 {
-	struct mnt_list *mnts = (struct mnt_list *) arg;
-	tree_free_mnt_tree(mnts);
+	struct mnt_params *mp;
+	int status;
+
+	status = pthread_once(&key_mnt_params_once, key_mnt_params_init);
+	if (status)
+		fatal(status);
+
+	mp = pthread_getspecific(key_mnt_direct_params);
+	if (mp) {
+		pthread_setspecific(key_mnt_direct_params, NULL);
+		key_mnt_params_destroy(mp);
+	}
+
+	mp = pthread_getspecific(key_mnt_offset_params);
+	if (mp) {
+		pthread_setspecific(key_mnt_offset_params, NULL);
+		key_mnt_params_destroy(mp);
+	}
+}
+
+static void mnt_snapshot_cleanup(void *arg)
+{
+	struct mnt_snapshot *snap = (struct mnt_snapshot *) arg;
+	mnt_snapshot_put(snap);
 	return;
 }
 
@@ -197,11 +226,13 @@ int umount_autofs_direct(struct autofs_point *ap)
 {
 	struct map_source *map;
 	struct mapent_cache *nc, *mc;
+	struct mnt_snapshot *snap;
 	struct mnt_list *mnts;
 	struct mapent *me, *ne;
 
-	mnts = tree_make_mnt_tree(_PROC_MOUNTS, "/");
-	pthread_cleanup_push(mnts_cleanup, mnts);
+	snap = mnt_snapshot_get();
+	mnts = snap ? snap->tree : NULL;
+	pthread_cleanup_push(mnt_snapshot_cleanup, snap);
 	nc = ap->entry->master->nc;
 	cache_readlock(nc);
 	pthread_cleanup_push(cache_lock_cleanup, nc);
@@ -241,20 +272,18 @@ int umount_autofs_direct(struct autofs_point *ap)
 	return 0;
 }
 
-static int unlink_mount_tree(struct autofs_point *ap, struct list_head *list)
+static int unlink_mount_tree(struct autofs_point *ap,
+			     struct mnt_list **mnts, int count)
 {
-	struct list_head *p;
-	int rv, ret;
+	int rv, ret, i;
 	pid_t pgrp = getpgrp();
 	char spgrp[20];
 
 	sprintf(spgrp, "pgrp=%d", pgrp);
 
 	ret = 1;
-	list_for_each(p, list) {
-		struct mnt_list *mnt;
-
-		mnt = list_entry(p, struct mnt_list, list);
+	for (i = 0; i < count; i++) {
+		struct mnt_list *mnt = mnts[i];
 
 		if (strstr(mnt->opts, spgrp))
 			continue;
@@ -287,11 +316,18 @@ static int unlink_mount_tree(struct autofs_point *ap, struct list_head *list)
 static int unlink_active_mounts(struct autofs_point *ap, struct mnt_list *mnts, struct mapent *me)
 {
 	struct ioctl_ops *ops = get_ioctl_ops();
-	struct list_head list;
+	struct mnt_list **array;
+	int count, ret = 0;
 
-	INIT_LIST_HEAD(&list);
+	/* The tree may be a shared snapshot so it can't be changed */
+	count = tree_get_mnt_array(mnts, me->key, 1, &array);
+	if (count < 0) {
+		error(ap->logopt,
+		      "failed to get list of mounts under %s", me->key);
+		return -1;
+	}
 
-	if (tree_get_mnt_list(mnts, &list, me->key, 1)) {
+	if (count) {
 		if (ap->state == ST_READMAP) {
 			time_t tout = me->source->exp_timeout;
 			int save_ioctlfd, ioctlfd;
@@ -306,7 +342,7 @@ static int unlink_active_mounts(struct autofs_point *ap, struct mnt_list *mnts,
 				error(ap->logopt,
 				     "failed to create ioctl fd for %s",
 				     me->key);
-				return 0;
+				goto done;
 			}
 
 			ops->timeout(ap->logopt, ioctlfd, tout);
@@ -314,32 +350,36 @@ static int unlink_active_mounts(struct autofs_point *ap, struct mnt_list *mnts,
 			if (save_ioctlfd == -1)
 				ops->close(ap->logopt, ioctlfd);
 
-			return 0;
+			goto done;
 		}
 	}
 
-	if (!unlink_mount_tree(ap, &list)) {
+	if (!unlink_mount_tree(ap, array, count)) {
 		debug(ap->logopt,
 		      "already mounted as other than autofs "
 		      "or failed to unlink entry in tree");
-		return 0;
+		goto done;
 	}
 
-	return 1;
+	ret = 1;
+done:
+	if (array)
+		free(array);
+	return ret;
 }
 
-int do_mount_autofs_direct(struct autofs_point *ap,
-			   struct mnt_list *mnts, struct mapent *me,
-			   time_t timeout)
+/*
+ * Take over or clear away any existing mount of a direct trigger.
+ * Returns 1 if a new trigger needs to be mounted, otherwise the
+ * result to return for the mount.
+ */
+static int direct_trigger_check(struct autofs_point *ap,
+				struct mnt_list *mnts, struct mapent *me,
+				time_t timeout)
 {
-	const char *str_direct = mount_type_str(t_direct);
 	struct ioctl_ops *ops = get_ioctl_ops();
-	struct mnt_params *mp;
-	struct stat st;
-	int status, ret, ioctlfd;
-	const char *map_name;
 	time_t runfreq;
-	int err;
+	int ret;
 
 	if (timeout) {
 		/* Calculate the expire run frequency */
@@ -376,6 +416,24 @@ int do_mount_autofs_direct(struct autofs_point *ap,
 		}
 	}
 
+	return 1;
+}
+
+/*
+ * Mount a new direct trigger. This doesn't change the autofs point
+ * so triggers can be mounted by several threads at once.
+ */
+static int direct_trigger_mount(struct autofs_point *ap,
+				struct mapent *me, time_t timeout)
+{
+	const char *str_direct = mount_type_str(t_direct);
+	struct ioctl_ops *ops = get_ioctl_ops();
+	struct mnt_params *mp;
+	struct stat st;
+	int status, ret, ioctlfd;
+	const char *map_name;
+	int err;
+
 	status = pthread_once(&key_mnt_params_once, key_mnt_params_init);
 	if (status)
 		fatal(status);
@@ -462,14 +520,234 @@ out_err:
 	return -1;
 }
 
+int do_mount_autofs_direct(struct autofs_point *ap,
+			   struct mnt_list *mnts, struct mapent *me,
+			   time_t timeout)
+{
+	int ret;
+
+	ret = direct_trigger_check(ap, mnts, me, timeout);
+	if (ret != 1)
+		return ret;
+
+	return direct_trigger_mount(ap, me, timeout);
+}
+
+void direct_triggers_init(struct direct_triggers *dt)
+{
+	memset(dt, 0, sizeof(struct direct_triggers));
+	clock_gettime(CLOCK_MONOTONIC, &dt->start);
+}
+
+void direct_triggers_cleanup(void *arg)
+{
+	struct direct_triggers *dt = (struct direct_triggers *) arg;
+
+	if (dt->triggers)
+		free(dt->triggers);
+	dt->triggers = NULL;
+	dt->count = dt->size = 0;
+}
+
+/*
+ * Deal with any existing mount of a direct trigger now and queue
+ * the trigger to be mounted by direct_triggers_mount() if it needs
+ * a new mount. The map entry cache must stay read locked until the
+ * queued triggers have been mounted.
+ */
+int direct_triggers_add(struct autofs_point *ap, struct mnt_list *mnts,
+			struct direct_triggers *dt, struct mapent *me,
+			time_t timeout)
+{
+	struct direct_trigger *this;
+	const char *cp;
+	int ret;
+
+	ret = direct_trigger_check(ap, mnts, me, timeout);
+	if (ret != 1)
+		return ret;
+
+	if (dt->count == dt->size) {
+		unsigned int size = dt->size ? dt->size * 2 : 64;
+
+		this = realloc(dt->triggers,
+			       size * sizeof(struct direct_trigger));
+		if (!this) {
+			/* Mount it now instead */
+			ret = direct_trigger_mount(ap, me, timeout);
+			if (ret)
+				dt->failed++;
+			else
+				dt->mounted++;
+			return ret;
+		}
+		dt->triggers = this;
+		dt->size = size;
+	}
+
+	this = &dt->triggers[dt->count++];
+	this->me = me;
+	this->timeout = timeout;
+	this->depth = 0;
+	for (cp = me->key; *cp; cp++)
+		if (*cp == '/')
+			this->depth++;
+
+	return 0;
+}
+
+static int trigger_cmp(const void *a, const void *b)
+{
+	const struct direct_trigger *t1 = a;
+	const struct direct_trigger *t2 = b;
+
+	if (t1->depth != t2->depth)
+		return t1->depth < t2->depth ? -1 : 1;
+
+	return strcmp(t1->me->key, t2->me->key);
+}
+
+/* Triggers at one path depth, shared by the threads mounting them */
+struct trigger_level {
+	struct autofs_point *ap;
+	struct direct_trigger *triggers;
+	unsigned int count;
+	unsigned int next;
+	unsigned int failed;
+};
+
+static void *do_mount_triggers(void *arg)
+{
+	struct trigger_level *tl = (struct trigger_level *) arg;
+	unsigned int n;
+
+	while ((n = __atomic_fetch_add(&tl->next, 1, __ATOMIC_RELAXED)) < tl->count) {
+		struct direct_trigger *this = &tl->triggers[n];
+
+		if (direct_trigger_mount(tl->ap, this->me, this->timeout))
+			__atomic_add_fetch(&tl->failed, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/*
+ * Mount the queued triggers. Triggers are mounted a path depth at a
+ * time, by up to direct_mount_threads threads, so any trigger above
+ * another one is always mounted first.
+ */
+void direct_triggers_mount(struct autofs_point *ap, struct direct_triggers *dt)
+{
+	unsigned int max_threads, i, j;
+	struct timespec start, end;
+	pthread_t *threads;
+	int cur_state;
+
+	if (!dt->count)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	qsort(dt->triggers, dt->count, sizeof(struct direct_trigger), trigger_cmp);
+
+	max_threads = defaults_get_direct_mount_threads();
+	if (max_threads > dt->count)
+		max_threads = dt->count;
+
+	threads = NULL;
+	if (max_threads > 1) {
+		threads = malloc((max_threads - 1) * sizeof(pthread_t));
+		if (!threads)
+			max_threads = 1;
+	}
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+
+	for (i = 0; i < dt->count; i = j) {
+		struct trigger_level tl;
+		unsigned int started = 0, n;
+
+		for (j = i + 1; j < dt->count; j++)
+			if (dt->triggers[j].depth != dt->triggers[i].depth)
+				break;
+
+		tl.ap = ap;
+		tl.triggers = &dt->triggers[i];
+		tl.count = j - i;
+		tl.next = 0;
+		tl.failed = 0;
+
+		/* This thread mounts triggers too */
+		n = min(max_threads, tl.count);
+		while (started + 1 < n) {
+			if (pthread_create(&threads[started], &th_attr,
+					   do_mount_triggers, &tl))
+				break;
+			started++;
+		}
+
+		do_mount_triggers(&tl);
+
+		while (started)
+			pthread_join(threads[--started], NULL);
+
+		dt->failed += tl.failed;
+		dt->mounted += tl.count - tl.failed;
+	}
+
+	pthread_setcancelstate(cur_state, NULL);
+
+	if (threads)
+		free(threads);
+	dt->count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dt->busy.tv_sec += end.tv_sec - start.tv_sec;
+	dt->busy.tv_nsec += end.tv_nsec - start.tv_nsec;
+	if (dt->busy.tv_nsec < 0) {
+		dt->busy.tv_sec--;
+		dt->busy.tv_nsec += 1000000000L;
+	} else if (dt->busy.tv_nsec >= 1000000000L) {
+		dt->busy.tv_sec++;
+		dt->busy.tv_nsec -= 1000000000L;
+	}
+}
+
+void direct_triggers_report(struct autofs_point *ap, struct direct_triggers *dt)
+{
+	struct timespec now;
+	long sec, nsec;
+
+	if (!dt->mounted && !dt->failed)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sec = now.tv_sec - dt->start.tv_sec;
+	nsec = now.tv_nsec - dt->start.tv_nsec;
+	if (nsec < 0) {
+		sec--;
+		nsec += 1000000000L;
+	}
+
+	info(ap->logopt,
+	     "mounted %u direct triggers (%u failed) in %ld.%03ld seconds, "
+	     "%ld.%03ld seconds mounting triggers",
+	     dt->mounted, dt->failed, sec, nsec / 1000000,
+	     (long) dt->busy.tv_sec, dt->busy.tv_nsec / 1000000);
+}
+
 int mount_autofs_direct(struct autofs_point *ap)
 {
 	struct map_source *map;
 	struct mapent_cache *nc, *mc;
 	struct mapent *me, *ne, *nested;
+	struct mnt_snapshot *snap;
 	struct mnt_list *mnts;
+	struct direct_triggers dt;
 	time_t now = monotonic_time(NULL);
 
+	direct_triggers_init(&dt);
+
 	if (strcmp(ap->path, "/-")) {
 		error(ap->logopt, "expected direct map, exiting");
 		return -1;
@@ -483,8 +761,10 @@ int mount_autofs_direct(struct autofs_point *ap)
 		return -1;
 	}
 
-	mnts = tree_make_mnt_tree(_PROC_MOUNTS, "/");
-	pthread_cleanup_push(mnts_cleanup, mnts);
+	snap = mnt_snapshot_get();
+	mnts = snap ? snap->tree : NULL;
+	pthread_cleanup_push(mnt_snapshot_cleanup, snap);
+	pthread_cleanup_push(direct_triggers_cleanup, &dt);
 	pthread_cleanup_push(master_source_lock_cleanup, ap->entry);
 	master_source_readlock(ap->entry);
 	nc = ap->entry->master->nc;
@@ -512,7 +792,7 @@ int mount_autofs_direct(struct autofs_point *ap)
 			if (ne) {
 				if (map->master_line < ne->age) {
 					/* TODO: check return, locking me */
-					do_mount_autofs_direct(ap, mnts, me, timeout);
+					direct_triggers_add(ap, mnts, &dt, me, timeout);
 				}
 				me = cache_enumerate(mc, me);
 				continue;
@@ -529,16 +809,20 @@ int mount_autofs_direct(struct autofs_point *ap)
 			}
 
 			/* TODO: check return, locking me */
-			do_mount_autofs_direct(ap, mnts, me, timeout);
+			direct_triggers_add(ap, mnts, &dt, me, timeout);
 
 			me = cache_enumerate(mc, me);
 		}
+		direct_triggers_mount(ap, &dt);
 		pthread_cleanup_pop(1);
 		map = map->next;
 	}
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+
+	direct_triggers_report(ap, &dt);
 
 	return 0;
 }
@@ -817,14 +1101,16 @@ void *expire_proc_direct(void *arg)
 {
 	struct ioctl_ops *ops = get_ioctl_ops();
 	struct mnt_list *mnts = NULL, *next;
-	struct list_head list, *p;
+	struct mnt_list **array = NULL;
+	struct mnt_snapshot *snap;
 	struct expire_args *ea;
 	struct expire_args ec;
+	struct expire_mounts em;
 	struct autofs_point *ap;
 	struct mapent *me = NULL;
 	unsigned int now;
-	int ioctlfd, cur_state;
-	int status, ret, left;
+	int cur_state;
+	int status, left, count, i;
 
 	ea = (struct expire_args *) arg;
 
@@ -849,18 +1135,22 @@ void *expire_proc_direct(void *arg)
 
 	left = 0;
 
-	mnts = tree_make_mnt_tree(_PROC_MOUNTS, "/");
-	pthread_cleanup_push(mnts_cleanup, mnts);
+	expire_mounts_init(&em, ap, now);
+
+	/* The snapshot is shared with the other direct mounts */
+	snap = mnt_snapshot_get();
+	mnts = snap ? snap->tree : NULL;
+	pthread_cleanup_push(mnt_snapshot_cleanup, snap);
 
 	/* Get a list of mounts select real ones and expire them if possible */
-	INIT_LIST_HEAD(&list);
-	if (!tree_get_mnt_list(mnts, &list, "/", 0)) {
-		ec.status = 0;
-		return NULL;
-	}
+	count = tree_get_mnt_array(mnts, "/", 0, &array);
+	if (count < 0)
+		count = 0;
+	pthread_cleanup_push(free, array);
 
-	list_for_each(p, &list) {
-		next = list_entry(p, struct mnt_list, list);
+	pthread_cleanup_push(expire_mounts_cleanup, &em);
+	for (i = 0; i < count; i++) {
+		next = array[i];
 
 		/*
 		 * All direct mounts must be present in the map
@@ -875,7 +1165,6 @@ void *expire_proc_direct(void *arg)
 
 		if (!strcmp(next->fs_type, "autofs")) {
 			struct stat st;
-			int ioctlfd;
 
 			cache_unlock(me->mc);
 
@@ -925,44 +1214,38 @@ void *expire_proc_direct(void *arg)
 			}
 			cache_unlock(me->mc);
 
-			ioctlfd = me->ioctlfd;
-
-			ret = ops->expire(ap->logopt, ioctlfd, next->path, now);
-			if (ret) {
+			if (expire_mounts_add(&em, next->path, -1))
 				left++;
-				pthread_setcancelstate(cur_state, NULL);
-				continue;
-			}
 
 			pthread_setcancelstate(cur_state, NULL);
 			continue;
 		}
 
-		if (me->ioctlfd >= 0) {
-			/* Real mounts have an open ioctl fd */
-			ioctlfd = me->ioctlfd;
-			cache_unlock(me->mc);
-		} else {
+		/* Real mounts have an open ioctl fd */
+		if (me->ioctlfd < 0) {
 			cache_unlock(me->mc);
 			continue;
 		}
+		cache_unlock(me->mc);
 
 		if (ap->state == ST_EXPIRE || ap->state == ST_PRUNE)
 			pthread_testcancel();
 
 		debug(ap->logopt, "send expire to trigger %s", next->path);
 
-		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
-		ret = ops->expire(ap->logopt, ioctlfd, next->path, now);
-		if (ret)
+		if (expire_mounts_add(&em, next->path, -1))
 			left++;
-		pthread_setcancelstate(cur_state, NULL);
 	}
+	left += expire_mounts_run(&em);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 
 	if (left)
 		info(ap->logopt, "%d remaining in %s", left, ap->path);
 
+	expire_mounts_report(&em);
+
 	ec.status = left;
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
@@ -1184,62 +1467,44 @@ static void mount_send_fail(void *arg)
 	ops->close(ap->logopt, mt->ioctlfd);
 }
 
-static void *do_mount_direct(void *arg)
+static int mount_direct(struct pending_args *mt)
 {
 	struct ioctl_ops *ops = get_ioctl_ops();
-	struct pending_args *args, mt;
-	struct autofs_point *ap;
+	struct autofs_point *ap = mt->ap;
 	struct stat st;
 	int status, state;
 
-	args = (struct pending_args *) arg;
-
-	pending_mutex_lock(args);
-
-	memcpy(&mt, args, sizeof(struct pending_args));
-
-	ap = mt.ap;
-
-	args->signaled = 1;
-	status = pthread_cond_signal(&args->cond);
-	if (status)
-		fatal(status);
-
-	pending_mutex_unlock(args);
-
-	pthread_cleanup_push(mount_send_fail, &mt);
-
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
 
-	status = fstat(mt.ioctlfd, &st);
+	status = fstat(mt->ioctlfd, &st);
 	if (status == -1) {
 		error(ap->logopt,
-		      "can't stat direct mount trigger %s", mt.name);
+		      "can't stat direct mount trigger %s", mt->name);
 		ops->send_fail(ap->logopt,
-			       mt.ioctlfd, mt.wait_queue_token, -ENOENT);
-		ops->close(ap->logopt, mt.ioctlfd);
+			       mt->ioctlfd, mt->wait_queue_token, -ENOENT);
+		ops->close(ap->logopt, mt->ioctlfd);
 		pthread_setcancelstate(state, NULL);
-		pthread_exit(NULL);
+		return -ENOENT;
 	}
 
-	status = stat(mt.name, &st);
-	if (status != 0 || !S_ISDIR(st.st_mode) || st.st_dev != mt.dev) {
+	status = stat(mt->name, &st);
+	if (status != 0 || !S_ISDIR(st.st_mode) || st.st_dev != mt->dev) {
 		error(ap->logopt,
 		     "direct trigger not valid or already mounted %s",
-		     mt.name);
-		ops->send_ready(ap->logopt, mt.ioctlfd, mt.wait_queue_token);
-		ops->close(ap->logopt, mt.ioctlfd);
+		     mt->name);
+		ops->send_ready(ap->logopt, mt->ioctlfd, mt->wait_queue_token);
+		ops->close(ap->logopt, mt->ioctlfd);
 		pthread_setcancelstate(state, NULL);
-		pthread_exit(NULL);
+		return 0;
 	}
 
 	pthread_setcancelstate(state, NULL);
 
-	info(ap->logopt, "attempting to mount entry %s", mt.name);
+	info(ap->logopt, "attempting to mount entry %s", mt->name);
 
-	set_tsd_user_vars(ap->logopt, mt.uid, mt.gid);
+	set_tsd_user_vars(ap->logopt, mt->uid, mt->gid);
 
-	status = lookup_nss_mount(ap, NULL, mt.name, mt.len);
+	status = lookup_nss_mount(ap, NULL, mt->name, mt->len);
 	/*
 	 * Direct mounts are always a single mount. If it fails there's
 	 * nothing to undo so just complain
@@ -1250,12 +1515,12 @@ static void *do_mount_direct(void *arg)
 		struct statfs fs;
 		unsigned int close_fd = 0;
 
-		if (statfs(mt.name, &fs) == -1 ||
+		if (statfs(mt->name, &fs) == -1 ||
 		   (fs.f_type == AUTOFS_SUPER_MAGIC &&
-		    !master_find_submount(ap, mt.name)))
+		    !master_find_submount(ap, mt->name)))
 			close_fd = 1;
-		cache_writelock(mt.mc);
-		if ((me = cache_lookup_distinct(mt.mc, mt.name))) {
+		cache_writelock(mt->mc);
+		if ((me = cache_lookup_distinct(mt->mc, mt->name))) {
 			/*
 			 * Careful here, we need to leave the file handle open
 			 * for direct mount multi-mounts with no real mount at
@@ -1264,22 +1529,49 @@ static void *do_mount_direct(void *arg)
 			if (close_fd && me == me->multi)
 				close_fd = 0;
 			if (!close_fd)
-				me->ioctlfd = mt.ioctlfd;
+				me->ioctlfd = mt->ioctlfd;
 		}
-		ops->send_ready(ap->logopt, mt.ioctlfd, mt.wait_queue_token);
-		cache_unlock(mt.mc);
+		ops->send_ready(ap->logopt, mt->ioctlfd, mt->wait_queue_token);
+		cache_unlock(mt->mc);
 		if (close_fd)
-			ops->close(ap->logopt, mt.ioctlfd);
-		info(ap->logopt, "mounted %s", mt.name);
+			ops->close(ap->logopt, mt->ioctlfd);
+		info(ap->logopt, "mounted %s", mt->name);
+		status = 0;
 	} else {
 		/* TODO: get mount return status from lookup_nss_mount */
 		ops->send_fail(ap->logopt,
-			       mt.ioctlfd, mt.wait_queue_token, -ENOENT);
-		ops->close(ap->logopt, mt.ioctlfd);
-		info(ap->logopt, "failed to mount %s", mt.name);
+			       mt->ioctlfd, mt->wait_queue_token, -ENOENT);
+		ops->close(ap->logopt, mt->ioctlfd);
+		info(ap->logopt, "failed to mount %s", mt->name);
+		status = -ENOENT;
 	}
 	pthread_setcancelstate(state, NULL);
 
+	return status;
+}
+
+static void *do_mount_direct(void *arg)
+{
+	struct pending_args *args, mt;
+	int status;
+
+	args = (struct pending_args *) arg;
+
+	pending_mutex_lock(args);
+
+	memcpy(&mt, args, sizeof(struct pending_args));
+
+	args->signaled = 1;
+	status = pthread_cond_signal(&args->cond);
+	if (status)
+		fatal(status);
+
+	pending_mutex_unlock(args);
+
+	pthread_cleanup_push(mount_send_fail, &mt);
+
+	mount_direct(&mt);
+
 	pthread_cleanup_pop(0);
 
 	return NULL;
@@ -1302,8 +1594,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
 
-	master_mutex_lock();
-
 	/*
 	 * If our parent is a direct or offset mount that has been
 	 * covered by a mount and another lookup occurs after the
@@ -1349,7 +1639,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 		logerr("can't find map entry for (%lu,%lu)",
 		    (unsigned long) pkt->dev, (unsigned long) pkt->ino);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 1;
 	}
@@ -1364,7 +1653,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 	if (ioctlfd == -1) {
 		cache_unlock(mc);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		crit(ap->logopt, "failed to create ioctl fd for %s", me->key);
 		/* TODO:  how do we clear wait q in kernel ?? */
@@ -1381,7 +1669,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 		ops->close(ap->logopt, ioctlfd);
 		cache_unlock(mc);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 0;
 	}
@@ -1393,7 +1680,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 		ops->close(ap->logopt, ioctlfd);
 		cache_unlock(mc);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 0;
 	}
@@ -1406,7 +1692,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 		ops->close(ap->logopt, ioctlfd);
 		cache_unlock(mc);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 0;
 	}
@@ -1420,20 +1705,11 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 		ops->close(ap->logopt, ioctlfd);
 		cache_unlock(mc);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 0;
 	}
 	memset(mt, 0, sizeof(struct pending_args));
 
-	pending_cond_init(mt);
-
-	status = pthread_mutex_init(&mt->mutex, NULL);
-	if (status)
-		fatal(status);
-
-	pending_mutex_lock(mt);
-
 	mt->ap = ap;
 	mt->ioctlfd = ioctlfd;
 	mt->mc = mc;
@@ -1445,6 +1721,32 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 	mt->gid = pkt->gid;
 	mt->wait_queue_token = pkt->wait_queue_token;
 
+	if (mount_pool_enabled()) {
+		/* Don't hold the cache or source locks if we need to wait */
+		cache_unlock(mc);
+		master_source_unlock(ap->entry);
+		status = mount_pool_add(mt, mount_direct);
+		if (status) {
+			error(ap->logopt, "mount request queue failed");
+			ops->send_fail(ap->logopt,
+				       ioctlfd, pkt->wait_queue_token, -status);
+			ops->close(ap->logopt, ioctlfd);
+			free(mt);
+			pthread_setcancelstate(state, NULL);
+			return 1;
+		}
+		pthread_setcancelstate(state, NULL);
+		return 0;
+	}
+
+	pending_cond_init(mt);
+
+	status = pthread_mutex_init(&mt->mutex, NULL);
+	if (status)
+		fatal(status);
+
+	pending_mutex_lock(mt);
+
 	status = pthread_create(&thid, &th_attr_detached, do_mount_direct, mt);
 	if (status) {
 		error(ap->logopt, "missing mount thread create failed");
@@ -1453,7 +1755,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 		ops->close(ap->logopt, ioctlfd);
 		cache_unlock(mc);
 		master_source_unlock(ap->entry);
-		master_mutex_unlock();
 		pending_mutex_unlock(mt);
 		pending_cond_destroy(mt);
 		pending_mutex_destroy(mt);
@@ -1465,8 +1766,6 @@ int handle_packet_missing_direct(struct autofs_point *ap, autofs_packet_missing_
 	cache_unlock(mc);
 	master_source_unlock(ap->entry);
 
-	master_mutex_unlock();
-
 	pthread_cleanup_push(free_pending_args, mt);
 	pthread_cleanup_push(pending_mutex_destroy, mt);
 	pthread_cleanup_push(pending_cond_destroy, mt);
@@ -382,14 +382,23 @@ static void mnts_cleanup(void *arg)
 	return;
 }
 
+static void mnt_snapshot_cleanup(void *arg)
+{
+	struct mnt_snapshot **snap = (struct mnt_snapshot **) arg;
+	mnt_snapshot_put(*snap);
+	return;
+}
+
 void *expire_proc_indirect(void *arg)
 {
 	struct ioctl_ops *ops = get_ioctl_ops();
 	struct autofs_point *ap;
 	struct mapent *me = NULL;
 	struct mnt_list *mnts = NULL, *next;
+	struct mnt_snapshot *snap = NULL;
 	struct expire_args *ea;
 	struct expire_args ec;
+	struct expire_mounts em;
 	unsigned int now;
 	int offsets, submnts, count;
 	int retries;
@@ -419,12 +428,16 @@ void *expire_proc_indirect(void *arg)
 
 	left = 0;
 
+	expire_mounts_init(&em, ap, now);
+
 	/* Get a list of real mounts and expire them if possible */
 	mnts = get_mnt_list(_PROC_MOUNTS, ap->path, 0);
 	pthread_cleanup_push(mnts_cleanup, mnts);
+	/* Snapshot used to check for mounts on offsets */
+	pthread_cleanup_push(mnt_snapshot_cleanup, &snap);
+	pthread_cleanup_push(expire_mounts_cleanup, &em);
 	for (next = mnts; next; next = next->next) {
 		char *ind_key;
-		int ret;
 
 		if (!strcmp(next->fs_type, "autofs")) {
 			/*
@@ -441,7 +454,8 @@ void *expire_proc_indirect(void *arg)
 				struct stat st;
 
 				/* It's got a mount, deal with in the outer loop */
-				if (is_mounted(_PATH_MOUNTED, next->path, MNTS_REAL)) {
+				if (tree_snapshot_is_mounted(&snap,
+							next->path, MNTS_REAL)) {
 					pthread_setcancelstate(cur_state, NULL);
 					continue;
 				}
@@ -520,19 +534,18 @@ void *expire_proc_indirect(void *arg)
 
 		ioctlfd = ap->ioctlfd;
 		if (me) {
+			/* Read when the expire is sent */
 			if (*me->key == '/')
-				ioctlfd = me->ioctlfd;
+				ioctlfd = -1;
 			cache_unlock(me->mc);
 		}
 
-		debug(ap->logopt, "expire %s", next->path);
-
-		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
-		ret = ops->expire(ap->logopt, ioctlfd, next->path, now);
-		if (ret)
+		if (expire_mounts_add(&em, next->path, ioctlfd))
 			left++;
-		pthread_setcancelstate(cur_state, NULL);
 	}
+	left += expire_mounts_run(&em);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 
 	/*
 	 * If there are no more real mounts left we could still
@@ -576,6 +589,8 @@ void *expire_proc_indirect(void *arg)
 	if (count)
 		info(ap->logopt, "%d remaining in %s", count, ap->path);
 
+	expire_mounts_report(&em);
+
 	ec.status = left;
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
@@ -716,73 +731,82 @@ static void mount_send_fail(void *arg)
 		       ap->ioctlfd, mt->wait_queue_token, -ENOENT);
 }
 
-static void *do_mount_indirect(void *arg)
+static int mount_indirect(struct pending_args *mt)
 {
 	struct ioctl_ops *ops = get_ioctl_ops();
-	struct pending_args *args, mt;
-	struct autofs_point *ap;
+	struct autofs_point *ap = mt->ap;
 	char buf[PATH_MAX + 1];
 	struct stat st;
 	int len, status, state;
 
-	args = (struct pending_args *) arg;
-
-	pending_mutex_lock(args);
-
-	memcpy(&mt, args, sizeof(struct pending_args));
-
-	ap = mt.ap;
-
-	args->signaled = 1;
-	status = pthread_cond_signal(&args->cond);
-	if (status)
-		fatal(status);
-
-	pending_mutex_unlock(args);
-
-	pthread_cleanup_push(mount_send_fail, &mt);
-
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
 
-	len = ncat_path(buf, sizeof(buf), ap->path, mt.name, mt.len);
+	len = ncat_path(buf, sizeof(buf), ap->path, mt->name, mt->len);
 	if (!len) {
 		crit(ap->logopt, "path to be mounted is to long");
 		ops->send_fail(ap->logopt,
-			       ap->ioctlfd, mt.wait_queue_token,
+			       ap->ioctlfd, mt->wait_queue_token,
 			      -ENAMETOOLONG);
 		pthread_setcancelstate(state, NULL);
-		pthread_exit(NULL);
+		return -ENAMETOOLONG;
 	}
 
 	status = lstat(buf, &st);
-	if (status != -1 && !(S_ISDIR(st.st_mode) && st.st_dev == mt.dev)) {
+	if (status != -1 && !(S_ISDIR(st.st_mode) && st.st_dev == mt->dev)) {
 		error(ap->logopt,
 		      "indirect trigger not valid or already mounted %s", buf);
-		ops->send_ready(ap->logopt, ap->ioctlfd, mt.wait_queue_token);
+		ops->send_ready(ap->logopt, ap->ioctlfd, mt->wait_queue_token);
 		pthread_setcancelstate(state, NULL);
-		pthread_exit(NULL);
+		return 0;
 	}
 
 	pthread_setcancelstate(state, NULL);
 
 	info(ap->logopt, "attempting to mount entry %s", buf);
 
-	set_tsd_user_vars(ap->logopt, mt.uid, mt.gid);
+	set_tsd_user_vars(ap->logopt, mt->uid, mt->gid);
 
-	status = lookup_nss_mount(ap, NULL, mt.name, mt.len);
+	status = lookup_nss_mount(ap, NULL, mt->name, mt->len);
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
 	if (status) {
 		ops->send_ready(ap->logopt,
-				ap->ioctlfd, mt.wait_queue_token);
+				ap->ioctlfd, mt->wait_queue_token);
 		info(ap->logopt, "mounted %s", buf);
+		status = 0;
 	} else {
 		/* TODO: get mount return status from lookup_nss_mount */
 		ops->send_fail(ap->logopt,
-			       ap->ioctlfd, mt.wait_queue_token, -ENOENT);
+			       ap->ioctlfd, mt->wait_queue_token, -ENOENT);
 		info(ap->logopt, "failed to mount %s", buf);
+		status = -ENOENT;
 	}
 	pthread_setcancelstate(state, NULL);
 
+	return status;
+}
+
+static void *do_mount_indirect(void *arg)
+{
+	struct pending_args *args, mt;
+	int status;
+
+	args = (struct pending_args *) arg;
+
+	pending_mutex_lock(args);
+
+	memcpy(&mt, args, sizeof(struct pending_args));
+
+	args->signaled = 1;
+	status = pthread_cond_signal(&args->cond);
+	if (status)
+		fatal(status);
+
+	pending_mutex_unlock(args);
+
+	pthread_cleanup_push(mount_send_fail, &mt);
+
+	mount_indirect(&mt);
+
 	pthread_cleanup_pop(0);
 
 	return NULL;
@@ -800,33 +824,36 @@ int handle_packet_missing_indirect(struct autofs_point *ap, autofs_packet_missin
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
 
-	master_mutex_lock();
-
 	debug(ap->logopt, "token %ld, name %s, request pid %u",
 		(unsigned long) pkt->wait_queue_token, pkt->name, pkt->pid);
 
-	/* Ignore packet if we're trying to shut down */
+	/*
+	 * Ignore packet if we're trying to shut down. We are called
+	 * from the mount's own thread so the autofs_point can't go
+	 * away and there's no need to serialise with other mounts.
+	 */
 	if (ap->shutdown || ap->state == ST_SHUTDOWN_FORCE) {
 		ops->send_fail(ap->logopt,
 			       ap->ioctlfd, pkt->wait_queue_token, -ENOENT);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 0;
 	}
 
 	/* Check if we recorded a mount fail for this key anywhere */
+	master_source_readlock(ap->entry);
 	me = lookup_source_mapent(ap, pkt->name, LKP_DISTINCT);
 	if (me) {
 		if (me->status >= monotonic_time(NULL)) {
 			ops->send_fail(ap->logopt, ap->ioctlfd,
 				       pkt->wait_queue_token, -ENOENT);
 			cache_unlock(me->mc);
-			master_mutex_unlock();
+			master_source_unlock(ap->entry);
 			pthread_setcancelstate(state, NULL);
 			return 0;
 		}
 		cache_unlock(me->mc);
 	}
+	master_source_unlock(ap->entry);
 
 	mt = malloc(sizeof(struct pending_args));
 	if (!mt) {
@@ -834,21 +861,13 @@ int handle_packet_missing_indirect(struct autofs_point *ap, autofs_packet_missin
 		logerr("malloc: %s", estr);
 		ops->send_fail(ap->logopt,
 			       ap->ioctlfd, pkt->wait_queue_token, -ENOMEM);
-		master_mutex_unlock();
 		pthread_setcancelstate(state, NULL);
 		return 1;
 	}
 	memset(mt, 0, sizeof(struct pending_args));
 
-	pending_cond_init(mt);
-
-	status = pthread_mutex_init(&mt->mutex, NULL);
-	if (status)
-		fatal(status);
-
-	pending_mutex_lock(mt);
-
 	mt->ap = ap;
+	mt->ioctlfd = -1;
 	strncpy(mt->name, pkt->name, pkt->len);
 	mt->name[pkt->len] = '\0';
 	mt->len = pkt->len;
@@ -857,12 +876,33 @@ int handle_packet_missing_indirect(struct autofs_point *ap, autofs_packet_missin
 	mt->gid = pkt->gid;
 	mt->wait_queue_token = pkt->wait_queue_token;
 
+	if (mount_pool_enabled()) {
+		status = mount_pool_add(mt, mount_indirect);
+		if (status) {
+			error(ap->logopt, "mount request queue failed");
+			ops->send_fail(ap->logopt,
+				       ap->ioctlfd, pkt->wait_queue_token, -status);
+			free(mt);
+			pthread_setcancelstate(state, NULL);
+			return 1;
+		}
+		pthread_setcancelstate(state, NULL);
+		return 0;
+	}
+
+	pending_cond_init(mt);
+
+	status = pthread_mutex_init(&mt->mutex, NULL);
+	if (status)
+		fatal(status);
+
+	pending_mutex_lock(mt);
+
 	status = pthread_create(&thid, &th_attr_detached, do_mount_indirect, mt);
 	if (status) {
 		error(ap->logopt, "expire thread create failed");
 		ops->send_fail(ap->logopt,
 			       ap->ioctlfd, pkt->wait_queue_token, -status);
-		master_mutex_unlock();
 		pending_mutex_unlock(mt);
 		pending_cond_destroy(mt);
 		pending_mutex_destroy(mt);
@@ -871,8 +911,6 @@ int handle_packet_missing_indirect(struct autofs_point *ap, autofs_packet_missin
 		return 1;
 	}
 
-	master_mutex_unlock();
-
 	pthread_cleanup_push(free_pending_args, mt);
 	pthread_cleanup_push(pending_mutex_destroy, mt);
 	pthread_cleanup_push(pending_cond_destroy, mt);
@@ -25,11 +25,17 @@
 #include "automount.h"
 #include "nsswitch.h"
 
-static void nsslist_cleanup(void *arg)
+static void mnt_snapshot_cleanup(void *arg)
 {
-	struct list_head *nsslist = (struct list_head *) arg;
-	if (!list_empty(nsslist))
-		free_sources(nsslist);
+	struct mnt_snapshot **snap = (struct mnt_snapshot **) arg;
+	mnt_snapshot_put(*snap);
+	return;
+}
+
+static void nss_config_cleanup(void *arg)
+{
+	struct nss_config *conf = (struct nss_config *) arg;
+	nsswitch_put_config(conf);
 	return;
 }
 
@@ -158,7 +164,7 @@ static int read_master_map(struct master *master, char *type, time_t age)
 int lookup_nss_read_master(struct master *master, time_t age)
 {
 	unsigned int logopt = master->logopt;
-	struct list_head nsslist;
+	struct nss_config *nss;
 	struct list_head *head, *p;
 	int result = NSS_STATUS_UNKNOWN;
 
@@ -230,18 +236,14 @@ int lookup_nss_read_master(struct master *master, time_t age)
 		}
 	}
 
-	INIT_LIST_HEAD(&nsslist);
-
-	result = nsswitch_parse(&nsslist);
-	if (result) {
-		if (!list_empty(&nsslist))
-			free_sources(&nsslist);
+	nss = nsswitch_get_config();
+	if (!nss) {
 		error(logopt, "can't to read name service switch config.");
 		return 0;
 	}
 
 	/* First one gets it */
-	head = &nsslist;
+	head = &nss->sources;
 	list_for_each(p, head) {
 		struct nss_source *this;
 		int status;
@@ -284,13 +286,12 @@ int lookup_nss_read_master(struct master *master, time_t age)
 
 		status = check_nss_result(this, result);
 		if (status >= 0) {
-			free_sources(&nsslist);
+			nsswitch_put_config(nss);
 			return status;
 		}
 	}
 
-	if (!list_empty(&nsslist))
-		free_sources(&nsslist);
+	nsswitch_put_config(nss);
 
 	return !result;
 }
@@ -528,7 +529,7 @@ static enum nsswitch_status read_map_source(struct nss_source *this,
 int lookup_nss_read_map(struct autofs_point *ap, struct map_source *source, time_t age)
 {
 	struct master_mapent *entry = ap->entry;
-	struct list_head nsslist;
+	struct nss_config *nss;
 	struct list_head *head, *p;
 	struct nss_source *this;
 	struct map_source *map;
@@ -585,20 +586,16 @@ int lookup_nss_read_map(struct autofs_point *ap, struct map_source *source, time
 			continue;
 		}
 
-		INIT_LIST_HEAD(&nsslist);
-
-		pthread_cleanup_push(nsslist_cleanup, &nsslist);
-		status = nsswitch_parse(&nsslist);
-		pthread_cleanup_pop(0);
-		if (status) {
+		nss = nsswitch_get_config();
+		if (!nss) {
 			error(ap->logopt,
 			      "can't to read name service switch config.");
 			result = 1;
 			break;
 		}
 
-		pthread_cleanup_push(nsslist_cleanup, &nsslist);
-		head = &nsslist;
+		pthread_cleanup_push(nss_config_cleanup, nss);
+		head = &nss->sources;
 		list_for_each(p, head) {
 			this = list_entry(p, struct nss_source, list);
 
@@ -745,6 +742,7 @@ next:
 int do_lookup_mount(struct autofs_point *ap, struct map_source *map, const char *name, int name_len)
 {
 	struct lookup_mod *lookup;
+	struct timespec start;
 	int status;
 
 	if (!map->lookup) {
@@ -763,7 +761,10 @@ int do_lookup_mount(struct autofs_point *ap, struct map_source *map, const char
 	master_source_current_wait(ap->entry);
 	ap->entry->current = map;
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	status = lookup->lookup_mount(ap, name, name_len, lookup->context);
+	mount_stage_record(ap, MOUNT_STAGE_LOOKUP, &start);
+	mount_source_record(map, &start);
 
 	return status;
 }
@@ -1068,13 +1069,16 @@ static void update_negative_cache(struct autofs_point *ap, struct map_source *so
 int lookup_nss_mount(struct autofs_point *ap, struct map_source *source, const char *name, int name_len)
 {
 	struct master_mapent *entry = ap->entry;
-	struct list_head nsslist;
+	struct nss_config *nss;
 	struct list_head *head, *p;
 	struct nss_source *this;
 	struct map_source *map;
 	enum nsswitch_status status;
+	struct timespec start;
 	int result = 0;
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	/*
 	 * For each map source (ie. each entry for the mount
 	 * point in the master map) do the nss lookup to
@@ -1127,17 +1131,15 @@ int lookup_nss_mount(struct autofs_point *ap, struct map_source *source, const c
 			continue;
 		}
 
-		INIT_LIST_HEAD(&nsslist);
-
-		status = nsswitch_parse(&nsslist);
-		if (status) {
+		nss = nsswitch_get_config();
+		if (!nss) {
 			error(ap->logopt,
 			      "can't to read name service switch config.");
 			result = 1;
 			break;
 		}
 
-		head = &nsslist;
+		head = &nss->sources;
 		list_for_each(p, head) {
 			this = list_entry(p, struct nss_source, list);
 
@@ -1160,8 +1162,7 @@ int lookup_nss_mount(struct autofs_point *ap, struct map_source *source, const c
 			}
 		}
 
-		if (!list_empty(&nsslist))
-			free_sources(&nsslist);
+		nsswitch_put_config(nss);
 
 		if (!map)
 			break;
@@ -1180,6 +1181,8 @@ int lookup_nss_mount(struct autofs_point *ap, struct map_source *source, const c
 		update_negative_cache(ap, source, name);
 	pthread_cleanup_pop(1);
 
+	mount_stage_record(ap, MOUNT_STAGE_TOTAL, &start);
+
 	return !result;
 }
 
@@ -1240,12 +1243,31 @@ static char *make_fullpath(const char *root, const char *key)
 	return path;
 }
 
+static void cache_resize_put_cleanup(void *arg)
+{
+	struct mapent_cache *mc = (struct mapent_cache *) arg;
+
+	cache_resize_put(mc);
+}
+
 void lookup_prune_one_cache(struct autofs_point *ap, struct mapent_cache *mc, time_t age)
 {
+	struct mapent_cache_stats stats;
 	struct mapent *me, *this;
+	struct mnt_snapshot *snap = NULL;
 	char *path;
 	int status = CHE_FAIL;
 
+	/* A single mount table snapshot is used for the whole prune */
+	pthread_cleanup_push(mnt_snapshot_cleanup, &snap);
+
+	/*
+	 * The cache lock is dropped to delete entries so the cache
+	 * mustn't be resized until the enumeration is done.
+	 */
+	cache_resize_hold(mc);
+	pthread_cleanup_push(cache_resize_put_cleanup, mc);
+
 	me = cache_enumerate(mc, NULL);
 	while (me) {
 		struct mapent *valid;
@@ -1296,7 +1318,7 @@ void lookup_prune_one_cache(struct autofs_point *ap, struct mapent_cache *mc, ti
 			valid = NULL;
 		}
 		if (!valid &&
-		    is_mounted(_PATH_MOUNTED, path, MNTS_REAL)) {
+		    tree_snapshot_is_mounted(&snap, path, MNTS_REAL)) {
 			debug(ap->logopt,
 			      "prune check posponed, %s mounted", path);
 			free(key);
@@ -1320,7 +1342,7 @@ void lookup_prune_one_cache(struct autofs_point *ap, struct mapent_cache *mc, ti
 
 		if (valid)
 			cache_delete(mc, key);
-		else if (!is_mounted(_PROC_MOUNTS, path, MNTS_AUTOFS)) {
+		else if (!tree_snapshot_is_mounted(&snap, path, MNTS_AUTOFS)) {
 			dev_t devid = ap->dev;
 			status = CHE_FAIL;
 			if (ap->type == LKP_DIRECT)
@@ -1347,6 +1369,27 @@ next:
 		free(path);
 	}
 
+	pthread_cleanup_pop(0);
+	pthread_cleanup_pop(1);
+
+	cache_unlock(mc);
+	cache_writelock(mc);
+	cache_resize_release(mc);
+	cache_unlock(mc);
+	cache_readlock(mc);
+
+	cache_get_stats(mc, &stats);
+	debug(ap->logopt,
+	      "map cache has %u entries in %u slots (%u used), "
+	      "longest chain %u, resized %u times",
+	      stats.entries, stats.size, stats.used,
+	      stats.max_chain, stats.resizes);
+	debug(ap->logopt,
+	      "map cache inode index has %u entries in %u slots "
+	      "(%u used), longest chain %u",
+	      stats.ino_entries, stats.ino_size, stats.ino_used,
+	      stats.ino_max_chain);
+
 	return;
 }
 
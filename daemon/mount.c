@@ -24,6 +24,198 @@
 
 #define ERR_PREFIX	"(mount):"
 
+/* Most file system types mount module latency is kept for */
+#define MOUNT_STATS_FSTYPES	32
+
+/* Mount module latency for a file system type */
+struct fstype_stats {
+	char fstype[32];
+	struct mount_latency_stats stats;
+};
+
+static struct fstype_stats fstype_stats[MOUNT_STATS_FSTYPES];
+static unsigned int fstype_count = 0;
+static pthread_mutex_t fstype_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *stage_name[MOUNT_STAGES] = {
+	"lookup", "parse", "probe", "mount", "total", "expire", "sweep"
+};
+
+/*
+ * Add the time since start to a latency histogram. This is done on
+ * every mount so it uses atomic updates rather than a lock.
+ */
+void mount_stats_record(struct mount_latency_stats *stats, struct timespec *start)
+{
+	struct timespec now;
+	unsigned long msec, max;
+	unsigned int bucket;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	msec = (now.tv_sec - start->tv_sec) * 1000;
+	msec += (now.tv_nsec - start->tv_nsec) / 1000000;
+
+	/* Bucket n holds latencies of less than 2^n milliseconds */
+	bucket = 0;
+	while (bucket < MOUNT_LATENCY_BUCKETS - 1 && msec >= (1UL << bucket))
+		bucket++;
+
+	__atomic_add_fetch(&stats->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats->total_msec, msec, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats->hist[bucket], 1, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&stats->max_msec, __ATOMIC_RELAXED);
+	while (msec > max) {
+		if (__atomic_compare_exchange_n(&stats->max_msec, &max, msec, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+void mount_stage_record(struct autofs_point *ap, unsigned int stage, struct timespec *start)
+{
+	if (stage >= MOUNT_STAGES)
+		return;
+
+	mount_stats_record(&ap->stage_stats[stage], start);
+}
+
+/* Record the time taken by the lookup module of a map source */
+void mount_source_record(struct map_source *map, struct timespec *start)
+{
+	struct mount_latency_stats *stats;
+
+	stats = __atomic_load_n(&map->lookup_stats, __ATOMIC_ACQUIRE);
+	if (!stats) {
+		struct mount_latency_stats *new;
+
+		new = malloc(sizeof(struct mount_latency_stats));
+		if (!new)
+			return;
+		memset(new, 0, sizeof(struct mount_latency_stats));
+
+		if (__atomic_compare_exchange_n(&map->lookup_stats, &stats, new, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			stats = new;
+		else
+			free(new);
+	}
+
+	mount_stats_record(stats, start);
+}
+
+static struct mount_latency_stats *fstype_get_stats(const char *fstype)
+{
+	struct mount_latency_stats *stats = NULL;
+	unsigned int count, i;
+	int status;
+
+	count = __atomic_load_n(&fstype_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < count; i++) {
+		if (!strcmp(fstype_stats[i].fstype, fstype))
+			return &fstype_stats[i].stats;
+	}
+
+	status = pthread_mutex_lock(&fstype_mutex);
+	if (status)
+		fatal(status);
+
+	for (i = 0; i < fstype_count; i++) {
+		if (!strcmp(fstype_stats[i].fstype, fstype)) {
+			stats = &fstype_stats[i].stats;
+			goto done;
+		}
+	}
+
+	if (fstype_count < MOUNT_STATS_FSTYPES &&
+	    strlen(fstype) < sizeof(fstype_stats[i].fstype)) {
+		strcpy(fstype_stats[i].fstype, fstype);
+		stats = &fstype_stats[i].stats;
+		__atomic_store_n(&fstype_count, fstype_count + 1, __ATOMIC_RELEASE);
+	}
+done:
+	status = pthread_mutex_unlock(&fstype_mutex);
+	if (status)
+		fatal(status);
+
+	return stats;
+}
+
+/* Write the statistics following the name already written */
+static void mount_stats_write_one(FILE *f, struct mount_latency_stats *stats)
+{
+	unsigned long count, hist[MOUNT_LATENCY_BUCKETS];
+	unsigned int i;
+
+	count = __atomic_load_n(&stats->count, __ATOMIC_RELAXED);
+	for (i = 0; i < MOUNT_LATENCY_BUCKETS; i++)
+		hist[i] = __atomic_load_n(&stats->hist[i], __ATOMIC_RELAXED);
+
+	fprintf(f, " count %lu average %lu max %lu histogram", count,
+		count ? __atomic_load_n(&stats->total_msec, __ATOMIC_RELAXED) / count : 0,
+		__atomic_load_n(&stats->max_msec, __ATOMIC_RELAXED));
+	for (i = 0; i < MOUNT_LATENCY_BUCKETS; i++)
+		fprintf(f, " %lu", hist[i]);
+	fputc('\n', f);
+}
+
+static void mount_stats_write_source(FILE *f, struct map_source *map)
+{
+	struct mount_latency_stats *stats;
+	struct map_source *instance;
+
+	stats = __atomic_load_n(&map->lookup_stats, __ATOMIC_ACQUIRE);
+	if (stats) {
+		fprintf(f, "source %s:%s",
+			map->type ? map->type : "-",
+			map->argc && map->argv[0] ? map->argv[0] : "-");
+		mount_stats_write_one(f, stats);
+	}
+
+	instance = map->instance;
+	while (instance) {
+		mount_stats_write_source(f, instance);
+		instance = instance->next;
+	}
+}
+
+/*
+ * Write the mount latency statistics of an autofs point, its map
+ * sources and the mount modules. Times are in milliseconds and
+ * histogram bucket n counts requests taking less than 2^n msec.
+ * Stages include the time taken by the stages they call, so parse
+ * includes probe and mount and lookup includes parse.
+ */
+int mount_stats_write(struct autofs_point *ap, FILE *f)
+{
+	struct map_source *map;
+	unsigned int count, i;
+
+	fprintf(f, "path %s\n", ap->path);
+
+	for (i = 0; i < MOUNT_STAGES; i++) {
+		fprintf(f, "stage %s", stage_name[i]);
+		mount_stats_write_one(f, &ap->stage_stats[i]);
+	}
+
+	master_source_readlock(ap->entry);
+	map = ap->entry->maps;
+	while (map) {
+		mount_stats_write_source(f, map);
+		map = map->next;
+	}
+	master_source_unlock(ap->entry);
+
+	count = __atomic_load_n(&fstype_count, __ATOMIC_ACQUIRE);
+	for (i = 0; i < count; i++) {
+		fprintf(f, "module %s", fstype_stats[i].fstype);
+		mount_stats_write_one(f, &fstype_stats[i].stats);
+	}
+
+	return ferror(f) ? -1 : 0;
+}
+
 /* These filesystems are known not to work with the "generic" module */
 /* Note: starting with Samba 2.0.6, smbfs is handled generically.    */
 static char *not_generic[] = { "nfs", "userfs", "afs", "autofs",
@@ -33,7 +225,9 @@ static char *not_generic[] = { "nfs", "userfs", "afs", "autofs",
 int do_mount(struct autofs_point *ap, const char *root, const char *name, int name_len,
 	     const char *what, const char *fstype, const char *options)
 {
+	struct mount_latency_stats *stats;
 	struct mount_mod *mod;
+	struct timespec start;
 	const char *modstr;
 	size_t root_len = root ? strlen(root) : 0;
 	char **ngp;
@@ -75,8 +269,14 @@ int do_mount(struct autofs_point *ap, const char *root, const char *name, int na
 		      "%s %s/%s type %s options %s using module %s",
 		      what, root, name, fstype, options, modstr);
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	rv = mod->mount_mount(ap, root, name, name_len, what, fstype, options, mod->context);
 	close_mount(mod);
 
+	mount_stage_record(ap, MOUNT_STAGE_MOUNT, &start);
+	stats = fstype_get_stats(modstr);
+	if (stats)
+		mount_stats_record(stats, &start);
+
 	return rv;
 }
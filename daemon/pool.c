@@ -0,0 +1,413 @@
+/* ----------------------------------------------------------------------- *
+ *
+ *  pool.c - mount request worker pool.
+ *
+ *   Copyright 2015 Ian Kent <raven@themaw.net> - All Rights Reserved
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 675 Mass Ave, Cambridge MA 02139,
+ *   USA; either version 2 of the License, or (at your option) any later
+ *   version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "automount.h"
+
+/* Attribute to create detached thread */
+extern pthread_attr_t th_attr_detached;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t space = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t stall;
+
+/* Requests waiting for a worker */
+static LIST_HEAD(requests);
+
+static unsigned int max_workers = 0;
+static unsigned int max_queue = 0;
+static unsigned int workers = 0;
+static unsigned int idle = 0;
+/* Workers created that haven't started waiting for work yet */
+static unsigned int starting = 0;
+
+/*
+ * A worker can block on a mount that triggers another automount,
+ * such as a bind or NFS mount of a path under another autofs mount,
+ * a program map or a submount offset. If every worker is blocked
+ * like that the queued requests they wait on would never be done,
+ * so if no worker has taken a queued request for this long another
+ * worker is started above the pool size.
+ */
+#define POOL_STALL_TIME		1
+
+static struct mount_pool_stats stats;
+
+#define pool_lock() \
+do { \
+	int _pool_lock = pthread_mutex_lock(&mutex); \
+	if (_pool_lock) \
+		fatal(_pool_lock); \
+} while (0)
+
+#define pool_unlock() \
+do { \
+	int _pool_unlock = pthread_mutex_unlock(&mutex); \
+	if (_pool_unlock) \
+		fatal(_pool_unlock); \
+} while (0)
+
+static unsigned long elapsed_usec(struct timespec *start)
+{
+	struct timespec now;
+	long usec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	usec = (now.tv_sec - start->tv_sec) * 1000000;
+	usec += (now.tv_nsec - start->tv_nsec) / 1000;
+
+	return usec < 0 ? 0 : usec;
+}
+
+/*
+ * Look for a queued request for the same mount. A request that a
+ * worker has started on may already have sent its result so only
+ * requests that haven't been started can be coalesced with.
+ */
+static struct pending_args *pool_find_request(struct pending_args *mt)
+{
+	struct list_head *p;
+
+	list_for_each(p, &requests) {
+		struct pending_args *this;
+
+		this = list_entry(p, struct pending_args, list);
+		if (this->ap == mt->ap && !strcmp(this->name, mt->name))
+			return this;
+	}
+
+	return NULL;
+}
+
+/*
+ * Complete requests coalesced with a request using the result
+ * the request was completed with.
+ */
+static void pool_complete_dups(struct list_head *dups, int result)
+{
+	struct ioctl_ops *ops = get_ioctl_ops();
+
+	while (!list_empty(dups)) {
+		struct pending_args *dup;
+		struct autofs_point *ap;
+		int ioctlfd;
+
+		dup = list_entry(dups->next, struct pending_args, list);
+		list_del(&dup->list);
+
+		ap = dup->ap;
+		ioctlfd = dup->ioctlfd != -1 ? dup->ioctlfd : ap->ioctlfd;
+
+		if (result)
+			ops->send_fail(ap->logopt,
+				       ioctlfd, dup->wait_queue_token, result);
+		else
+			ops->send_ready(ap->logopt,
+					ioctlfd, dup->wait_queue_token);
+
+		if (dup->ioctlfd != -1)
+			ops->close(ap->logopt, dup->ioctlfd);
+
+		free(dup);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	struct pending_args *mt;
+	unsigned long wait;
+	int status, result;
+
+	pool_lock();
+
+	starting--;
+
+	while (1) {
+		while (list_empty(&requests)) {
+			/* Workers started above the pool size aren't kept */
+			if (workers > max_workers) {
+				workers--;
+				stats.workers = workers;
+				pool_unlock();
+				return NULL;
+			}
+			idle++;
+			status = pthread_cond_wait(&work, &mutex);
+			idle--;
+			if (status)
+				fatal(status);
+		}
+
+		mt = list_entry(requests.next, struct pending_args, list);
+		list_del_init(&mt->list);
+		stats.depth--;
+
+		wait = elapsed_usec(&mt->queued);
+		stats.wait_usec += wait;
+		if (wait > stats.max_wait_usec)
+			stats.max_wait_usec = wait;
+
+		status = pthread_cond_signal(&space);
+		if (status)
+			fatal(status);
+
+		pool_unlock();
+
+		result = mt->handler(mt);
+
+		/*
+		 * Per thread mount context must not leak into requests
+		 * for other users or other autofs mounts.
+		 */
+		clear_tsd_user_vars();
+		clear_mnt_params();
+
+		/* Nothing is coalesced with mt once it's been dequeued */
+		pool_complete_dups(&mt->dups, result);
+		free(mt);
+
+		pool_lock();
+	}
+
+	return NULL;
+}
+
+/* Called with the pool mutex held */
+static int pool_start_worker(void)
+{
+	pthread_t thid;
+	int status;
+
+	status = pthread_create(&thid, &th_attr_detached, pool_worker, NULL);
+	if (status)
+		return status;
+
+	workers++;
+	starting++;
+	stats.workers = workers;
+
+	return 0;
+}
+
+static int time_before(struct timespec *t1, struct timespec *t2)
+{
+	if (t1->tv_sec != t2->tv_sec)
+		return t1->tv_sec < t2->tv_sec;
+	return t1->tv_nsec < t2->tv_nsec;
+}
+
+/*
+ * Start another worker when the oldest queued request has waited
+ * POOL_STALL_TIME seconds with no worker free to take it.
+ */
+static void *pool_monitor(void *arg)
+{
+	struct pending_args *mt;
+	struct timespec when, now;
+	int status;
+
+	pool_lock();
+
+	while (1) {
+		if (list_empty(&requests)) {
+			status = pthread_cond_wait(&stall, &mutex);
+			if (status)
+				fatal(status);
+			continue;
+		}
+
+		mt = list_entry(requests.next, struct pending_args, list);
+		when = mt->queued;
+		when.tv_sec += POOL_STALL_TIME;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (idle || starting || time_before(&now, &when)) {
+			/* A worker is about to take it, check again later */
+			if (!time_before(&now, &when)) {
+				when = now;
+				when.tv_sec += POOL_STALL_TIME;
+			}
+			status = pthread_cond_timedwait(&stall, &mutex, &when);
+			if (status && status != ETIMEDOUT)
+				fatal(status);
+			continue;
+		}
+
+		status = pool_start_worker();
+		if (status) {
+			error(mt->ap->logopt,
+			      "failed to start extra mount worker thread");
+			when = now;
+			when.tv_sec += POOL_STALL_TIME;
+			status = pthread_cond_timedwait(&stall, &mutex, &when);
+			if (status && status != ETIMEDOUT)
+				fatal(status);
+			continue;
+		}
+		stats.extra++;
+		debug(mt->ap->logopt,
+		      "no mount worker free, started extra worker");
+	}
+
+	return NULL;
+}
+
+int mount_pool_enabled(void)
+{
+	return max_workers != 0;
+}
+
+/*
+ * Queue a mount request to be processed by handler in a pool
+ * worker. A request for a mount that is already queued and not
+ * yet started is completed along with that request. If the queue
+ * is full the caller waits until there is room for the request.
+ * The pool owns mt once it has been queued.
+ */
+int mount_pool_add(struct pending_args *mt, int (*handler)(struct pending_args *))
+{
+	struct pending_args *this;
+	unsigned int throttled = 0;
+	int status;
+
+	INIT_LIST_HEAD(&mt->list);
+	INIT_LIST_HEAD(&mt->dups);
+	mt->handler = handler;
+
+	pool_lock();
+
+	while (1) {
+		this = pool_find_request(mt);
+		if (this) {
+			debug(mt->ap->logopt,
+			      "coalesced request for %s with pending request",
+			      mt->name);
+			list_add_tail(&mt->list, &this->dups);
+			stats.coalesced++;
+			pool_unlock();
+			return 0;
+		}
+
+		if (stats.depth < max_queue)
+			break;
+
+		if (!throttled) {
+			stats.throttled++;
+			throttled = 1;
+		}
+
+		status = pthread_cond_wait(&space, &mutex);
+		if (status)
+			fatal(status);
+	}
+
+	if (!idle && workers < max_workers) {
+		status = pool_start_worker();
+		if (status) {
+			/* Existing workers will get to it eventually */
+			if (!workers) {
+				pool_unlock();
+				return status;
+			}
+			error(mt->ap->logopt,
+			      "failed to start mount worker thread");
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &mt->queued);
+	list_add_tail(&mt->list, &requests);
+	stats.requests++;
+	stats.depth++;
+	if (stats.depth > stats.max_depth)
+		stats.max_depth = stats.depth;
+
+	status = pthread_cond_signal(&work);
+	if (status)
+		fatal(status);
+
+	/* Have the monitor check the request gets taken */
+	status = pthread_cond_signal(&stall);
+	if (status)
+		fatal(status);
+
+	pool_unlock();
+
+	return 0;
+}
+
+void mount_pool_get_stats(struct mount_pool_stats *pool_stats)
+{
+	pool_lock();
+	memcpy(pool_stats, &stats, sizeof(struct mount_pool_stats));
+	pool_unlock();
+}
+
+void mount_pool_log_stats(unsigned int logopt)
+{
+	struct mount_pool_stats ps;
+
+	if (!mount_pool_enabled())
+		return;
+
+	mount_pool_get_stats(&ps);
+
+	debug(logopt,
+	      "mount pool: workers %u, queue depth %u (max %u), "
+	      "requests %lu, coalesced %lu, throttled %lu, "
+	      "wait %lu usec (max %lu usec), extra workers %lu",
+	      ps.workers, ps.depth, ps.max_depth,
+	      ps.requests, ps.coalesced, ps.throttled,
+	      ps.requests ? ps.wait_usec / ps.requests : 0,
+	      ps.max_wait_usec, ps.extra);
+}
+
+int mount_pool_start_handler(void)
+{
+	pthread_condattr_t condattrs;
+	pthread_t thid;
+	int status;
+
+	max_workers = defaults_get_mount_pool_size();
+	max_queue = defaults_get_mount_pool_queue_size();
+	if (!max_queue)
+		max_queue = 1;
+
+	memset(&stats, 0, sizeof(struct mount_pool_stats));
+
+	if (!max_workers)
+		return 1;
+
+	status = pthread_condattr_init(&condattrs);
+	if (status)
+		fatal(status);
+
+	status = pthread_condattr_setclock(&condattrs, CLOCK_MONOTONIC);
+	if (status)
+		fatal(status);
+
+	status = pthread_cond_init(&stall, &condattrs);
+	if (status)
+		fatal(status);
+
+	pthread_condattr_destroy(&condattrs);
+
+	/* Workers are started on demand */
+	status = pthread_create(&thid, &th_attr_detached, pool_monitor, NULL);
+
+	return !status;
+}
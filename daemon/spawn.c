@@ -25,10 +25,15 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
+#include <sys/vfs.h>
 
 #include "automount.h"
 
 static pthread_mutex_t spawn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Mount latency histograms for mount(8) and mount(2) mounts */
+static struct mount_latency_stats latency[2];
 
 #define SPAWN_OPT_NONE		0x0000
 #define SPAWN_OPT_LOCK		0x0001
@@ -321,6 +326,37 @@ done:
 	}
 }
 
+static void mount_latency_record(unsigned int native, struct timespec *start)
+{
+	struct mount_latency_stats *stats = &latency[native ? 1 : 0];
+	struct timespec now;
+	unsigned long msec;
+	unsigned int bucket;
+	int status;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	msec = (now.tv_sec - start->tv_sec) * 1000;
+	msec += (now.tv_nsec - start->tv_nsec) / 1000000;
+
+	/* Bucket n holds latencies of less than 2^n milliseconds */
+	bucket = 0;
+	while (bucket < MOUNT_LATENCY_BUCKETS - 1 && msec >= (1UL << bucket))
+		bucket++;
+
+	status = pthread_mutex_lock(&stats_mutex);
+	if (status)
+		fatal(status);
+	stats->count++;
+	stats->total_msec += msec;
+	if (msec > stats->max_msec)
+		stats->max_msec = msec;
+	stats->hist[bucket]++;
+	status = pthread_mutex_unlock(&stats_mutex);
+	if (status)
+		fatal(status);
+}
+
 int spawnv(unsigned logopt, const char *prog, const char *const *argv)
 {
 	return do_spawn(logopt, -1, SPAWN_OPT_NONE, prog, argv);
@@ -362,6 +398,7 @@ int spawn_mount(unsigned logopt, ...)
 	int update_mtab = 1, ret, printed = 0;
 	unsigned int wait = defaults_get_mount_wait();
 	char buf[PATH_MAX + 1];
+	struct timespec start;
 
 	/* If we use mount locking we can't validate the location */
 #ifdef ENABLE_MOUNT_LOCKING
@@ -416,6 +453,8 @@ int spawn_mount(unsigned logopt, ...)
 	}
 	va_end(arg);
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	while (retries--) {
 		ret = do_spawn(logopt, wait, options, prog, (const char **) argv);
 		if (ret == MTAB_NOTUPDATED) {
@@ -464,6 +503,8 @@ int spawn_mount(unsigned logopt, ...)
 		ret = MNT_FORCE_FAIL;
 	}
 
+	mount_latency_record(0, &start);
+
 	return ret;
 }
 
@@ -490,6 +531,7 @@ int spawn_bind_mount(unsigned logopt, ...)
 	unsigned int retries = MTAB_LOCK_RETRIES;
 	int update_mtab = 1, ret, printed = 0;
 	char buf[PATH_MAX + 1];
+	struct timespec start;
 
 	/* If we use mount locking we can't validate the location */
 #ifdef ENABLE_MOUNT_LOCKING
@@ -534,6 +576,8 @@ int spawn_bind_mount(unsigned logopt, ...)
 	while ((*p++ = va_arg(arg, char *)));
 	va_end(arg);
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	while (retries--) {
 		ret = do_spawn(logopt, -1, options, prog, (const char **) argv);
 		if (ret == MTAB_NOTUPDATED) {
@@ -582,9 +626,293 @@ int spawn_bind_mount(unsigned logopt, ...)
 		ret = MNT_FORCE_FAIL;
 	}
 
+	mount_latency_record(0, &start);
+
 	return ret;
 }
 
+struct mount_flag_opt {
+	const char *name;
+	unsigned long flag;
+	unsigned int clear;
+};
+
+static const struct mount_flag_opt mount_flag_opts[] = {
+	{ "ro",		MS_RDONLY,	0 },
+	{ "rw",		MS_RDONLY,	1 },
+	{ "nosuid",	MS_NOSUID,	0 },
+	{ "suid",	MS_NOSUID,	1 },
+	{ "nodev",	MS_NODEV,	0 },
+	{ "dev",	MS_NODEV,	1 },
+	{ "noexec",	MS_NOEXEC,	0 },
+	{ "exec",	MS_NOEXEC,	1 },
+	{ "sync",	MS_SYNCHRONOUS,	0 },
+	{ "async",	MS_SYNCHRONOUS,	1 },
+	{ "dirsync",	MS_DIRSYNC,	0 },
+	{ "mand",	MS_MANDLOCK,	0 },
+	{ "nomand",	MS_MANDLOCK,	1 },
+	{ "noatime",	MS_NOATIME,	0 },
+	{ "atime",	MS_NOATIME,	1 },
+	{ "nodiratime",	MS_NODIRATIME,	0 },
+	{ "diratime",	MS_NODIRATIME,	1 },
+	{ "relatime",	MS_RELATIME,	0 },
+	{ "norelatime",	MS_RELATIME,	1 },
+	{ "strictatime", MS_STRICTATIME, 0 },
+	{ "bind",	MS_BIND,	0 },
+	{ "rbind",	MS_BIND|MS_REC,	0 },
+	{ NULL,		0,		0 }
+};
+
+/* Options used only by mount(8), the kernel doesn't know them */
+static const char *mount_user_opts[] = {
+	"defaults", "auto", "noauto", "user", "nouser", "users",
+	"owner", "group", "nofail", "_netdev", NULL
+};
+
+/*
+ * Split a mount option string into mount flags and the data
+ * passed to the file system. Returns -1 if the options need
+ * mount(8).
+ */
+static int mount_parse_options(const char *options,
+			       unsigned long *flags, char *data)
+{
+	const char *cp = options;
+	char *dp = data;
+
+	*flags = 0;
+	*data = '\0';
+
+	while (cp && *cp) {
+		const struct mount_flag_opt *fo;
+		const char **uo;
+		const char *end;
+		size_t len;
+
+		while (*cp == ',' || *cp == ' ' || *cp == '\t')
+			cp++;
+		end = cp;
+		while (*end && *end != ',')
+			end++;
+		len = end - cp;
+		while (len && (cp[len - 1] == ' ' || cp[len - 1] == '\t'))
+			len--;
+		if (!len) {
+			cp = end;
+			continue;
+		}
+
+		/* Loop devices and remounts need mount(8) */
+		if (!strncmp(cp, "loop", 4) || !_strncmp("remount", cp, len))
+			return -1;
+
+		for (fo = mount_flag_opts; fo->name; fo++) {
+			if (!_strncmp(fo->name, cp, len))
+				break;
+		}
+		if (fo->name) {
+			if (fo->clear)
+				*flags &= ~fo->flag;
+			else
+				*flags |= fo->flag;
+			cp = end;
+			continue;
+		}
+
+		for (uo = mount_user_opts; *uo; uo++) {
+			if (!_strncmp(*uo, cp, len))
+				break;
+		}
+		if (*uo || !strncmp(cp, "x-", 2) || !strncmp(cp, "comment=", 8)) {
+			cp = end;
+			continue;
+		}
+
+		if (dp != data)
+			*dp++ = ',';
+		memcpy(dp, cp, len);
+		dp += len;
+		*dp = '\0';
+
+		cp = end;
+	}
+
+	return 0;
+}
+
+/*
+ * File system types that can be mounted without a mount(8) helper.
+ * NFS mounts get the server address option added by the NFS module.
+ */
+static const char *native_fstypes[] = {
+	"bind", "ext2", "ext3", "ext4", "xfs", "nfs", "nfs4", NULL
+};
+
+static int native_fstype(const char *fstype)
+{
+	char helper[PATH_MAX + 1];
+	const char **ft;
+	int len;
+
+	for (ft = native_fstypes; *ft; ft++) {
+		if (!strcmp(*ft, fstype))
+			break;
+	}
+	if (!*ft)
+		return 0;
+
+	if (!strncmp(fstype, "nfs", 3))
+		return 1;
+
+	/* An installed mount helper may need to do more than mount(2) */
+	len = snprintf(helper, sizeof(helper), "/sbin/mount.%s", fstype);
+	if (len >= sizeof(helper) || !access(helper, F_OK))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Mount using mount(2) rather than running mount(8). This is only
+ * done if it's enabled in the configuration, the file system type
+ * doesn't need a mount helper, the mtab is a link to the proc mount
+ * table, there's no mount wait timeout and the mount doesn't need
+ * anything mount(8) does for us. Returns 0 on success,
+ * MNT_NATIVE_UNSUPPORTED if mount(8) must be used or an errno value
+ * if the mount failed.
+ */
+int native_mount(unsigned logopt, const char *what, const char *where,
+		 const char *fstype, const char *options)
+{
+	char buf[MAX_ERR_BUF];
+	char mtab[PATH_MAX + 1];
+	struct timespec start;
+	unsigned long flags;
+	char *data;
+	int ret, len;
+
+	if (!defaults_get_mount_native())
+		return MNT_NATIVE_UNSUPPORTED;
+
+	if (!native_fstype(fstype))
+		return MNT_NATIVE_UNSUPPORTED;
+
+	/* A mount(2) can't be timed out */
+	if ((int) defaults_get_mount_wait() != -1)
+		return MNT_NATIVE_UNSUPPORTED;
+
+	/* mount(8) needs to update the mtab */
+	len = readlink(_PATH_MOUNTED, mtab, PATH_MAX);
+	if (len == -1)
+		return MNT_NATIVE_UNSUPPORTED;
+	mtab[len] = '\0';
+	if (strcmp(mtab, _PROC_MOUNTS) && strcmp(mtab, _PROC_SELF_MOUNTS))
+		return MNT_NATIVE_UNSUPPORTED;
+
+	data = alloca(options ? strlen(options) + 1 : 1);
+	if (mount_parse_options(options, &flags, data) == -1)
+		return MNT_NATIVE_UNSUPPORTED;
+
+	if (!strcmp(fstype, "bind")) {
+		flags |= MS_BIND;
+		fstype = NULL;
+	}
+
+	/*
+	 * A local mount location may need to be automounted, which
+	 * can't be triggered from the daemon, so leave that to mount(8)
+	 * which does it as the requesting user. A location that hasn't
+	 * been mounted yet shows up as an autofs file system.
+	 */
+	if (*what == '/') {
+		struct statfs fs;
+
+		if (statfs(what, &fs) == -1 || fs.f_type == AUTOFS_SUPER_MAGIC)
+			return MNT_NATIVE_UNSUPPORTED;
+	}
+
+	debug(logopt, "calling mount(2) %s on %s type %s flags 0x%lx data %s",
+	      what, where, fstype ? fstype : "none", flags, data);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ret = mount(what, where, fstype, flags, *data ? data : NULL);
+	if (!ret && (flags & MS_BIND) && (flags & ~(MS_BIND|MS_REC))) {
+		/* Bind mount flags can only be set by a remount */
+		ret = mount("none", where, NULL, flags | MS_REMOUNT, NULL);
+		if (ret) {
+			int save_errno = errno;
+			umount(where);
+			errno = save_errno;
+		}
+	}
+
+	if (ret) {
+		ret = errno;
+		switch (ret) {
+		/* Let mount(8) work out what's needed */
+		case EINVAL:
+		case ENODEV:
+		case ENOTBLK:
+		case ENOSYS:
+		case EOPNOTSUPP:
+		case EPROTONOSUPPORT:
+			debug(logopt, "mount(2) %s on %s failed: %s, "
+			      "falling back to mount(8)",
+			      what, where, strerror_r(ret, buf, MAX_ERR_BUF));
+			return MNT_NATIVE_UNSUPPORTED;
+		}
+		warn(logopt, ">> mount(2) %s on %s failed: %s",
+		     what, where, strerror_r(ret, buf, MAX_ERR_BUF));
+	}
+
+	mount_latency_record(1, &start);
+
+	return ret;
+}
+
+void mount_latency_get_stats(struct mount_latency_stats *stats,
+			     unsigned int native)
+{
+	int status;
+
+	status = pthread_mutex_lock(&stats_mutex);
+	if (status)
+		fatal(status);
+	memcpy(stats, &latency[native ? 1 : 0],
+	       sizeof(struct mount_latency_stats));
+	status = pthread_mutex_unlock(&stats_mutex);
+	if (status)
+		fatal(status);
+}
+
+void mount_latency_log_stats(unsigned int logopt)
+{
+	const char *name[] = { "mount(8)", "mount(2)" };
+	unsigned int i, j;
+
+	for (i = 0; i < 2; i++) {
+		struct mount_latency_stats stats;
+		char hist[MOUNT_LATENCY_BUCKETS * 21 + 1];
+		char *p = hist;
+
+		mount_latency_get_stats(&stats, i);
+		if (!stats.count)
+			continue;
+
+		*p = '\0';
+		for (j = 0; j < MOUNT_LATENCY_BUCKETS; j++)
+			p += sprintf(p, " %lu", stats.hist[j]);
+
+		debug(logopt,
+		      "%s mounts: count %lu, average %lu msec, max %lu msec, "
+		      "latency histogram (< 1, 2, 4 ... msec):%s",
+		      name[i], stats.count, stats.total_msec / stats.count,
+		      stats.max_msec, hist);
+	}
+}
+
+
 int spawn_umount(unsigned logopt, ...)
 {
 	va_list arg;
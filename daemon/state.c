@@ -16,7 +16,8 @@
 
 #include "automount.h"
 
-/* Attribute to create detached thread */
+/* Attributes to create threads */
+extern pthread_attr_t th_attr;
 extern pthread_attr_t th_attr_detached;
 
 struct state_queue {
@@ -207,6 +208,247 @@ void expire_cleanup(void *arg)
 	return;
 }
 
+void expire_mounts_init(struct expire_mounts *em,
+			struct autofs_point *ap, unsigned int when)
+{
+	memset(em, 0, sizeof(struct expire_mounts));
+	em->ap = ap;
+	em->when = when;
+	clock_gettime(CLOCK_MONOTONIC, &em->start);
+}
+
+void expire_mounts_cleanup(void *arg)
+{
+	struct expire_mounts *em = (struct expire_mounts *) arg;
+	unsigned int i;
+
+	for (i = 0; i < em->count; i++)
+		free(em->mounts[i].path);
+	if (em->mounts)
+		free(em->mounts);
+	em->mounts = NULL;
+	em->count = em->size = 0;
+}
+
+/* Called with cancellation disabled */
+static int expire_mount_ioctlfd(struct autofs_point *ap, const char *path)
+{
+	struct mapent *me;
+	int ioctlfd = -1;
+
+	master_source_readlock(ap->entry);
+	me = lookup_source_mapent(ap, path, LKP_DISTINCT);
+	master_source_unlock(ap->entry);
+	if (me) {
+		ioctlfd = me->ioctlfd;
+		cache_unlock(me->mc);
+	}
+
+	return ioctlfd;
+}
+
+static int expire_mount(struct expire_mounts *em, const char *path, int ioctlfd)
+{
+	struct ioctl_ops *ops = get_ioctl_ops();
+	struct autofs_point *ap = em->ap;
+	struct timespec start;
+	int cur_state, ret;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+	/*
+	 * The map entry ioctl fd can be closed or replaced while the
+	 * rest of the mounts are found so it's read when the expire
+	 * is sent. If it's gone there's nothing left to expire.
+	 */
+	if (ioctlfd == -1) {
+		ioctlfd = expire_mount_ioctlfd(ap, path);
+		if (ioctlfd == -1) {
+			pthread_setcancelstate(cur_state, NULL);
+			return 0;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = ops->expire(ap->logopt, ioctlfd, path, em->when);
+	mount_stage_record(ap, MOUNT_STAGE_EXPIRE, &start);
+	pthread_setcancelstate(cur_state, NULL);
+
+	return ret;
+}
+
+/*
+ * Queue a mount to be sent an expire request by expire_mounts_run().
+ * If ioctlfd is -1 the ioctl fd of the map entry for path is used.
+ * If it can't be queued the request is sent now and the result of
+ * the expire is returned.
+ */
+int expire_mounts_add(struct expire_mounts *em, const char *path, int ioctlfd)
+{
+	struct expire_mount *this;
+	const char *cp;
+	char *tmp;
+
+	if (em->count == em->size) {
+		unsigned int size = em->size ? em->size * 2 : 64;
+
+		this = realloc(em->mounts, size * sizeof(struct expire_mount));
+		if (!this)
+			return expire_mount(em, path, ioctlfd);
+		em->mounts = this;
+		em->size = size;
+	}
+
+	tmp = strdup(path);
+	if (!tmp)
+		return expire_mount(em, path, ioctlfd);
+
+	this = &em->mounts[em->count++];
+	this->path = tmp;
+	this->ioctlfd = ioctlfd;
+	this->depth = 0;
+	for (cp = path; *cp; cp++)
+		if (*cp == '/')
+			this->depth++;
+
+	return 0;
+}
+
+static int expire_mount_cmp(const void *a, const void *b)
+{
+	const struct expire_mount *m1 = a;
+	const struct expire_mount *m2 = b;
+
+	if (m1->depth != m2->depth)
+		return m1->depth > m2->depth ? -1 : 1;
+
+	return strcmp(m1->path, m2->path);
+}
+
+/* Mounts at one path depth, shared by the threads expiring them */
+struct expire_level {
+	struct expire_mounts *em;
+	struct expire_mount *mounts;
+	unsigned int count;
+	unsigned int next;
+	unsigned int left;
+};
+
+static void *do_expire_mounts(void *arg)
+{
+	struct expire_level *el = (struct expire_level *) arg;
+	unsigned int n;
+
+	while ((n = __atomic_fetch_add(&el->next, 1, __ATOMIC_RELAXED)) < el->count) {
+		struct expire_mount *this = &el->mounts[n];
+
+		debug(el->em->ap->logopt, "expire %s", this->path);
+
+		if (expire_mount(el->em, this->path, this->ioctlfd))
+			__atomic_add_fetch(&el->left, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+/*
+ * Send expire requests to the queued mounts and return the number
+ * that could not be expired. Mounts are expired a path depth at a
+ * time, deepest first, by up to expire_threads threads, so a mount
+ * is never expired before the mounts below it.
+ */
+int expire_mounts_run(struct expire_mounts *em)
+{
+	unsigned int max_threads, i, j;
+	pthread_t *threads;
+	int cur_state, left;
+
+	if (!em->count)
+		return 0;
+
+	qsort(em->mounts, em->count,
+	      sizeof(struct expire_mount), expire_mount_cmp);
+
+	max_threads = defaults_get_expire_threads();
+	if (max_threads > em->count)
+		max_threads = em->count;
+
+	threads = NULL;
+	if (max_threads > 1) {
+		threads = malloc((max_threads - 1) * sizeof(pthread_t));
+		if (!threads)
+			max_threads = 1;
+	}
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+
+	left = 0;
+	for (i = 0; i < em->count; i = j) {
+		struct expire_level el;
+		unsigned int started = 0, n;
+
+		for (j = i + 1; j < em->count; j++)
+			if (em->mounts[j].depth != em->mounts[i].depth)
+				break;
+
+		el.em = em;
+		el.mounts = &em->mounts[i];
+		el.count = j - i;
+		el.next = 0;
+		el.left = 0;
+
+		/* This thread expires mounts too */
+		n = min(max_threads, el.count);
+		while (started + 1 < n) {
+			if (pthread_create(&threads[started], &th_attr,
+					   do_expire_mounts, &el))
+				break;
+			started++;
+		}
+
+		do_expire_mounts(&el);
+
+		while (started)
+			pthread_join(threads[--started], NULL);
+
+		left += el.left;
+	}
+
+	em->expired += em->count - left;
+	em->left += left;
+
+	pthread_setcancelstate(cur_state, NULL);
+
+	if (threads)
+		free(threads);
+	expire_mounts_cleanup(em);
+
+	return left;
+}
+
+/* Record and log the time taken by the expire run */
+void expire_mounts_report(struct expire_mounts *em)
+{
+	struct autofs_point *ap = em->ap;
+	struct timespec now;
+	long sec, nsec;
+
+	mount_stage_record(ap, MOUNT_STAGE_SWEEP, &em->start);
+
+	if (!em->expired && !em->left)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sec = now.tv_sec - em->start.tv_sec;
+	nsec = now.tv_nsec - em->start.tv_nsec;
+	if (nsec < 0) {
+		sec--;
+		nsec += 1000000000L;
+	}
+
+	debug(ap->logopt,
+	      "expire of %s sent to %u mounts (%u busy) in %ld.%03ld seconds",
+	      ap->path, em->expired + em->left, em->left, sec, nsec / 1000000);
+}
+
 static unsigned int st_ready(struct autofs_point *ap)
 {
 	debug(ap->logopt,
@@ -340,15 +582,16 @@ static void do_readmap_cleanup(void *arg)
 	return;
 }
 
-static void tree_mnts_cleanup(void *arg)
+static void mnt_snapshot_cleanup(void *arg)
 {
-	struct mnt_list *mnts = (struct mnt_list *) arg;
-	tree_free_mnt_tree(mnts);
+	struct mnt_snapshot *snap = (struct mnt_snapshot *) arg;
+	mnt_snapshot_put(snap);
 	return;
 }
 
 static void do_readmap_mount(struct autofs_point *ap, struct mnt_list *mnts,
-			     struct map_source *map, struct mapent *me, time_t now)
+			     struct direct_triggers *dt, struct map_source *map,
+			     struct mapent *me, time_t now)
 {
 	struct mapent_cache *nc;
 	struct mapent *ne, *nested, *valid;
@@ -432,7 +675,7 @@ static void do_readmap_mount(struct autofs_point *ap, struct mnt_list *mnts,
 			debug(ap->logopt,
 			      "%s is mounted", me->key);
 	} else
-		do_mount_autofs_direct(ap, mnts, me, map->exp_timeout);
+		direct_triggers_add(ap, mnts, dt, me, map->exp_timeout);
 
 	return;
 }
@@ -443,6 +686,7 @@ static void *do_readmap(void *arg)
 	struct map_source *map;
 	struct mapent_cache *nc, *mc;
 	struct readmap_args *ra;
+	struct mnt_snapshot *snap;
 	struct mnt_list *mnts;
 	int status;
 	time_t now;
@@ -472,8 +716,8 @@ static void *do_readmap(void *arg)
 
 	info(ap->logopt, "re-reading map for %s", ap->path);
 
-	pthread_cleanup_push(master_mutex_lock_cleanup, NULL);
-	master_mutex_lock();
+	pthread_cleanup_push(master_maps_lock_cleanup, ap->entry);
+	master_maps_lock(ap->entry);
 	status = lookup_nss_read_map(ap, NULL, now);
 	if (!status)
 		pthread_exit(NULL);
@@ -488,10 +732,16 @@ static void *do_readmap(void *arg)
 		status = lookup_ghost(ap, ap->path);
 	} else {
 		struct mapent *me;
+		struct direct_triggers dt;
 		unsigned int append_alarm = !ap->exp_runfreq;
 
-		mnts = tree_make_mnt_tree(_PROC_MOUNTS, "/");
-		pthread_cleanup_push(tree_mnts_cleanup, mnts);
+		direct_triggers_init(&dt);
+
+		/* Shared with the other direct mounts re-reading their maps */
+		snap = mnt_snapshot_get();
+		mnts = snap ? snap->tree : NULL;
+		pthread_cleanup_push(mnt_snapshot_cleanup, snap);
+		pthread_cleanup_push(direct_triggers_cleanup, &dt);
 		nc = ap->entry->master->nc;
 		cache_readlock(nc);
 		pthread_cleanup_push(cache_lock_cleanup, nc);
@@ -509,9 +759,10 @@ static void *do_readmap(void *arg)
 			cache_readlock(mc);
 			me = cache_enumerate(mc, NULL);
 			while (me) {
-				do_readmap_mount(ap, mnts, map, me, now);
+				do_readmap_mount(ap, mnts, &dt, map, me, now);
 				me = cache_enumerate(mc, me);
 			}
+			direct_triggers_mount(ap, &dt);
 			lookup_prune_one_cache(ap, map->mc, now);
 			pthread_cleanup_pop(1);
 			clear_stale_instances(map);
@@ -530,6 +781,9 @@ static void *do_readmap(void *arg)
 		pthread_cleanup_pop(1);
 		pthread_cleanup_pop(1);
 		pthread_cleanup_pop(1);
+		pthread_cleanup_pop(1);
+
+		direct_triggers_report(ap, &dt);
 	}
 
 	pthread_cleanup_pop(1);
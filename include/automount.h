@@ -8,6 +8,7 @@
 #ifndef AUTOMOUNT_H
 #define AUTOMOUNT_H
 
+#include <stdio.h>
 #include <paths.h>
 #include <limits.h>
 #include <time.h>
@@ -85,6 +86,7 @@ int load_autofs4_module(void);
 #define MTAB_NOTUPDATED 0x1000			/* mtab succeded but not updated */
 #define NOT_MOUNTED     0x0100			/* path notmounted */
 #define MNT_FORCE_FAIL	-1
+#define MNT_NATIVE_UNSUPPORTED	-2		/* Use mount(8) for the mount */
 #define _PROC_MOUNTS		"/proc/mounts"
 #define _PROC_SELF_MOUNTS	"/proc/self/mounts"
 
@@ -155,14 +157,74 @@ static u_int32_t inline hash(const char *key, unsigned int size)
 	return hashval % size;
 }
 
-struct mapent_cache {
+/* A cache reader lock, each on its own cache line */
+struct cache_lock {
 	pthread_rwlock_t rwlock;
+} __attribute__((aligned(64)));
+
+/* A lock of a stripe of inode index slots */
+struct cache_ino_lock {
+	pthread_mutex_t mutex;
+} __attribute__((aligned(64)));
+
+/* A path name component of the cache key prefix index */
+struct cache_path {
+	struct cache_path *next;	/* Index hash chain */
+	struct cache_path *parent;
+	struct list_head children;
+	struct list_head sibling;
+	struct mapent *me;		/* An entry with this path as key */
+	unsigned int count;		/* Entries at and below this path */
+	unsigned int wild;		/* Children with names starting with '*' */
+	u_int32_t hashval;
+	unsigned int len;
+	char name[];
+};
+
+struct mapent_cache {
+	/*
+	 * Readers take one of the locks chosen by thread, writers
+	 * take all of them so readers don't share a cache line.
+	 */
+	struct cache_lock *locks;
+	unsigned int nr_locks;
+	unsigned int write_locked;	/* Set while writer holds locks */
+	pthread_t writer;
 	unsigned int size;
-	pthread_mutex_t ino_index_mutex;
+	unsigned int min_size;		/* Never shrink below this size */
+	unsigned int entries;		/* Number of entries in the cache */
+	/* Slots whose numbers are equal modulo the locks share a lock */
+	struct cache_ino_lock *ino_locks;
+	unsigned int ino_size;
+	unsigned int ino_entries;	/* Number of entries in the index */
 	struct list_head *ino_index;
+	/* Keys indexed by path name component for prefix lookups */
+	struct cache_path *path_root;
+	struct cache_path **path_index;
+	unsigned int path_size;
+	unsigned int path_nodes;	/* Number of components in the index */
 	struct autofs_point *ap;
 	struct map_source *map;
 	struct mapent **hash;
+	/* Table being migrated to hash during a resize */
+	struct mapent **old_hash;
+	unsigned int old_size;
+	unsigned int rehash_pos;	/* Next old_hash slot to move */
+	unsigned int resizes;		/* Number of resizes done */
+	unsigned int resize_hold;	/* Enumerations that stop resizing */
+};
+
+struct mapent_cache_stats {
+	unsigned int size;		/* Number of hash slots */
+	unsigned int entries;		/* Number of entries */
+	unsigned int used;		/* Number of non-empty slots */
+	unsigned int max_chain;		/* Longest hash chain */
+	unsigned int resizes;		/* Number of resizes done */
+	unsigned int rehashing;		/* Resize in progress */
+	unsigned int ino_size;		/* Number of inode index slots */
+	unsigned int ino_entries;	/* Number of inode index entries */
+	unsigned int ino_used;		/* Number of non-empty index slots */
+	unsigned int ino_max_chain;	/* Longest inode index chain */
 };
 
 struct stack {
@@ -171,6 +233,33 @@ struct stack {
 	struct stack *next;
 };
 
+/* A multi-mount offset of a parsed map entry */
+struct mapent_offset {
+	struct list_head list;
+	char *path;
+	char *options;
+	char *loc;
+};
+
+/*
+ * Parsed form of a map entry, kept with the cache entry so that it
+ * can be reused while the entry age and the expanded map entry it
+ * was parsed from don't change.
+ */
+struct mapent_parse {
+	unsigned int refs;
+	time_t age;
+	char *entry;			/* Expanded map entry */
+	char *optstr;			/* Global options when parsed */
+	unsigned int append;		/* Global options were appended */
+	unsigned int offset;		/* Entry is a multi-mount offset */
+	unsigned int multi;		/* Entry is a multi-mount */
+	char *options;			/* Gathered mount options */
+	const char *rest;		/* Entry following the options */
+	char *loc;			/* Location of a normal entry */
+	struct list_head offsets;	/* Offsets of a multi-mount */
+};
+
 struct mapent {
 	struct mapent *next;
 	struct list_head ino_index;
@@ -185,6 +274,8 @@ struct mapent {
 	char *key;
 	char *mapent;
 	struct stack *stack;
+	/* Parsed form of mapent if the parser keeps one */
+	struct mapent_parse *parsed;
 	time_t age;
 	/* Time of last mount fail */
 	time_t status;
@@ -232,6 +323,13 @@ void cache_clean_null_cache(struct mapent_cache *mc);
 void cache_release_null_cache(struct master *master);
 struct mapent *cache_enumerate(struct mapent_cache *mc, struct mapent *me);
 char *cache_get_offset(const char *prefix, char *offset, int start, struct list_head *head, struct list_head **pos);
+void cache_resize_hold(struct mapent_cache *mc);
+void cache_resize_put(struct mapent_cache *mc);
+void cache_resize_release(struct mapent_cache *mc);
+void cache_get_stats(struct mapent_cache *mc, struct mapent_cache_stats *stats);
+struct mapent_parse *cache_get_parsed(struct mapent *me);
+void cache_set_parsed(struct mapent *me, struct mapent_parse *parsed);
+void cache_put_parsed(struct mapent_parse *parsed);
 
 /* Utility functions */
 
@@ -248,8 +346,40 @@ int spawnl(unsigned logopt, const char *prog, ...);
 int spawnv(unsigned logopt, const char *prog, const char *const *argv);
 int spawn_mount(unsigned logopt, ...);
 int spawn_bind_mount(unsigned logopt, ...);
+int native_mount(unsigned logopt, const char *what, const char *where,
+		 const char *fstype, const char *options);
 int spawn_umount(unsigned logopt, ...);
 void reset_signals(void);
+
+#define MOUNT_LATENCY_BUCKETS	16
+
+struct mount_latency_stats {
+	unsigned long count;
+	unsigned long total_msec;
+	unsigned long max_msec;
+	unsigned long hist[MOUNT_LATENCY_BUCKETS];
+};
+
+void mount_latency_get_stats(struct mount_latency_stats *stats, unsigned int native);
+void mount_latency_log_stats(unsigned int logopt);
+
+/* Stages of mount requests and expires timed for each autofs point */
+#define MOUNT_STAGE_LOOKUP	0	/* Map source lookup module */
+#define MOUNT_STAGE_PARSE	1	/* Map entry parse and mount */
+#define MOUNT_STAGE_PROBE	2	/* NFS server availability probe */
+#define MOUNT_STAGE_MOUNT	3	/* Mount module */
+#define MOUNT_STAGE_TOTAL	4	/* Whole mount request */
+#define MOUNT_STAGE_EXPIRE	5	/* Expire request for one mount */
+#define MOUNT_STAGE_SWEEP	6	/* Whole expire run */
+#define MOUNT_STAGES		7
+
+struct autofs_point;
+struct map_source;
+
+void mount_stats_record(struct mount_latency_stats *stats, struct timespec *start);
+void mount_stage_record(struct autofs_point *ap, unsigned int stage, struct timespec *start);
+void mount_source_record(struct map_source *map, struct timespec *start);
+int mount_stats_write(struct autofs_point *ap, FILE *f);
 int do_mount(struct autofs_point *ap, const char *root, const char *name,
 	     int name_len, const char *what, const char *fstype,
 	     const char *options);
@@ -426,6 +556,10 @@ struct pending_args {
 	uid_t uid;			/* uid of requestor */
 	gid_t gid;			/* gid of requestor */
 	unsigned long wait_queue_token;	/* Associated kernel wait token */
+	struct list_head list;		/* Mount pool request queue */
+	struct list_head dups;		/* Requests for the same mount */
+	struct timespec queued;		/* Time request was queued */
+	int (*handler)(struct pending_args *);
 };
 
 #ifdef INCLUDE_PENDING_FUNCTIONS
@@ -554,6 +688,8 @@ struct autofs_point {
 	unsigned int shutdown;		/* Shutdown notification */
 	unsigned int submnt_count;	/* Number of submounts */
 	struct list_head submounts;	/* List of child submounts */
+	/* Latency of the stages of mount requests */
+	struct mount_latency_stats stage_stats[MOUNT_STAGES];
 };
 
 /* Foreably unlink existing mounts at startup. */
@@ -561,6 +697,27 @@ extern int do_force_unlink;
 
 /* Standard functions used by daemon or modules */
 
+/* A direct mount trigger waiting to be mounted */
+struct direct_trigger {
+	struct mapent *me;
+	time_t timeout;
+	unsigned int depth;		/* Number of path components */
+};
+
+/*
+ * Direct mount triggers found when reading a map, mounted together
+ * once the map has been read.
+ */
+struct direct_triggers {
+	struct direct_trigger *triggers;
+	unsigned int count;
+	unsigned int size;
+	unsigned int mounted;		/* Triggers mounted so far */
+	unsigned int failed;		/* Triggers that failed to mount */
+	struct timespec start;		/* When the map read started */
+	struct timespec busy;		/* Time spent mounting triggers */
+};
+
 #define	MOUNT_OFFSET_OK		0
 #define	MOUNT_OFFSET_FAIL	-1
 #define MOUNT_OFFSET_IGNORE	-2
@@ -573,8 +730,15 @@ void *expire_proc_direct(void *);
 int expire_offsets_direct(struct autofs_point *ap, struct mapent *me, int now);
 int mount_autofs_indirect(struct autofs_point *ap, const char *root);
 int do_mount_autofs_direct(struct autofs_point *ap, struct mnt_list *mnts, struct mapent *me, time_t timeout);
+void direct_triggers_init(struct direct_triggers *dt);
+int direct_triggers_add(struct autofs_point *ap, struct mnt_list *mnts,
+			struct direct_triggers *dt, struct mapent *me, time_t timeout);
+void direct_triggers_mount(struct autofs_point *ap, struct direct_triggers *dt);
+void direct_triggers_report(struct autofs_point *ap, struct direct_triggers *dt);
+void direct_triggers_cleanup(void *arg);
 int mount_autofs_direct(struct autofs_point *ap);
 int mount_autofs_offset(struct autofs_point *ap, struct mapent *me, const char *root, const char *offset);
+void clear_mnt_params(void);
 void submount_signal_parent(struct autofs_point *ap, unsigned int success);
 void close_mount_fds(struct autofs_point *ap);
 int umount_autofs(struct autofs_point *ap, const char *root, int force);
@@ -618,6 +782,25 @@ int alarm_start_handler(void);
 int alarm_add(struct autofs_point *ap, time_t seconds);
 void alarm_delete(struct autofs_point *ap);
 
+/* Mount request worker pool */
+struct mount_pool_stats {
+	unsigned int workers;		/* Worker threads running */
+	unsigned int depth;		/* Requests waiting for a worker */
+	unsigned int max_depth;		/* Maximum queue depth seen */
+	unsigned long requests;		/* Requests queued */
+	unsigned long coalesced;	/* Requests merged with a pending request */
+	unsigned long throttled;	/* Requests that waited for queue space */
+	unsigned long wait_usec;	/* Total time requests spent queued */
+	unsigned long max_wait_usec;	/* Longest time a request spent queued */
+	unsigned long extra;		/* Workers started above the pool size */
+};
+
+int mount_pool_start_handler(void);
+int mount_pool_enabled(void);
+int mount_pool_add(struct pending_args *mt, int (*handler)(struct pending_args *));
+void mount_pool_get_stats(struct mount_pool_stats *pool_stats);
+void mount_pool_log_stats(unsigned int logopt);
+
 /*
  * Use CLOEXEC flag for open(), pipe(), fopen() (read-only case) and
  * socket() if possible.
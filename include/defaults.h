@@ -34,6 +34,8 @@
 
 #define DEFAULT_LDAP_TIMEOUT		"-1"
 #define DEFAULT_LDAP_NETWORK_TIMEOUT	"8"
+#define DEFAULT_LDAP_CONNECTION_POOL_SIZE	"0"
+#define DEFAULT_LDAP_CONNECTION_IDLE_TIMEOUT	"60"
 
 #define DEFAULT_MAP_OBJ_CLASS		"nisMap"
 #define DEFAULT_ENTRY_OBJ_CLASS		"nisObject"
@@ -42,12 +44,24 @@
 #define DEFAULT_VALUE_ATTR		"nisMapEntry"
 
 #define DEFAULT_MOUNT_NFS_DEFAULT_PROTOCOL	"3"
+#define DEFAULT_MOUNT_NFS_PROBE_CACHE_TIMEOUT	"0"
 #define DEFAULT_APPEND_OPTIONS		"1"
 #define DEFAULT_AUTH_CONF_FILE		AUTOFS_MAP_DIR "/autofs_ldap_auth.conf"
 
 #define DEFAULT_MAP_HASH_TABLE_SIZE	"1024"
 
 #define DEFAULT_USE_HOSTNAME_FOR_MOUNTS	"0"
+#define DEFAULT_FILE_MAP_INDEX		"0"
+#define DEFAULT_MOUNT_POOL_SIZE		"0"
+#define DEFAULT_MOUNT_POOL_QUEUE_SIZE	"1024"
+#define DEFAULT_MOUNT_NATIVE		"0"
+#define DEFAULT_DIRECT_MOUNT_THREADS	"1"
+#define DEFAULT_LOG_QUEUE_SIZE		"0"
+#define DEFAULT_LOG_RATE_LIMIT		"0"
+#define DEFAULT_EXPIRE_THREADS		"1"
+#define DEFAULT_HOSTS_EXPORTS_TIMEOUT	"10"
+#define DEFAULT_HOSTS_EXPORTS_THREADS	"8"
+#define DEFAULT_HOSTS_EXPORTS_DEADLINE	"30"
 
 /* Config entry flags */
 #define CONF_NONE			0x00000000
@@ -158,13 +172,27 @@ unsigned int defaults_force_std_prog_map_env(void);
 const char *defaults_get_ldap_server(void);
 unsigned int defaults_get_ldap_timeout(void);
 unsigned int defaults_get_ldap_network_timeout(void);
+unsigned int defaults_get_ldap_connection_pool_size(void);
+unsigned int defaults_get_ldap_connection_idle_timeout(void);
 unsigned int defaults_get_mount_nfs_default_proto(void);
+unsigned int defaults_get_mount_nfs_probe_cache_timeout(void);
 unsigned int defaults_get_append_options(void);
 unsigned int defaults_get_mount_wait(void);
 unsigned int defaults_get_umount_wait(void);
 const char *defaults_get_auth_conf_file(void);
 unsigned int defaults_get_map_hash_table_size(void);
 unsigned int defaults_use_hostname_for_mounts(void);
+unsigned int defaults_get_file_map_index(void);
+unsigned int defaults_get_mount_pool_size(void);
+unsigned int defaults_get_mount_pool_queue_size(void);
+unsigned int defaults_get_mount_native(void);
+unsigned int defaults_get_direct_mount_threads(void);
+unsigned int defaults_get_log_queue_size(void);
+unsigned int defaults_get_log_rate_limit(void);
+unsigned int defaults_get_expire_threads(void);
+unsigned int defaults_get_hosts_exports_timeout(void);
+unsigned int defaults_get_hosts_exports_threads(void);
+unsigned int defaults_get_hosts_exports_deadline(void);
 
 unsigned int conf_amd_mount_section_exists(const char *);
 char *conf_amd_get_arch(void);
@@ -38,6 +38,9 @@ extern void set_mnt_logging(unsigned global_logopt);
 extern void open_log(void);
 extern void log_to_syslog(void);
 extern void log_to_stderr(void);
+extern int log_async_start(unsigned int queue_size, unsigned int rate_limit);
+extern void log_async_stop(void);
+extern void log_async_log_stats(unsigned int logopt);
  
 extern void log_info(unsigned int, const char* msg, ...);
 extern void log_notice(unsigned int, const char* msg, ...);
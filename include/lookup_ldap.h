@@ -39,6 +39,9 @@ struct ldap_conn {
 #ifdef WITH_SASL
 	sasl_conn_t *sasl_conn;
 #endif
+	/* Idle connection pool */
+	struct list_head list;
+	time_t last_used;
 };
 
 struct lookup_context {
@@ -77,6 +80,18 @@ struct lookup_context {
 	char *cur_host;
 	struct ldap_searchdn *sdns;
 
+	/*
+	 * Bound connections not currently in use. Lookups take a
+	 * connection from the list and return it when done so that
+	 * a new connection is only needed when one has failed.
+	 */
+	pthread_mutex_t conns_mutex;
+	unsigned int mutexes_init;	/* uris and conns mutexes are usable */
+	struct list_head conns;
+	unsigned int conns_count;
+	unsigned int conns_max;
+	unsigned int conns_idle_timeout;
+
 	/* TLS and SASL authentication information */
 	char        *auth_conf;
 	unsigned     use_tls;
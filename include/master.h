@@ -31,6 +31,8 @@ struct map_source {
 	time_t age;
 	unsigned int master_line;
 	struct mapent_cache *mc;
+	/* Lookup latency, allocated when first needed */
+	struct mount_latency_stats *lookup_stats;
 	unsigned int stale;
 	unsigned int recurse;
 	unsigned int depth;
@@ -47,6 +49,7 @@ struct master_mapent {
 	time_t age;
 	struct master *master;
 	pthread_rwlock_t source_lock;
+	pthread_mutex_t maps_mutex;
 	pthread_mutex_t current_mutex;
 	pthread_cond_t current_cond;
 	struct map_source *current;
@@ -100,6 +103,9 @@ void master_source_writelock(struct master_mapent *);
 void master_source_readlock(struct master_mapent *);
 void master_source_unlock(struct master_mapent *);
 void master_source_lock_cleanup(void *);
+void master_maps_lock(struct master_mapent *);
+void master_maps_unlock(struct master_mapent *);
+void master_maps_lock_cleanup(void *);
 void master_source_current_wait(struct master_mapent *);
 void master_source_current_signal(struct master_mapent *);
 struct master_mapent *master_find_mapent(struct master *, const char *);
@@ -71,6 +71,26 @@ struct mnt_list {
 };
 
 
+struct mnt_table_stats {
+	unsigned long reparses;		/* Times the mount table was parsed */
+	unsigned long avoided;		/* Parses avoided by the cached table */
+	unsigned long tree_builds;	/* Times a mount snapshot was made */
+	unsigned long tree_reused;	/* Snapshots shared while unchanged */
+};
+
+/*
+ * A tree of all the mounts in the proc mount table, shared while
+ * the mount table is unchanged. The tree must not be changed so
+ * only tree_is_mounted() and tree_get_mnt_array() may be used on it.
+ */
+struct mnt_snapshot {
+	unsigned int refs;
+	unsigned long generation;	/* Mount table generation, 0 if not shared */
+	struct mnt_list *tree;
+	struct mnt_list **index;	/* Mounts ordered by path, made when needed */
+	unsigned int count;
+};
+
 struct nfs_mount_vers {
 	unsigned int major;
 	unsigned int minor;
@@ -82,8 +102,18 @@ extern unsigned int nfs_mount_uses_string_options;
 
 struct amd_entry;
 
+/* Storage for the standard environment variables of a request */
+struct stdenv_vars {
+	struct substvar vars[6];
+	unsigned int count;
+	char uid[16];
+	char gid[16];
+	char shost[HOST_NAME_MAX + 1];
+};
+
 struct substvar *addstdenv(struct substvar *sv, const char *prefix);
 struct substvar *removestdenv(struct substvar *sv, const char *prefix);
+struct substvar *stdenv_overlay(struct stdenv_vars *env, struct substvar *sv);
 void add_std_amd_vars(struct substvar *sv);
 void remove_std_amd_vars(void);
 struct amd_entry *new_amd_entry(const struct substvar *sv);
@@ -98,6 +128,8 @@ char *make_options_string(char *path, int kernel_pipefd, const char *extra);
 char *make_mnt_name_string(char *path);
 int ext_mount_add(struct list_head *, const char *, unsigned int);
 int ext_mount_remove(struct list_head *, const char *);
+void mnt_table_get_stats(struct mnt_table_stats *stats);
+void mnt_table_log_stats(unsigned int logopt);
 struct mnt_list *get_mnt_list(const char *table, const char *path, int include);
 struct mnt_list *reverse_mnt_list(struct mnt_list *list);
 void free_mnt_list(struct mnt_list *list);
@@ -106,11 +138,18 @@ int is_mounted(const char *table, const char *path, unsigned int type);
 int has_fstab_option(const char *opt);
 void tree_free_mnt_tree(struct mnt_list *tree);
 struct mnt_list *tree_make_mnt_tree(const char *table, const char *path);
+struct mnt_snapshot *mnt_snapshot_get(void);
+struct mnt_snapshot *mnt_snapshot_get_current(void);
+void mnt_snapshot_put(struct mnt_snapshot *snap);
+int mnt_snapshot_count_mounts(struct mnt_snapshot *snap, const char *path);
 int tree_get_mnt_list(struct mnt_list *mnts, struct list_head *list, const char *path, int include);
+int tree_get_mnt_array(struct mnt_list *mnts, const char *path, int include, struct mnt_list ***array);
 int tree_get_mnt_sublist(struct mnt_list *mnts, struct list_head *list, const char *path, int include);
 int tree_find_mnt_ents(struct mnt_list *mnts, struct list_head *list, const char *path);
 int tree_is_mounted(struct mnt_list *mnts, const char *path, unsigned int type);
+int tree_snapshot_is_mounted(struct mnt_snapshot **snap, const char *path, unsigned int type);
 void set_tsd_user_vars(unsigned int, uid_t, gid_t);
+void clear_tsd_user_vars(void);
 const char *mount_type_str(unsigned int);
 void notify_mount_result(struct autofs_point *, const char *, time_t, const char *);
 int try_remount(struct autofs_point *, struct mapent *, unsigned int);
@@ -22,6 +22,8 @@
 #define __NSSWITCH_H
 
 #include <netdb.h>
+#include <time.h>
+#include <sys/types.h>
 #include "list.h"
 
 #define NSSWITCH_FILE _PATH_NSSWITCH_CONF
@@ -55,11 +57,22 @@ struct nss_source {
 	struct list_head list;
 }; 
 
+struct nss_config {
+	unsigned int refs;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct list_head sources;
+};
+
 int set_action(struct nss_action *a, char *status, char *action, int negated);
 int check_nss_result(struct nss_source *this, enum nsswitch_status result);
 struct nss_source *add_source(struct list_head *head, char *source);
 int free_sources(struct list_head *list);
 
 int nsswitch_parse(struct list_head *list);
+struct nss_config *nsswitch_get_config(void);
+void nsswitch_put_config(struct nss_config *conf);
 
 #endif
@@ -51,6 +51,9 @@
 #define SEL_TRUE		0x00800000
 #define SEL_FALSE		0x01000000
 
+/* Number of selector bits, each selector has a table index */
+#define SEL_MAX			25
+
 #define SEL_COMP_NONE		0x0000
 #define SEL_COMP_EQUAL		0x0001
 #define SEL_COMP_NOTEQUAL	0x0002
@@ -71,6 +74,7 @@
 
 struct type_compare {
 	char	*value;
+	int	num;		/* value of numeric comparisons */
 };
 
 struct type_function {
@@ -83,6 +87,7 @@ struct sel {
 	const char *name;
 	unsigned int flags;
 	struct sel *next;
+	unsigned int index;	/* bit number of selector */
 };
 
 struct selector {
@@ -73,6 +73,7 @@ struct host *new_host(const char *, struct sockaddr *, size_t,
 void free_host_list(struct host **);
 int parse_location(unsigned, struct host **, const char *, unsigned int);
 int prune_host_list(unsigned, struct host **, unsigned int, int);
+void probe_cache_invalidate(struct sockaddr *, size_t);
 void dump_host_list(struct host *);
 
 #endif
@@ -59,6 +59,28 @@ struct expire_args {
 	int status;		 /* Return status */
 };
 
+/* A mount to be sent an expire request */
+struct expire_mount {
+	char *path;
+	int ioctlfd;			/* -1 to use the map entry's */
+	unsigned int depth;		/* Number of path components */
+};
+
+/*
+ * Mounts found by an expire run, sent expire requests together
+ * once they have all been found.
+ */
+struct expire_mounts {
+	struct autofs_point *ap;
+	struct expire_mount *mounts;
+	unsigned int count;
+	unsigned int size;
+	unsigned int when;		/* Immediate expire ? */
+	unsigned int expired;		/* Mounts expired so far */
+	unsigned int left;		/* Mounts that were busy */
+	struct timespec start;		/* When the expire run started */
+};
+
 #define expire_args_mutex_lock(ea) \
 do { \
 	int _ea_lock = pthread_mutex_lock(&ea->mutex); \
@@ -86,6 +108,12 @@ void st_mutex_unlock(void);
 
 void expire_cleanup(void *);
 void expire_proc_cleanup(void *);
+void expire_mounts_init(struct expire_mounts *em,
+			struct autofs_point *ap, unsigned int when);
+int expire_mounts_add(struct expire_mounts *em, const char *path, int ioctlfd);
+int expire_mounts_run(struct expire_mounts *em);
+void expire_mounts_report(struct expire_mounts *em);
+void expire_mounts_cleanup(void *arg);
 void nextstate(int, enum states);
 
 int st_add_task(struct autofs_point *, enum states);
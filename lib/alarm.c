@@ -15,16 +15,31 @@
 #include <stdlib.h>
 #include "automount.h"
 
+/*
+ * Pending alarms are kept on a binary heap ordered by time so adding
+ * and removing one is O(log n) however many autofs points there are.
+ * They are also hashed by autofs point so alarm_delete() doesn't need
+ * to look at every alarm.
+ */
 struct alarm {
 	time_t time;
 	unsigned int cancel;
 	struct autofs_point *ap;
-	struct list_head list;
+	int index;		/* Position in the heap, -1 once due */
+	struct alarm *next;	/* Next due alarm being run */
+	struct list_head hash;
 };
 
+#define ALARM_HASH_MIN_SIZE	64
+
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t cond;
-static LIST_HEAD(alarms);
+static struct alarm **heap = NULL;
+static unsigned int heap_count = 0;
+static unsigned int heap_size = 0;
+static struct list_head *alarm_hash = NULL;
+static unsigned int hash_count = 0;
+static unsigned int hash_size = 0;
 
 #define alarm_lock() \
 do { \
@@ -40,11 +55,130 @@ do { \
 		fatal(_alm_unlock); \
 } while (0)
 
-/* Insert alarm entry on ordered list. */
+static void heap_set(unsigned int i, struct alarm *this)
+{
+	heap[i] = this;
+	this->index = i;
+}
+
+static void heap_up(unsigned int i)
+{
+	struct alarm *this = heap[i];
+
+	while (i) {
+		unsigned int parent = (i - 1) / 2;
+
+		if (heap[parent]->time <= this->time)
+			break;
+		heap_set(i, heap[parent]);
+		i = parent;
+	}
+	heap_set(i, this);
+}
+
+static void heap_down(unsigned int i)
+{
+	struct alarm *this = heap[i];
+
+	while (1) {
+		unsigned int child = 2 * i + 1;
+
+		if (child >= heap_count)
+			break;
+		if (child + 1 < heap_count &&
+		    heap[child + 1]->time < heap[child]->time)
+			child++;
+		if (this->time <= heap[child]->time)
+			break;
+		heap_set(i, heap[child]);
+		i = child;
+	}
+	heap_set(i, this);
+}
+
+static int heap_insert(struct alarm *new)
+{
+	if (heap_count == heap_size) {
+		unsigned int size = heap_size ? heap_size * 2 : 64;
+		struct alarm **tmp;
+
+		tmp = realloc(heap, size * sizeof(struct alarm *));
+		if (!tmp)
+			return 0;
+		heap = tmp;
+		heap_size = size;
+	}
+	heap_set(heap_count++, new);
+	heap_up(new->index);
+
+	return 1;
+}
+
+static void heap_remove(struct alarm *this)
+{
+	unsigned int i = this->index;
+	struct alarm *last;
+
+	this->index = -1;
+	last = heap[--heap_count];
+	if (i == heap_count)
+		return;
+
+	heap_set(i, last);
+	if (i && heap[(i - 1) / 2]->time > last->time)
+		heap_up(i);
+	else
+		heap_down(i);
+}
+
+static u_int32_t alarm_hash_ap(struct autofs_point *ap, unsigned int size)
+{
+	unsigned long key = (unsigned long) ap;
+
+	key ^= key >> 17;
+	key *= 0x9e3779b1UL;
+
+	return (u_int32_t) (key >> 7) & (size - 1);
+}
+
+/* Keep about one alarm per hash chain */
+static void alarm_hash_check_resize(void)
+{
+	struct list_head *new;
+	unsigned int size, i;
+
+	if (hash_size && hash_count < hash_size)
+		return;
+
+	size = hash_size ? hash_size * 2 : ALARM_HASH_MIN_SIZE;
+	new = malloc(size * sizeof(struct list_head));
+	if (!new)
+		return;
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(&new[i]);
+
+	for (i = 0; i < hash_size; i++) {
+		struct list_head *head = &alarm_hash[i];
+
+		while (!list_empty(head)) {
+			struct alarm *this;
+
+			this = list_entry(head->next, struct alarm, hash);
+			list_del(&this->hash);
+			list_add_tail(&this->hash,
+				      &new[alarm_hash_ap(this->ap, size)]);
+		}
+	}
+
+	if (alarm_hash)
+		free(alarm_hash);
+	alarm_hash = new;
+	hash_size = size;
+}
+
+/* Insert alarm entry in the alarm heap. */
 int alarm_add(struct autofs_point *ap, time_t seconds)
 {
-	struct list_head *head;
-	struct list_head *p;
 	struct alarm *new;
 	time_t now = monotonic_time(NULL);
 	time_t next_alarm = 0;
@@ -61,30 +195,31 @@ int alarm_add(struct autofs_point *ap, time_t seconds)
 	new->ap = ap;
 	new->cancel = 0;
 	new->time = now + seconds;
+	new->next = NULL;
 
 	alarm_lock();
 
-	head = &alarms;
+	alarm_hash_check_resize();
+	if (!alarm_hash) {
+		alarm_unlock();
+		free(new);
+		return 0;
+	}
 
 	/* Check if we have a pending alarm */
-	if (!list_empty(head)) {
-		struct alarm *current;
-		current = list_entry(head->next, struct alarm, list);
-		next_alarm = current->time;
+	if (heap_count) {
+		next_alarm = heap[0]->time;
 		empty = 0;
 	}
 
-	list_for_each(p, head) {
-		struct alarm *this;
-
-		this = list_entry(p, struct alarm, list);
-		if (this->time >= new->time) {
-			list_add_tail(&new->list, p);
-			break;
-		}
+	if (!heap_insert(new)) {
+		alarm_unlock();
+		free(new);
+		return 0;
 	}
-	if (p == head)
-		list_add_tail(&new->list, p);
+
+	list_add(&new->hash, &alarm_hash[alarm_hash_ap(ap, hash_size)]);
+	hash_count++;
 
 	/*
 	 * Wake the alarm thread if it is not busy (ie. if the
@@ -106,39 +241,42 @@ void alarm_delete(struct autofs_point *ap)
 {
 	struct list_head *head;
 	struct list_head *p;
-	struct alarm *current;
 	unsigned int signal_cancel = 0;
 	int status;
 
 	alarm_lock();
 
-	head = &alarms;
-
-	if (list_empty(head)) {
+	if (!hash_count) {
 		alarm_unlock();
 		return;
 	}
 
-	current = list_entry(head->next, struct alarm, list);
+	head = &alarm_hash[alarm_hash_ap(ap, hash_size)];
 
 	p = head->next;
 	while (p != head) {
 		struct alarm *this;
 
-		this = list_entry(p, struct alarm, list);
+		this = list_entry(p, struct alarm, hash);
 		p = p->next;
 
-		if (ap == this->ap) {
-			if (current != this) {
-				list_del_init(&this->list);
-				free(this);
-				continue;
-			}
-			/* Mark as canceled */
+		if (ap != this->ap)
+			continue;
+
+		/* Due and about to run, mark as canceled */
+		if (this->index == -1) {
 			this->cancel = 1;
-			this->time = 0;
-			signal_cancel = 1;
+			continue;
 		}
+
+		/* The alarm thread may be waiting on it */
+		if (!this->index)
+			signal_cancel = 1;
+
+		heap_remove(this);
+		list_del(&this->hash);
+		hash_count--;
+		free(this);
 	}
 
 	if (signal_cancel) {
@@ -154,7 +292,6 @@ void alarm_delete(struct autofs_point *ap)
 
 static void *alarm_handler(void *arg)
 {
-	struct list_head *head;
 	struct timespec expire;
 	struct alarm *first;
 	time_t now;
@@ -162,10 +299,10 @@ static void *alarm_handler(void *arg)
 
 	alarm_lock();
 
-	head = &alarms;
-
 	while (1) {
-		if (list_empty(head)) {
+		struct alarm *due, **last;
+
+		if (!heap_count) {
 			/* No alarms, wait for one to be added */
 			status = pthread_cond_wait(&cond, &mutex);
 			if (status)
@@ -173,7 +310,7 @@ static void *alarm_handler(void *arg)
 			continue;
 		}
 
-		first = list_entry(head->next, struct alarm, list);
+		first = heap[0];
 
 		now = monotonic_time(NULL);
 
@@ -191,19 +328,42 @@ static void *alarm_handler(void *arg)
 			status = pthread_cond_timedwait(&cond, &mutex, &expire);
 			if (status && status != ETIMEDOUT)
 				fatal(status);
-		} else {
-			/* First alarm has triggered, run it */
+			continue;
+		}
+
+		/* Take every alarm that has triggered, in time order */
+		due = NULL;
+		last = &due;
+		while (heap_count && heap[0]->time <= now) {
+			first = heap[0];
+			heap_remove(first);
+			*last = first;
+			last = &first->next;
+		}
+
+		/*
+		 * Queue the expires together. The state queue mutex is
+		 * taken before the alarm mutex elsewhere so the alarm
+		 * mutex is dropped to take it. Alarms canceled in the
+		 * mean time are still on the hash and are marked.
+		 */
+		alarm_unlock();
+		st_mutex_lock();
+		alarm_lock();
 
-			list_del(&first->list);
+		while (due) {
+			first = due;
+			due = first->next;
 
-			if (!first->cancel) {
-				struct autofs_point *ap = first->ap;
-				alarm_unlock(); 
-				st_add_task(ap, ST_EXPIRE);
-				alarm_lock();
-			}
+			if (!first->cancel)
+				__st_add_task(first->ap, ST_EXPIRE);
+
+			list_del(&first->hash);
+			hash_count--;
 			free(first);
 		}
+
+		st_mutex_unlock();
 	}
 	/* Will never come here, so alarm_unlock is not necessary */
 }
@@ -24,6 +24,29 @@
 
 #include "automount.h"
 
+/* Grow the hash table when the average chain length exceeds this */
+#define CACHE_MAX_LOAD		2
+/* Shrink the hash table when fewer than one in this many slots are used */
+#define CACHE_MIN_LOAD		8
+/* Number of old hash table slots moved by each cache update */
+#define CACHE_REHASH_STEP	16
+
+/* Most reader lock slots a cache will have */
+#define CACHE_MAX_LOCKS		64
+
+/* Number of inode index slot locks */
+#define CACHE_INO_LOCKS		16
+/* Initial number of inode index slots, a power of two */
+#define CACHE_INO_MIN_SIZE	64
+/* Grow the inode index when it has more entries than slots */
+#define CACHE_INO_MAX_LOAD	1
+
+/* Initial number of path index slots, a power of two */
+#define CACHE_PATH_MIN_SIZE	64
+
+/* Protects the parsed map entry of each cache entry */
+static pthread_mutex_t parsed_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 void cache_dump_multi(struct list_head *list)
 {
 	struct list_head *p;
@@ -35,13 +58,13 @@ void cache_dump_multi(struct list_head *list)
 	}
 }
 
-void cache_dump_cache(struct mapent_cache *mc)
+static void cache_dump_hash(struct mapent **table, unsigned int size)
 {
 	struct mapent *me;
 	unsigned int i;
 
-	for (i = 0; i < mc->size; i++) {
-		me = mc->hash[i];
+	for (i = 0; i < size; i++) {
+		me = table[i];
 		if (me == NULL)
 			continue;
 		while (me) {
@@ -52,11 +75,68 @@ void cache_dump_cache(struct mapent_cache *mc)
 	}
 }
 
+void cache_dump_cache(struct mapent_cache *mc)
+{
+	if (mc->old_hash)
+		cache_dump_hash(mc->old_hash, mc->old_size);
+	cache_dump_hash(mc->hash, mc->size);
+}
+
+static int cache_locks_init(struct mapent_cache *mc)
+{
+	unsigned int i, nr = 1;
+	long cpus;
+	int status;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	while (nr < cpus && nr < CACHE_MAX_LOCKS)
+		nr <<= 1;
+
+	if (posix_memalign((void **) &mc->locks,
+			   sizeof(struct cache_lock),
+			   nr * sizeof(struct cache_lock)))
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		status = pthread_rwlock_init(&mc->locks[i].rwlock, NULL);
+		if (status)
+			fatal(status);
+	}
+	mc->nr_locks = nr;
+	mc->write_locked = 0;
+
+	return 1;
+}
+
+static void cache_locks_destroy(struct mapent_cache *mc)
+{
+	unsigned int i;
+	int status;
+
+	for (i = 0; i < mc->nr_locks; i++) {
+		status = pthread_rwlock_destroy(&mc->locks[i].rwlock);
+		if (status)
+			fatal(status);
+	}
+	free(mc->locks);
+}
+
+/* A thread always uses the same reader lock of a cache */
+static struct cache_lock *cache_reader_lock(struct mapent_cache *mc)
+{
+	unsigned long id = (unsigned long) pthread_self();
+
+	id ^= id >> 12;
+	id *= 0x9e3779b97f4a7c15UL;
+
+	return &mc->locks[(id >> 32) & (mc->nr_locks - 1)];
+}
+
 void cache_readlock(struct mapent_cache *mc)
 {
 	int status;
 
-	status = pthread_rwlock_rdlock(&mc->rwlock);
+	status = pthread_rwlock_rdlock(&cache_reader_lock(mc)->rwlock);
 	if (status) {
 		logmsg("mapent cache rwlock lock failed");
 		fatal(status);
@@ -66,36 +146,66 @@ void cache_readlock(struct mapent_cache *mc)
 
 void cache_writelock(struct mapent_cache *mc)
 {
+	unsigned int i;
 	int status;
 
-	status = pthread_rwlock_wrlock(&mc->rwlock);
-	if (status) {
-		logmsg("mapent cache rwlock lock failed");
-		fatal(status);
+	for (i = 0; i < mc->nr_locks; i++) {
+		status = pthread_rwlock_wrlock(&mc->locks[i].rwlock);
+		if (status) {
+			logmsg("mapent cache rwlock lock failed");
+			fatal(status);
+		}
 	}
+	mc->writer = pthread_self();
+	mc->write_locked = 1;
 	return;
 }
 
 int cache_try_writelock(struct mapent_cache *mc)
 {
+	unsigned int i;
 	int status;
 
-	status = pthread_rwlock_trywrlock(&mc->rwlock);
-	if (status) {
-		logmsg("mapent cache rwlock busy");
-		return 0;
+	for (i = 0; i < mc->nr_locks; i++) {
+		status = pthread_rwlock_trywrlock(&mc->locks[i].rwlock);
+		if (status) {
+			while (i--)
+				pthread_rwlock_unlock(&mc->locks[i].rwlock);
+			logmsg("mapent cache rwlock busy");
+			return 0;
+		}
 	}
+	mc->writer = pthread_self();
+	mc->write_locked = 1;
 	return 1;
 }
 
 void cache_unlock(struct mapent_cache *mc)
 {
+	unsigned int i;
 	int status;
 
-	status = pthread_rwlock_unlock(&mc->rwlock);
-	if (status) {
-		logmsg("mapent cache rwlock unlock failed");
-		fatal(status);
+	/*
+	 * The write lock fields can only be set by this thread if
+	 * it holds any of the locks.
+	 */
+	if (!mc->write_locked || !pthread_equal(mc->writer, pthread_self())) {
+		status = pthread_rwlock_unlock(&cache_reader_lock(mc)->rwlock);
+		if (status) {
+			logmsg("mapent cache rwlock unlock failed");
+			fatal(status);
+		}
+		return;
+	}
+
+	mc->write_locked = 0;
+	i = mc->nr_locks;
+	while (i--) {
+		status = pthread_rwlock_unlock(&mc->locks[i].rwlock);
+		if (status) {
+			logmsg("mapent cache rwlock unlock failed");
+			fatal(status);
+		}
 	}
 	return;
 }
@@ -125,55 +235,650 @@ void cache_multi_readlock(struct mapent *me)
 
 void cache_multi_writelock(struct mapent *me)
 {
-	int status;
+	int status;
+
+	if (!me)
+		return;
+
+	status = pthread_rwlock_wrlock(&me->multi_rwlock);
+	if (status) {
+		logmsg("mapent cache multi mutex lock failed");
+		fatal(status);
+	}
+	return;
+}
+
+void cache_multi_unlock(struct mapent *me)
+{
+	int status;
+
+	if (!me)
+		return;
+
+	status = pthread_rwlock_unlock(&me->multi_rwlock);
+	if (status) {
+		logmsg("mapent cache multi mutex unlock failed");
+		fatal(status);
+	}
+	return;
+}
+
+void cache_multi_lock_cleanup(void *arg)
+{
+	struct mapent *me = (struct mapent *) arg;
+	cache_multi_unlock(me);
+	return;
+}
+
+/*
+ * Mix the device and inode numbers so that sequential inode numbers
+ * are spread over the whole index.
+ */
+static u_int32_t ino_hash(dev_t dev, ino_t ino)
+{
+	u_int64_t hashval = (u_int64_t) ino;
+
+	hashval ^= (u_int64_t) dev * 0x9e3779b97f4a7c15ULL;
+	hashval ^= hashval >> 30;
+	hashval *= 0xbf58476d1ce4e5b9ULL;
+	hashval ^= hashval >> 27;
+	hashval *= 0x94d049bb133111ebULL;
+	hashval ^= hashval >> 31;
+
+	return (u_int32_t) hashval;
+}
+
+static inline void ino_index_lock(struct mapent_cache *mc, u_int32_t hashval)
+{
+	unsigned int n = hashval & (CACHE_INO_LOCKS - 1);
+	int status = pthread_mutex_lock(&mc->ino_locks[n].mutex);
+	if (status)
+		fatal(status);
+	return;
+}
+
+static inline void ino_index_unlock(struct mapent_cache *mc, u_int32_t hashval)
+{
+	unsigned int n = hashval & (CACHE_INO_LOCKS - 1);
+	int status = pthread_mutex_unlock(&mc->ino_locks[n].mutex);
+	if (status)
+		fatal(status);
+	return;
+}
+
+/* Lock the slots of two hash values, in lock order */
+static void ino_index_lock_two(struct mapent_cache *mc,
+			       u_int32_t hash1, u_int32_t hash2)
+{
+	unsigned int n1 = hash1 & (CACHE_INO_LOCKS - 1);
+	unsigned int n2 = hash2 & (CACHE_INO_LOCKS - 1);
+
+	if (n1 == n2)
+		ino_index_lock(mc, hash1);
+	else if (n1 < n2) {
+		ino_index_lock(mc, hash1);
+		ino_index_lock(mc, hash2);
+	} else {
+		ino_index_lock(mc, hash2);
+		ino_index_lock(mc, hash1);
+	}
+}
+
+static void ino_index_unlock_two(struct mapent_cache *mc,
+				 u_int32_t hash1, u_int32_t hash2)
+{
+	ino_index_unlock(mc, hash1);
+	if ((hash1 & (CACHE_INO_LOCKS - 1)) != (hash2 & (CACHE_INO_LOCKS - 1)))
+		ino_index_unlock(mc, hash2);
+}
+
+static void ino_index_lock_all(struct mapent_cache *mc)
+{
+	unsigned int i;
+
+	for (i = 0; i < CACHE_INO_LOCKS; i++)
+		ino_index_lock(mc, i);
+}
+
+static void ino_index_unlock_all(struct mapent_cache *mc)
+{
+	unsigned int i;
+
+	for (i = 0; i < CACHE_INO_LOCKS; i++)
+		ino_index_unlock(mc, i);
+}
+
+static int cache_ino_index_init(struct mapent_cache *mc)
+{
+	unsigned int i;
+	int status;
+
+	mc->ino_size = CACHE_INO_MIN_SIZE;
+	mc->ino_entries = 0;
+
+	mc->ino_index = malloc(mc->ino_size * sizeof(struct list_head));
+	if (!mc->ino_index)
+		return 0;
+
+	if (posix_memalign((void **) &mc->ino_locks,
+			   sizeof(struct cache_ino_lock),
+			   CACHE_INO_LOCKS * sizeof(struct cache_ino_lock))) {
+		free(mc->ino_index);
+		return 0;
+	}
+
+	for (i = 0; i < CACHE_INO_LOCKS; i++) {
+		status = pthread_mutex_init(&mc->ino_locks[i].mutex, NULL);
+		if (status)
+			fatal(status);
+	}
+
+	for (i = 0; i < mc->ino_size; i++)
+		INIT_LIST_HEAD(&mc->ino_index[i]);
+
+	return 1;
+}
+
+static void cache_ino_index_free(struct mapent_cache *mc)
+{
+	unsigned int i;
+	int status;
+
+	for (i = 0; i < CACHE_INO_LOCKS; i++) {
+		status = pthread_mutex_destroy(&mc->ino_locks[i].mutex);
+		if (status)
+			fatal(status);
+	}
+	free(mc->ino_locks);
+	free(mc->ino_index);
+}
+
+/* Remove an entry from the inode index */
+static void ino_index_del(struct mapent_cache *mc, struct mapent *me)
+{
+	u_int32_t hashval = ino_hash(me->dev, me->ino);
+
+	ino_index_lock(mc, hashval);
+	if (!list_empty(&me->ino_index)) {
+		list_del_init(&me->ino_index);
+		__atomic_sub_fetch(&mc->ino_entries, 1, __ATOMIC_RELAXED);
+	}
+	ino_index_unlock(mc, hashval);
+}
+
+/*
+ * The inode index size doesn't depend on the key hash table size,
+ * it's doubled whenever it has more entries than slots. Lookups
+ * hold the lock of the slot they search so the index can only be
+ * moved while all of the locks are held.
+ */
+static void ino_index_check_resize(struct mapent_cache *mc)
+{
+	struct list_head *index;
+	unsigned int i, size;
+
+	size = __atomic_load_n(&mc->ino_size, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&mc->ino_entries, __ATOMIC_RELAXED) <=
+	    size * CACHE_INO_MAX_LOAD)
+		return;
+
+	ino_index_lock_all(mc);
+
+	if (mc->ino_entries <= mc->ino_size * CACHE_INO_MAX_LOAD)
+		goto done;
+
+	size = mc->ino_size * 2;
+	index = malloc(size * sizeof(struct list_head));
+	if (!index)
+		goto done;
+
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(&index[i]);
+
+	for (i = 0; i < mc->ino_size; i++) {
+		struct list_head *head = &mc->ino_index[i];
+
+		while (!list_empty(head)) {
+			struct mapent *me;
+			u_int32_t hashval;
+
+			me = list_entry(head->next, struct mapent, ino_index);
+			list_del(&me->ino_index);
+			hashval = ino_hash(me->dev, me->ino);
+			list_add(&me->ino_index, &index[hashval & (size - 1)]);
+		}
+	}
+
+	free(mc->ino_index);
+	mc->ino_index = index;
+	mc->ino_size = size;
+done:
+	ino_index_unlock_all(mc);
+}
+
+/* Hash a path name component within its parent */
+static u_int32_t path_hash(struct cache_path *parent,
+			   const char *name, unsigned int len)
+{
+	u_int32_t hashval = (u_int32_t) ((unsigned long) parent >> 4);
+	unsigned int i;
+
+	hashval *= 0x9e3779b1;
+	for (i = 0; i < len; i++) {
+		hashval += (unsigned char) name[i];
+		hashval += (hashval << 10);
+		hashval ^= (hashval >> 6);
+	}
+
+	hashval += (hashval << 3);
+	hashval ^= (hashval >> 11);
+	hashval += (hashval << 15);
+
+	return hashval;
+}
+
+static struct cache_path *cache_path_alloc(struct cache_path *parent,
+					   const char *name, unsigned int len)
+{
+	struct cache_path *path;
+
+	path = malloc(sizeof(struct cache_path) + len + 1);
+	if (!path)
+		return NULL;
+
+	path->next = NULL;
+	path->parent = parent;
+	INIT_LIST_HEAD(&path->children);
+	INIT_LIST_HEAD(&path->sibling);
+	path->me = NULL;
+	path->count = 0;
+	path->wild = 0;
+	path->hashval = parent ? path_hash(parent, name, len) : 0;
+	path->len = len;
+	memcpy(path->name, name, len);
+	path->name[len] = '\0';
+
+	return path;
+}
+
+/*
+ * Keys are indexed by their '/' separated components so that entries
+ * below a path can be found without looking at every key. The root
+ * node isn't in the index, its children are the leading components.
+ */
+static int cache_path_index_init(struct mapent_cache *mc)
+{
+	unsigned int i;
+
+	mc->path_size = CACHE_PATH_MIN_SIZE;
+	mc->path_nodes = 0;
+
+	mc->path_index = malloc(mc->path_size * sizeof(struct cache_path *));
+	if (!mc->path_index)
+		return 0;
+
+	for (i = 0; i < mc->path_size; i++)
+		mc->path_index[i] = NULL;
+
+	mc->path_root = cache_path_alloc(NULL, "", 0);
+	if (!mc->path_root) {
+		free(mc->path_index);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Remove all of the paths from the index */
+static void cache_path_index_empty(struct mapent_cache *mc)
+{
+	struct cache_path *path, *next;
+	unsigned int i;
+
+	for (i = 0; i < mc->path_size; i++) {
+		path = mc->path_index[i];
+		while (path) {
+			next = path->next;
+			free(path);
+			path = next;
+		}
+		mc->path_index[i] = NULL;
+	}
+	mc->path_nodes = 0;
+
+	INIT_LIST_HEAD(&mc->path_root->children);
+	mc->path_root->me = NULL;
+	mc->path_root->count = 0;
+	mc->path_root->wild = 0;
+}
+
+static void cache_path_index_free(struct mapent_cache *mc)
+{
+	cache_path_index_empty(mc);
+	free(mc->path_root);
+	free(mc->path_index);
+}
+
+static struct cache_path *cache_path_find(struct mapent_cache *mc,
+					  struct cache_path *parent,
+					  const char *name, unsigned int len)
+{
+	u_int32_t hashval = path_hash(parent, name, len);
+	struct cache_path *path;
+
+	path = mc->path_index[hashval & (mc->path_size - 1)];
+	while (path) {
+		if (path->hashval == hashval && path->parent == parent &&
+		    path->len == len && !memcmp(path->name, name, len))
+			return path;
+		path = path->next;
+	}
+
+	return NULL;
+}
+
+/* Find the index node of a path, it need not be a key itself */
+static struct cache_path *cache_path_lookup(struct mapent_cache *mc,
+					    const char *key)
+{
+	struct cache_path *path = mc->path_root;
+	const char *name = key;
+
+	while (1) {
+		const char *end = strchr(name, '/');
+		unsigned int len = end ? end - name : strlen(name);
+
+		path = cache_path_find(mc, path, name, len);
+		if (!path || !end)
+			break;
+		name = end + 1;
+	}
+
+	return path;
+}
+
+/* The path index is doubled whenever it has more nodes than slots */
+static void cache_path_check_resize(struct mapent_cache *mc)
+{
+	struct cache_path **index, *path, *next;
+	unsigned int i, size;
+
+	if (mc->path_nodes <= mc->path_size)
+		return;
+
+	size = mc->path_size * 2;
+	index = malloc(size * sizeof(struct cache_path *));
+	if (!index)
+		return;
+
+	for (i = 0; i < size; i++)
+		index[i] = NULL;
+
+	for (i = 0; i < mc->path_size; i++) {
+		path = mc->path_index[i];
+		while (path) {
+			unsigned int n = path->hashval & (size - 1);
+
+			next = path->next;
+			path->next = index[n];
+			index[n] = path;
+			path = next;
+		}
+	}
+
+	free(mc->path_index);
+	mc->path_index = index;
+	mc->path_size = size;
+}
+
+/* Remove unused nodes from a path up toward the root */
+static void cache_path_prune(struct mapent_cache *mc, struct cache_path *path)
+{
+	while (path != mc->path_root && !path->count) {
+		struct cache_path *parent = path->parent;
+		struct cache_path **slot;
+
+		slot = &mc->path_index[path->hashval & (mc->path_size - 1)];
+		while (*slot != path)
+			slot = &(*slot)->next;
+		*slot = path->next;
+
+		list_del(&path->sibling);
+		if (*path->name == '*')
+			parent->wild--;
+		mc->path_nodes--;
+		free(path);
+
+		path = parent;
+	}
+}
+
+/* Add a new cache entry to the path index */
+static int cache_path_add(struct mapent_cache *mc, struct mapent *me)
+{
+	struct cache_path *path = mc->path_root, *this;
+	const char *name = me->key;
+
+	while (1) {
+		const char *end = strchr(name, '/');
+		unsigned int len = end ? end - name : strlen(name);
+
+		this = cache_path_find(mc, path, name, len);
+		if (!this) {
+			unsigned int n;
+
+			this = cache_path_alloc(path, name, len);
+			if (!this) {
+				cache_path_prune(mc, path);
+				return 0;
+			}
+			n = this->hashval & (mc->path_size - 1);
+			this->next = mc->path_index[n];
+			mc->path_index[n] = this;
+			list_add_tail(&this->sibling, &path->children);
+			if (*this->name == '*')
+				path->wild++;
+			mc->path_nodes++;
+		}
+		path = this;
+
+		if (!end)
+			break;
+		name = end + 1;
+	}
+
+	if (!path->me)
+		path->me = me;
+
+	for (this = path; this; this = this->parent)
+		this->count++;
+
+	cache_path_check_resize(mc);
+
+	return 1;
+}
+
+/*
+ * Remove a cache entry from the path index, the entry must already
+ * be unlinked from the hash table so any other entry with the same
+ * key can take its place.
+ */
+static void cache_path_del(struct mapent_cache *mc, struct mapent *me)
+{
+	struct cache_path *path, *this;
+
+	path = cache_path_lookup(mc, me->key);
+	if (!path)
+		return;
+
+	if (path->me == me)
+		path->me = cache_lookup_distinct(mc, me->key);
+
+	for (this = path; this; this = this->parent)
+		this->count--;
+
+	cache_path_prune(mc, path);
+}
+
+/* Get an entry at or below a path */
+static struct mapent *cache_path_any(struct cache_path *path)
+{
+	while (!path->me) {
+		if (list_empty(&path->children))
+			return NULL;
+		path = list_entry(path->children.next,
+				  struct cache_path, sibling);
+	}
+
+	return path->me;
+}
+
+static struct mapent **cache_alloc_hash(unsigned int size)
+{
+	struct mapent **table;
+
+	table = malloc(size * sizeof(struct mapent *));
+	if (!table)
+		return NULL;
+	memset(table, 0, size * sizeof(struct mapent *));
+
+	return table;
+}
+
+/*
+ * Move the entries of up to slots old hash table slots to the
+ * current hash table, releasing the old table once it's empty.
+ */
+/* cache must be write locked by caller */
+static void cache_rehash_step(struct mapent_cache *mc, unsigned int slots)
+{
+	struct mapent *me, *next, **tail;
+
+	while (mc->old_hash && slots) {
+		me = mc->old_hash[mc->rehash_pos];
+		mc->old_hash[mc->rehash_pos] = NULL;
+		while (me) {
+			next = me->next;
+			/* Append to preserve the order of duplicate keys */
+			tail = &mc->hash[hash(me->key, mc->size)];
+			while (*tail)
+				tail = &(*tail)->next;
+			me->next = NULL;
+			*tail = me;
+			me = next;
+		}
+
+		if (++mc->rehash_pos == mc->old_size) {
+			free(mc->old_hash);
+			mc->old_hash = NULL;
+			mc->old_size = 0;
+			mc->rehash_pos = 0;
+		}
+		slots--;
+	}
+}
+
+/*
+ * Start moving the cache to a hash table of a new size. Entries
+ * are moved a few slots at a time by subsequent updates so that
+ * no single update has to rehash the whole cache.
+ */
+/* cache must be write locked by caller */
+static void cache_resize(struct mapent_cache *mc, unsigned int size)
+{
+	struct mapent **table;
 
-	if (!me)
+	/* Complete any resize in progress */
+	if (mc->old_hash)
+		cache_rehash_step(mc, mc->old_size);
+
+	table = cache_alloc_hash(size);
+	if (!table)
 		return;
 
-	status = pthread_rwlock_wrlock(&me->multi_rwlock);
-	if (status) {
-		logmsg("mapent cache multi mutex lock failed");
-		fatal(status);
-	}
-	return;
+	mc->old_hash = mc->hash;
+	mc->old_size = mc->size;
+	mc->rehash_pos = 0;
+	mc->hash = table;
+	mc->size = size;
+	mc->resizes++;
 }
 
-void cache_multi_unlock(struct mapent *me)
+/* cache must be write locked by caller */
+static void cache_check_resize(struct mapent_cache *mc)
 {
-	int status;
+	unsigned int size;
 
-	if (!me)
+	/* An enumeration that drops the lock can't follow a rehash */
+	if (__atomic_load_n(&mc->resize_hold, __ATOMIC_ACQUIRE))
 		return;
 
-	status = pthread_rwlock_unlock(&me->multi_rwlock);
-	if (status) {
-		logmsg("mapent cache multi mutex unlock failed");
-		fatal(status);
+	if (mc->old_hash) {
+		cache_rehash_step(mc, CACHE_REHASH_STEP);
+		return;
+	}
+
+	if (mc->entries > mc->size * CACHE_MAX_LOAD) {
+		if (mc->size > UINT_MAX / 2)
+			return;
+		cache_resize(mc, mc->size * 2);
+	} else if (mc->size > mc->min_size &&
+		   mc->entries * CACHE_MIN_LOAD < mc->size) {
+		size = mc->size / 2;
+		if (size < mc->min_size)
+			size = mc->min_size;
+		cache_resize(mc, size);
 	}
-	return;
 }
 
-void cache_multi_lock_cleanup(void *arg)
+/*
+ * Callers that enumerate the cache and drop the lock to update
+ * it part way through must stop resizes for the length of the
+ * enumeration, since moving entries between hash tables would
+ * make it skip or revisit entries. The cache may be read locked
+ * to take or put the hold.
+ */
+void cache_resize_hold(struct mapent_cache *mc)
 {
-	struct mapent *me = (struct mapent *) arg;
-	cache_multi_unlock(me);
-	return;
+	__atomic_add_fetch(&mc->resize_hold, 1, __ATOMIC_RELEASE);
 }
 
-static inline void ino_index_lock(struct mapent_cache *mc)
+void cache_resize_put(struct mapent_cache *mc)
 {
-	int status = pthread_mutex_lock(&mc->ino_index_mutex);
-	if (status)
-		fatal(status);
-	return;
+	__atomic_sub_fetch(&mc->resize_hold, 1, __ATOMIC_RELEASE);
 }
 
-static inline void ino_index_unlock(struct mapent_cache *mc)
+/* Release the hold and catch up on the resizes that were skipped */
+/* cache must be write locked by caller */
+void cache_resize_release(struct mapent_cache *mc)
 {
-	int status = pthread_mutex_unlock(&mc->ino_index_mutex);
-	if (status)
-		fatal(status);
-	return;
+	cache_resize_put(mc);
+	cache_check_resize(mc);
+}
+
+/*
+ * Return the hash slot that holds key. Old hash table slots that
+ * haven't been moved yet hold all the entries of the keys in them.
+ */
+/* cache must be read locked by caller */
+static struct mapent **cache_key_slot(struct mapent_cache *mc, const char *key)
+{
+	struct mapent *me;
+	u_int32_t hashval;
+
+	if (mc->old_hash) {
+		hashval = hash(key, mc->old_size);
+		if (hashval >= mc->rehash_pos) {
+			me = mc->old_hash[hashval];
+			while (me) {
+				if (strcmp(key, me->key) == 0)
+					return &mc->old_hash[hashval];
+				me = me->next;
+			}
+		}
+	}
+
+	return &mc->hash[hash(key, mc->size)];
 }
 
 /* Save the cache entry mapent field onto a stack and set a new mapent */
@@ -243,7 +948,6 @@ struct mapent_cache *cache_init(struct autofs_point *ap, struct map_source *map)
 {
 	struct mapent_cache *mc;
 	unsigned int i;
-	int status;
 
 	if (map->mc)
 		cache_release(map);
@@ -253,6 +957,15 @@ struct mapent_cache *cache_init(struct autofs_point *ap, struct map_source *map)
 		return NULL;
 
 	mc->size = defaults_get_map_hash_table_size();
+	if (!mc->size)
+		mc->size = 1;
+	mc->min_size = mc->size;
+	mc->entries = 0;
+	mc->old_hash = NULL;
+	mc->old_size = 0;
+	mc->rehash_pos = 0;
+	mc->resizes = 0;
+	mc->resize_hold = 0;
 
 	mc->hash = malloc(mc->size * sizeof(struct mapent *));
 	if (!mc->hash) {
@@ -260,27 +973,31 @@ struct mapent_cache *cache_init(struct autofs_point *ap, struct map_source *map)
 		return NULL;
 	}
 
-	mc->ino_index = malloc(mc->size * sizeof(struct list_head));
-	if (!mc->ino_index) {
+	if (!cache_ino_index_init(mc)) {
 		free(mc->hash);
 		free(mc);
 		return NULL;
 	}
 
-	status = pthread_mutex_init(&mc->ino_index_mutex, NULL);
-	if (status)
-		fatal(status);
+	if (!cache_path_index_init(mc)) {
+		cache_ino_index_free(mc);
+		free(mc->hash);
+		free(mc);
+		return NULL;
+	}
 
-	status = pthread_rwlock_init(&mc->rwlock, NULL);
-	if (status)
-		fatal(status);
+	if (!cache_locks_init(mc)) {
+		cache_path_index_free(mc);
+		cache_ino_index_free(mc);
+		free(mc->hash);
+		free(mc);
+		return NULL;
+	}
 
 	cache_writelock(mc);
 
-	for (i = 0; i < mc->size; i++) {
+	for (i = 0; i < mc->size; i++)
 		mc->hash[i] = NULL;
-		INIT_LIST_HEAD(&mc->ino_index[i]);
-	}
 
 	mc->ap = ap;
 	mc->map = map;
@@ -295,6 +1012,10 @@ void cache_clean_null_cache(struct mapent_cache *mc)
 	struct mapent *me, *next;
 	int i;
 
+	/* Only the current hash table need be cleaned */
+	if (mc->old_hash)
+		cache_rehash_step(mc, mc->old_size);
+
 	for (i = 0; i < mc->size; i++) {
 		me = mc->hash[i];
 		if (me == NULL)
@@ -313,6 +1034,9 @@ void cache_clean_null_cache(struct mapent_cache *mc)
 		}
 		mc->hash[i] = NULL;
 	}
+	mc->entries = 0;
+
+	cache_path_index_empty(mc);
 
 	return;
 }
@@ -321,13 +1045,19 @@ struct mapent_cache *cache_init_null_cache(struct master *master)
 {
 	struct mapent_cache *mc;
 	unsigned int i;
-	int status;
 
 	mc = malloc(sizeof(struct mapent_cache));
 	if (!mc)
 		return NULL;
 
 	mc->size = NULL_MAP_HASHSIZE;
+	mc->min_size = mc->size;
+	mc->entries = 0;
+	mc->old_hash = NULL;
+	mc->old_size = 0;
+	mc->rehash_pos = 0;
+	mc->resizes = 0;
+	mc->resize_hold = 0;
 
 	mc->hash = malloc(mc->size * sizeof(struct mapent *));
 	if (!mc->hash) {
@@ -335,25 +1065,29 @@ struct mapent_cache *cache_init_null_cache(struct master *master)
 		return NULL;
 	}
 
-	mc->ino_index = malloc(mc->size * sizeof(struct list_head));
-	if (!mc->ino_index) {
+	if (!cache_ino_index_init(mc)) {
 		free(mc->hash);
 		free(mc);
 		return NULL;
 	}
 
-	status = pthread_mutex_init(&mc->ino_index_mutex, NULL);
-	if (status)
-		fatal(status);
+	if (!cache_path_index_init(mc)) {
+		cache_ino_index_free(mc);
+		free(mc->hash);
+		free(mc);
+		return NULL;
+	}
 
-	status = pthread_rwlock_init(&mc->rwlock, NULL);
-	if (status)
-		fatal(status);
+	if (!cache_locks_init(mc)) {
+		cache_path_index_free(mc);
+		cache_ino_index_free(mc);
+		free(mc->hash);
+		free(mc);
+		return NULL;
+	}
 
-	for (i = 0; i < mc->size; i++) {
+	for (i = 0; i < mc->size; i++)
 		mc->hash[i] = NULL;
-		INIT_LIST_HEAD(&mc->ino_index[i]);
-	}
 
 	mc->ap = NULL;
 	mc->map = NULL;
@@ -361,30 +1095,40 @@ struct mapent_cache *cache_init_null_cache(struct master *master)
 	return mc;
 }
 
-static u_int32_t ino_hash(dev_t dev, ino_t ino, unsigned int size)
-{
-	u_int32_t hashval;
-
-	hashval = dev + ino;
-
-	return hashval % size;
-}
-
 int cache_set_ino_index(struct mapent_cache *mc, const char *key, dev_t dev, ino_t ino)
 {
-	u_int32_t ino_index = ino_hash(dev, ino, mc->size);
+	u_int32_t hashval = ino_hash(dev, ino);
+	u_int32_t old;
 	struct mapent *me;
+	int added = 0;
 
 	me = cache_lookup_distinct(mc, key);
 	if (!me)
 		return 0;
 
-	ino_index_lock(mc);
-	list_del_init(&me->ino_index);
-	list_add(&me->ino_index, &mc->ino_index[ino_index]);
+	/* The entry can only be moved while its slot is locked */
+	while (1) {
+		old = ino_hash(me->dev, me->ino);
+		ino_index_lock_two(mc, old, hashval);
+		if (ino_hash(me->dev, me->ino) == old)
+			break;
+		ino_index_unlock_two(mc, old, hashval);
+	}
+
+	if (list_empty(&me->ino_index)) {
+		__atomic_add_fetch(&mc->ino_entries, 1, __ATOMIC_RELAXED);
+		added = 1;
+	} else
+		list_del_init(&me->ino_index);
+	list_add(&me->ino_index,
+		 &mc->ino_index[hashval & (mc->ino_size - 1)]);
 	me->dev = dev;
 	me->ino = ino;
-	ino_index_unlock(mc);
+
+	ino_index_unlock_two(mc, old, hashval);
+
+	if (added)
+		ino_index_check_resize(mc);
 
 	return 1;
 }
@@ -394,11 +1138,11 @@ struct mapent *cache_lookup_ino(struct mapent_cache *mc, dev_t dev, ino_t ino)
 {
 	struct mapent *me = NULL;
 	struct list_head *head, *p;
-	u_int32_t ino_index;
+	u_int32_t hashval;
 
-	ino_index_lock(mc);
-	ino_index = ino_hash(dev, ino, mc->size);
-	head = &mc->ino_index[ino_index];
+	hashval = ino_hash(dev, ino);
+	ino_index_lock(mc, hashval);
+	head = &mc->ino_index[hashval & (mc->ino_size - 1)];
 
 	list_for_each(p, head) {
 		me = list_entry(p, struct mapent, ino_index);
@@ -406,32 +1150,48 @@ struct mapent *cache_lookup_ino(struct mapent_cache *mc, dev_t dev, ino_t ino)
 		if (me->dev != dev || me->ino != ino)
 			continue;
 
-		ino_index_unlock(mc);
+		ino_index_unlock(mc, hashval);
+		return me;
+	}
+	ino_index_unlock(mc, hashval);
+	return NULL;
+}
+
+static struct mapent *cache_first_primary(struct mapent *me)
+{
+	while (me) {
+		/* Multi mount entries are not primary */
+		if (me->multi && me->multi != me) {
+			me = me->next;
+			continue;
+		}
 		return me;
 	}
-	ino_index_unlock(mc);
 	return NULL;
 }
 
+/*
+ * During a resize the slots of the old hash table that haven't
+ * been moved yet are enumerated before the current hash table.
+ */
 /* cache must be read locked by caller */
 struct mapent *cache_lookup_first(struct mapent_cache *mc)
 {
 	struct mapent *me = NULL;
 	unsigned int i;
 
-	for (i = 0; i < mc->size; i++) {
-		me = mc->hash[i];
-		if (!me)
-			continue;
+	if (mc->old_hash) {
+		for (i = mc->rehash_pos; i < mc->old_size; i++) {
+			me = cache_first_primary(mc->old_hash[i]);
+			if (me)
+				return me;
+		}
+	}
 
-		while (me) {
-			/* Multi mount entries are not primary */
-			if (me->multi && me->multi != me) {
-				me = me->next;
-				continue;
-			}
+	for (i = 0; i < mc->size; i++) {
+		me = cache_first_primary(mc->hash[i]);
+		if (me)
 			return me;
-		}
 	}
 	return NULL;
 }
@@ -446,33 +1206,32 @@ struct mapent *cache_lookup_next(struct mapent_cache *mc, struct mapent *me)
 	if (!me)
 		return NULL;
 
-	this = me->next;
-	while (this) {
-		/* Multi mount entries are not primary */
-		if (this->multi && this->multi != this) {
-			this = this->next;
-			continue;
-		}
+	this = cache_first_primary(me->next);
+	if (this)
 		return this;
-	}
-
-	hashval = hash(me->key, mc->size) + 1;
-	if (hashval < mc->size) {
-		for (i = (unsigned int) hashval; i < mc->size; i++) {
-			this = mc->hash[i];
-			if (!this)
-				continue;
 
-			while (this) {
-				/* Multi mount entries are not primary */
-				if (this->multi && this->multi != this) {
-					this = this->next;
-					continue;
-				}
-				return this;
+	if (mc->old_hash) {
+		hashval = hash(me->key, mc->old_size);
+		if (hashval >= mc->rehash_pos &&
+		    cache_key_slot(mc, me->key) == &mc->old_hash[hashval]) {
+			for (i = hashval + 1; i < mc->old_size; i++) {
+				this = cache_first_primary(mc->old_hash[i]);
+				if (this)
+					return this;
 			}
+			/* Continue with the current hash table */
+			hashval = 0;
+			goto next;
 		}
 	}
+
+	hashval = hash(me->key, mc->size) + 1;
+next:
+	for (i = (unsigned int) hashval; i < mc->size; i++) {
+		this = cache_first_primary(mc->hash[i]);
+		if (this)
+			return this;
+	}
 	return NULL;
 }
 
@@ -504,10 +1263,9 @@ struct mapent *cache_lookup(struct mapent_cache *mc, const char *key)
 	if (!key)
 		return NULL;
 
-	for (me = mc->hash[hash(key, mc->size)]; me != NULL; me = me->next) {
-		if (strcmp(key, me->key) == 0)
-			goto done;
-	}
+	me = cache_lookup_distinct(mc, key);
+	if (me)
+		goto done;
 
 	me = cache_lookup_first(mc);
 	if (me != NULL) {
@@ -517,9 +1275,7 @@ struct mapent *cache_lookup(struct mapent_cache *mc, const char *key)
 			goto done;
 		}
 
-		for (me = mc->hash[hash("*", mc->size)]; me != NULL; me = me->next)
-			if (strcmp("*", me->key) == 0)
-				goto done;
+		me = cache_lookup_distinct(mc, "*");
 	}
 done:
 	return me;
@@ -533,7 +1289,7 @@ struct mapent *cache_lookup_distinct(struct mapent_cache *mc, const char *key)
 	if (!key)
 		return NULL;
 
-	for (me = mc->hash[hash(key, mc->size)]; me != NULL; me = me->next) {
+	for (me = *cache_key_slot(mc, key); me != NULL; me = me->next) {
 		if (strcmp(key, me->key) == 0)
 			return me;
 	}
@@ -545,7 +1301,7 @@ struct mapent *cache_lookup_distinct(struct mapent_cache *mc, const char *key)
 struct mapent *cache_lookup_offset(const char *prefix, const char *offset, int start, struct list_head *head)
 {
 	struct list_head *p;
-	struct mapent *this;
+	struct mapent *this, *owner;
 	/* Keys for direct maps may be as long as a path name */
 	char o_key[PATH_MAX];
 	/* Avoid "//" at the beginning of paths */
@@ -557,6 +1313,35 @@ struct mapent *cache_lookup_offset(const char *prefix, const char *offset, int s
 	if (size >= sizeof(o_key))
 		return NULL;
 
+	if (list_empty(head))
+		return NULL;
+
+	/*
+	 * The offsets of a multi-mount share the path of its root so,
+	 * using the key of an offset for the start of the path, look
+	 * for the offset in the cache before walking the list.
+	 */
+	this = list_entry(head, struct mapent, multi_list);
+	owner = this->multi;
+	if (this == owner)
+		this = list_entry(head->next, struct mapent, multi_list);
+	if (owner && this != owner &&
+	    strlen(this->key) >= (size_t) start &&
+	    start + size < PATH_MAX) {
+		char key[PATH_MAX];
+		struct mapent *me;
+
+		memcpy(key, this->key, start);
+		strcpy(key + start, o_key);
+
+		me = cache_lookup_distinct(this->mc, key);
+		while (me) {
+			if (me != owner && me->multi == owner)
+				return me;
+			me = cache_lookup_key_next(me);
+		}
+	}
+
 	list_for_each(p, head) {
 		this = list_entry(p, struct mapent, multi_list);
 		if (!strcmp(&this->key[start], o_key))
@@ -570,41 +1355,32 @@ static struct mapent *__cache_partial_match(struct mapent_cache *mc,
 					    const char *prefix,
 					    unsigned int type)
 {
-	struct mapent *me = NULL;
-	size_t len = strlen(prefix);
-	unsigned int i;
+	struct cache_path *path, *this;
+	struct list_head *p;
 
-	for (i = 0; i < mc->size; i++) {
-		me = mc->hash[i];
-		if (me == NULL)
-			continue;
+	path = cache_path_lookup(mc, prefix);
+	if (!path || list_empty(&path->children))
+		return NULL;
 
-		if (len < strlen(me->key) &&
-		    (strncmp(prefix, me->key, len) == 0) &&
-		     me->key[len] == '/') {
-			if (type == LKP_NORMAL)
-				return me;
-			if (type == LKP_WILD &&
-			    me->key[len] != '\0' &&
-			    me->key[len + 1] == '*')
-				return me;
-		}
+	if (type == LKP_NORMAL) {
+		this = list_entry(path->children.next,
+				  struct cache_path, sibling);
+		return cache_path_any(this);
+	}
 
-		me = me->next;
-		while (me != NULL) {
-			if (len < strlen(me->key) &&
-			    (strncmp(prefix, me->key, len) == 0 &&
-			    me->key[len] == '/')) {
-				if (type == LKP_NORMAL)
-					return me;
-				if (type == LKP_WILD &&
-				    me->key[len] != '\0' &&
-				    me->key[len + 1] == '*')
-					return me;
-			}
-			me = me->next;
-		}
+	if (type != LKP_WILD || !path->wild)
+		return NULL;
+
+	this = cache_path_find(mc, path, "*", 1);
+	if (this)
+		return cache_path_any(this);
+
+	list_for_each(p, &path->children) {
+		this = list_entry(p, struct cache_path, sibling);
+		if (*this->name == '*')
+			return cache_path_any(this);
 	}
+
 	return NULL;
 }
 
@@ -625,7 +1401,6 @@ int cache_add(struct mapent_cache *mc, struct map_source *ms, const char *key, c
 {
 	struct mapent *me, *existing = NULL;
 	char *pkey, *pent;
-	u_int32_t hashval = hash(key, mc->size);
 	int status;
 
 	me = (struct mapent *) malloc(sizeof(struct mapent));
@@ -651,6 +1426,7 @@ int cache_add(struct mapent_cache *mc, struct map_source *ms, const char *key, c
 		me->mapent = NULL;
 
 	me->stack = NULL;
+	me->parsed = NULL;
 
 	me->age = age;
 	me->status = 0;
@@ -665,6 +1441,14 @@ int cache_add(struct mapent_cache *mc, struct map_source *ms, const char *key, c
 	me->ino = (ino_t) -1;
 	me->flags = 0;
 
+	if (!cache_path_add(mc, me)) {
+		free(me->key);
+		if (me->mapent)
+			free(me->mapent);
+		free(me);
+		return CHE_FAIL;
+	}
+
 	status = pthread_rwlock_init(&me->multi_rwlock, NULL);
 	if (status)
 		fatal(status);
@@ -675,6 +1459,7 @@ int cache_add(struct mapent_cache *mc, struct map_source *ms, const char *key, c
 	 */
 	existing = cache_lookup_distinct(mc, key);
 	if (!existing) {
+		u_int32_t hashval = hash(key, mc->size);
 		me->next = mc->hash[hashval];
 		mc->hash[hashval] = me;
 	} else {
@@ -690,6 +1475,10 @@ int cache_add(struct mapent_cache *mc, struct map_source *ms, const char *key, c
 		me->next = existing->next;
 		existing->next = me;
 	}
+	mc->entries++;
+
+	cache_check_resize(mc);
+
 	return CHE_OK;
 }
 
@@ -891,18 +1680,18 @@ int cache_update(struct mapent_cache *mc, struct map_source *ms, const char *key
 /* cache_multi_lock of the multi mount owner must be held by caller */
 int cache_delete_offset(struct mapent_cache *mc, const char *key)
 {
-	u_int32_t hashval = hash(key, mc->size);
+	struct mapent **slot = cache_key_slot(mc, key);
 	struct mapent *me = NULL, *pred;
 	int status;
 
-	me = mc->hash[hashval];
+	me = *slot;
 	if (!me)
 		return CHE_FAIL;
 
 	if (strcmp(key, me->key) == 0) {
 		if (me->multi && me->multi == me)
 			return CHE_FAIL;
-		mc->hash[hashval] = me->next;
+		*slot = me->next;
 		goto delete;
 	}
 
@@ -924,13 +1713,16 @@ delete:
 	if (status)
 		fatal(status);
 	list_del(&me->multi_list);
-	ino_index_lock(mc);
-	list_del(&me->ino_index);
-	ino_index_unlock(mc);
+	ino_index_del(mc, me);
+	cache_path_del(mc, me);
+	cache_put_parsed(me->parsed);
 	free(me->key);
 	if (me->mapent)
 		free(me->mapent);
 	free(me);
+	mc->entries--;
+
+	cache_check_resize(mc);
 
 	return CHE_OK;
 }
@@ -938,14 +1730,14 @@ delete:
 /* cache must be write locked by caller */
 int cache_delete(struct mapent_cache *mc, const char *key)
 {
+	struct mapent **slot = cache_key_slot(mc, key);
 	struct mapent *me = NULL, *pred;
-	u_int32_t hashval = hash(key, mc->size);
 	int status, ret = CHE_OK;
 	char this[PATH_MAX];
 
 	strcpy(this, key);
 
-	me = mc->hash[hashval];
+	me = *slot;
 	if (!me) {
 		ret = CHE_FAIL;
 		goto done;
@@ -964,9 +1756,9 @@ int cache_delete(struct mapent_cache *mc, const char *key)
 			status = pthread_rwlock_destroy(&me->multi_rwlock);
 			if (status)
 				fatal(status);
-			ino_index_lock(mc);
-			list_del(&me->ino_index);
-			ino_index_unlock(mc);
+			ino_index_del(mc, me);
+			cache_path_del(mc, me);
+			cache_put_parsed(me->parsed);
 			free(me->key);
 			if (me->mapent)
 				free(me->mapent);
@@ -978,11 +1770,12 @@ int cache_delete(struct mapent_cache *mc, const char *key)
 				s = next;
 			}
 			free(me);
+			mc->entries--;
 			me = pred;
 		}
 	}
 
-	me = mc->hash[hashval];
+	me = *slot;
 	if (!me)
 		goto done;
 
@@ -992,13 +1785,13 @@ int cache_delete(struct mapent_cache *mc, const char *key)
 			ret = CHE_FAIL;
 			goto done;
 		}
-		mc->hash[hashval] = me->next;
+		*slot = me->next;
 		status = pthread_rwlock_destroy(&me->multi_rwlock);
 		if (status)
 			fatal(status);
-		ino_index_lock(mc);
-		list_del(&me->ino_index);
-		ino_index_unlock(mc);
+		ino_index_del(mc, me);
+		cache_path_del(mc, me);
+		cache_put_parsed(me->parsed);
 		free(me->key);
 		if (me->mapent)
 			free(me->mapent);
@@ -1010,7 +1803,9 @@ int cache_delete(struct mapent_cache *mc, const char *key)
 			s = next;
 		}
 		free(me);
+		mc->entries--;
 	}
+	cache_check_resize(mc);
 done:
 	return ret;
 }
@@ -1078,18 +1873,22 @@ void cache_release(struct map_source *map)
 {
 	struct mapent_cache *mc;
 	struct mapent *me, *next;
-	int status;
 	unsigned int i;
 
 	mc = map->mc;
 
 	cache_writelock(mc);
 
+	/* Move any remaining entries so there's only one table to free */
+	if (mc->old_hash)
+		cache_rehash_step(mc, mc->old_size);
+
 	for (i = 0; i < mc->size; i++) {
 		me = mc->hash[i];
 		if (me == NULL)
 			continue;
 		next = me->next;
+		cache_put_parsed(me->parsed);
 		free(me->key);
 		if (me->mapent)
 			free(me->mapent);
@@ -1098,6 +1897,7 @@ void cache_release(struct map_source *map)
 		while (next != NULL) {
 			me = next;
 			next = me->next;
+			cache_put_parsed(me->parsed);
 			free(me->key);
 			if (me->mapent)
 				free(me->mapent);
@@ -1109,16 +1909,11 @@ void cache_release(struct map_source *map)
 
 	cache_unlock(mc);
 
-	status = pthread_mutex_destroy(&mc->ino_index_mutex);
-	if (status)
-		fatal(status);
-
-	status = pthread_rwlock_destroy(&mc->rwlock);
-	if (status)
-		fatal(status);
+	cache_locks_destroy(mc);
+	cache_path_index_free(mc);
+	cache_ino_index_free(mc);
 
 	free(mc->hash);
-	free(mc->ino_index);
 	free(mc);
 }
 
@@ -1126,13 +1921,16 @@ void cache_release_null_cache(struct master *master)
 {
 	struct mapent_cache *mc;
 	struct mapent *me, *next;
-	int status;
 	unsigned int i;
 
 	mc = master->nc;
 
 	cache_writelock(mc);
 
+	/* Move any remaining entries so there's only one table to free */
+	if (mc->old_hash)
+		cache_rehash_step(mc, mc->old_size);
+
 	for (i = 0; i < mc->size; i++) {
 		me = mc->hash[i];
 		if (me == NULL)
@@ -1155,16 +1953,11 @@ void cache_release_null_cache(struct master *master)
 
 	cache_unlock(mc);
 
-	status = pthread_mutex_destroy(&mc->ino_index_mutex);
-	if (status)
-		fatal(status);
-
-	status = pthread_rwlock_destroy(&mc->rwlock);
-	if (status)
-		fatal(status);
+	cache_locks_destroy(mc);
+	cache_path_index_free(mc);
+	cache_ino_index_free(mc);
 
 	free(mc->hash);
-	free(mc->ino_index);
 	free(mc);
 }
 
@@ -1288,3 +2081,131 @@ char *cache_get_offset(const char *prefix, char *offset, int start,
 	return *offset ? offset : NULL;
 }
 
+/* cache must be read locked by caller */
+void cache_get_stats(struct mapent_cache *mc, struct mapent_cache_stats *stats)
+{
+	struct mapent *me;
+	unsigned int i, len;
+
+	memset(stats, 0, sizeof(struct mapent_cache_stats));
+
+	stats->size = mc->size;
+	stats->entries = mc->entries;
+	stats->resizes = mc->resizes;
+	stats->rehashing = mc->old_hash ? 1 : 0;
+
+	for (i = 0; i < mc->size; i++) {
+		me = mc->hash[i];
+		if (!me)
+			continue;
+		stats->used++;
+		len = 0;
+		while (me) {
+			len++;
+			me = me->next;
+		}
+		if (len > stats->max_chain)
+			stats->max_chain = len;
+	}
+
+	ino_index_lock_all(mc);
+	stats->ino_size = mc->ino_size;
+	stats->ino_entries = mc->ino_entries;
+	for (i = 0; i < mc->ino_size; i++) {
+		struct list_head *p;
+
+		if (list_empty(&mc->ino_index[i]))
+			continue;
+		stats->ino_used++;
+		len = 0;
+		list_for_each(p, &mc->ino_index[i])
+			len++;
+		if (len > stats->ino_max_chain)
+			stats->ino_max_chain = len;
+	}
+	ino_index_unlock_all(mc);
+}
+
+/*
+ * Get a reference to the parsed form of a map entry, or NULL if
+ * there isn't one. It's up to the caller to check it is still valid.
+ */
+struct mapent_parse *cache_get_parsed(struct mapent *me)
+{
+	struct mapent_parse *parsed;
+	int status;
+
+	status = pthread_mutex_lock(&parsed_mutex);
+	if (status)
+		fatal(status);
+	parsed = me->parsed;
+	if (parsed)
+		parsed->refs++;
+	status = pthread_mutex_unlock(&parsed_mutex);
+	if (status)
+		fatal(status);
+
+	return parsed;
+}
+
+/* Replace the parsed form of a map entry, cache must be read locked */
+void cache_set_parsed(struct mapent *me, struct mapent_parse *parsed)
+{
+	struct mapent_parse *old;
+	int status;
+
+	status = pthread_mutex_lock(&parsed_mutex);
+	if (status)
+		fatal(status);
+	old = me->parsed;
+	if (parsed)
+		parsed->refs++;
+	me->parsed = parsed;
+	status = pthread_mutex_unlock(&parsed_mutex);
+	if (status)
+		fatal(status);
+
+	cache_put_parsed(old);
+}
+
+void cache_put_parsed(struct mapent_parse *parsed)
+{
+	unsigned int refs;
+	int status;
+
+	if (!parsed)
+		return;
+
+	status = pthread_mutex_lock(&parsed_mutex);
+	if (status)
+		fatal(status);
+	refs = --parsed->refs;
+	status = pthread_mutex_unlock(&parsed_mutex);
+	if (status)
+		fatal(status);
+
+	if (refs)
+		return;
+
+	while (!list_empty(&parsed->offsets)) {
+		struct mapent_offset *mo;
+
+		mo = list_entry(parsed->offsets.next, struct mapent_offset, list);
+		list_del(&mo->list);
+		free(mo->path);
+		if (mo->options)
+			free(mo->options);
+		if (mo->loc)
+			free(mo->loc);
+		free(mo);
+	}
+	if (parsed->entry)
+		free(parsed->entry);
+	if (parsed->optstr)
+		free(parsed->optstr);
+	if (parsed->options)
+		free(parsed->options);
+	if (parsed->loc)
+		free(parsed->loc);
+	free(parsed);
+}
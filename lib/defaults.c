@@ -56,6 +56,8 @@
 #define NAME_LDAP_URI			"ldap_uri"
 #define NAME_LDAP_TIMEOUT		"ldap_timeout"
 #define NAME_LDAP_NETWORK_TIMEOUT	"ldap_network_timeout"
+#define NAME_LDAP_CONNECTION_POOL_SIZE	"ldap_connection_pool_size"
+#define NAME_LDAP_CONNECTION_IDLE_TIMEOUT "ldap_connection_idle_timeout"
 
 #define NAME_SEARCH_BASE		"search_base"
 
@@ -66,6 +68,7 @@
 #define NAME_VALUE_ATTR			"value_attribute"
 
 #define NAME_MOUNT_NFS_DEFAULT_PROTOCOL	"mount_nfs_default_protocol"
+#define NAME_MOUNT_NFS_PROBE_CACHE_TIMEOUT "mount_nfs_probe_cache_timeout"
 #define NAME_APPEND_OPTIONS		"append_options"
 #define NAME_MOUNT_WAIT			"mount_wait"
 #define NAME_UMOUNT_WAIT		"umount_wait"
@@ -74,6 +77,17 @@
 #define NAME_MAP_HASH_TABLE_SIZE	"map_hash_table_size"
 
 #define NAME_USE_HOSTNAME_FOR_MOUNTS	"use_hostname_for_mounts"
+#define NAME_FILE_MAP_INDEX		"file_map_index"
+#define NAME_MOUNT_POOL_SIZE		"mount_pool_size"
+#define NAME_MOUNT_POOL_QUEUE_SIZE	"mount_pool_queue_size"
+#define NAME_MOUNT_NATIVE		"mount_native"
+#define NAME_DIRECT_MOUNT_THREADS	"direct_mount_threads"
+#define NAME_LOG_QUEUE_SIZE		"log_queue_size"
+#define NAME_LOG_RATE_LIMIT		"log_rate_limit"
+#define NAME_EXPIRE_THREADS		"expire_threads"
+#define NAME_HOSTS_EXPORTS_TIMEOUT	"hosts_exports_timeout"
+#define NAME_HOSTS_EXPORTS_THREADS	"hosts_exports_threads"
+#define NAME_HOSTS_EXPORTS_DEADLINE	"hosts_exports_deadline"
 
 #define NAME_AMD_ARCH				"arch"
 #define NAME_AMD_AUTO_ATTRCACHE			"auto_attrcache"
@@ -1642,6 +1656,28 @@ unsigned int defaults_get_ldap_network_timeout(void)
 	return res;
 }
 
+unsigned int defaults_get_ldap_connection_pool_size(void)
+{
+	int res;
+
+	res = conf_get_number(autofs_gbl_sec, NAME_LDAP_CONNECTION_POOL_SIZE);
+	if (res < 0)
+		res = atoi(DEFAULT_LDAP_CONNECTION_POOL_SIZE);
+
+	return res;
+}
+
+unsigned int defaults_get_ldap_connection_idle_timeout(void)
+{
+	int res;
+
+	res = conf_get_number(autofs_gbl_sec, NAME_LDAP_CONNECTION_IDLE_TIMEOUT);
+	if (res < 0)
+		res = atoi(DEFAULT_LDAP_CONNECTION_IDLE_TIMEOUT);
+
+	return res;
+}
+
 unsigned int defaults_get_mount_nfs_default_proto(void)
 {
 	int proto;
@@ -1653,6 +1689,17 @@ unsigned int defaults_get_mount_nfs_default_proto(void)
 	return (unsigned int) proto;
 }
 
+unsigned int defaults_get_mount_nfs_probe_cache_timeout(void)
+{
+	int timeout;
+
+	timeout = conf_get_number(autofs_gbl_sec, NAME_MOUNT_NFS_PROBE_CACHE_TIMEOUT);
+	if (timeout < 0)
+		timeout = atoi(DEFAULT_MOUNT_NFS_PROBE_CACHE_TIMEOUT);
+
+	return (unsigned int) timeout;
+}
+
 unsigned int defaults_get_append_options(void)
 {
 	int res;
@@ -1719,6 +1766,127 @@ unsigned int defaults_use_hostname_for_mounts(void)
 	return res;
 }
 
+unsigned int defaults_get_file_map_index(void)
+{
+	int res;
+
+	res = conf_get_yesno(autofs_gbl_sec, NAME_FILE_MAP_INDEX);
+	if (res < 0)
+		res = atoi(DEFAULT_FILE_MAP_INDEX);
+
+	return res;
+}
+
+unsigned int defaults_get_mount_pool_size(void)
+{
+	long size;
+
+	size = conf_get_number(autofs_gbl_sec, NAME_MOUNT_POOL_SIZE);
+	if (size < 0)
+		size = atoi(DEFAULT_MOUNT_POOL_SIZE);
+
+	return (unsigned int) size;
+}
+
+unsigned int defaults_get_mount_pool_queue_size(void)
+{
+	long size;
+
+	size = conf_get_number(autofs_gbl_sec, NAME_MOUNT_POOL_QUEUE_SIZE);
+	if (size < 0)
+		size = atoi(DEFAULT_MOUNT_POOL_QUEUE_SIZE);
+
+	return (unsigned int) size;
+}
+
+unsigned int defaults_get_mount_native(void)
+{
+	int res;
+
+	res = conf_get_yesno(autofs_gbl_sec, NAME_MOUNT_NATIVE);
+	if (res < 0)
+		res = atoi(DEFAULT_MOUNT_NATIVE);
+
+	return res;
+}
+
+unsigned int defaults_get_direct_mount_threads(void)
+{
+	long threads;
+
+	threads = conf_get_number(autofs_gbl_sec, NAME_DIRECT_MOUNT_THREADS);
+	if (threads < 0)
+		threads = atoi(DEFAULT_DIRECT_MOUNT_THREADS);
+
+	return (unsigned int) threads;
+}
+
+unsigned int defaults_get_log_queue_size(void)
+{
+	long size;
+
+	size = conf_get_number(autofs_gbl_sec, NAME_LOG_QUEUE_SIZE);
+	if (size < 0)
+		size = atoi(DEFAULT_LOG_QUEUE_SIZE);
+
+	return (unsigned int) size;
+}
+
+unsigned int defaults_get_log_rate_limit(void)
+{
+	long limit;
+
+	limit = conf_get_number(autofs_gbl_sec, NAME_LOG_RATE_LIMIT);
+	if (limit < 0)
+		limit = atoi(DEFAULT_LOG_RATE_LIMIT);
+
+	return (unsigned int) limit;
+}
+
+unsigned int defaults_get_expire_threads(void)
+{
+	long threads;
+
+	threads = conf_get_number(autofs_gbl_sec, NAME_EXPIRE_THREADS);
+	if (threads < 0)
+		threads = atoi(DEFAULT_EXPIRE_THREADS);
+
+	return (unsigned int) threads;
+}
+
+unsigned int defaults_get_hosts_exports_timeout(void)
+{
+	long timeout;
+
+	timeout = conf_get_number(autofs_gbl_sec, NAME_HOSTS_EXPORTS_TIMEOUT);
+	if (timeout <= 0)
+		timeout = atoi(DEFAULT_HOSTS_EXPORTS_TIMEOUT);
+
+	return (unsigned int) timeout;
+}
+
+unsigned int defaults_get_hosts_exports_threads(void)
+{
+	long threads;
+
+	threads = conf_get_number(autofs_gbl_sec, NAME_HOSTS_EXPORTS_THREADS);
+	if (threads <= 0)
+		threads = atoi(DEFAULT_HOSTS_EXPORTS_THREADS);
+
+	return (unsigned int) threads;
+}
+
+unsigned int defaults_get_hosts_exports_deadline(void)
+{
+	long deadline;
+
+	deadline = conf_get_number(autofs_gbl_sec, NAME_HOSTS_EXPORTS_DEADLINE);
+	if (deadline <= 0)
+		deadline = atoi(DEFAULT_HOSTS_EXPORTS_DEADLINE);
+
+	return (unsigned int) deadline;
+}
+
 unsigned int conf_amd_mount_section_exists(const char *section)
 {
 	return conf_section_exists(section);
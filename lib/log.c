@@ -32,6 +32,339 @@ static unsigned int logging_to_syslog = 0;
 static unsigned int do_verbose = 0;		/* Verbose feedback option */
 static unsigned int do_debug = 0;		/* Full debug output */
 
+/* Longest message queued for the log writer, longer ones are truncated */
+#define LOG_MSG_SIZE		512
+/* Number of call site slots used for rate limiting */
+#define LOG_RATE_SLOTS		256
+
+/* A queued log message */
+struct log_msg {
+	unsigned long seq;
+	int priority;
+	char text[LOG_MSG_SIZE];
+};
+
+/*
+ * When a queue size is configured messages are formatted into a ring
+ * of slots by the calling thread and written out by the log writer
+ * thread. A slot is claimed by moving the enqueue position on and is
+ * handed to the writer by setting its sequence number, so callers
+ * never wait on one another or on the writer. If the ring is full the
+ * message is dropped and counted.
+ */
+struct log_queue {
+	struct log_msg *msgs;
+	unsigned long size;
+	unsigned long enqueue;
+	unsigned long dequeue;
+	unsigned int waiting;		/* Set while the writer is idle */
+	unsigned int shutdown;
+	unsigned long dropped;		/* Messages dropped, ring full */
+	unsigned long limited;		/* Messages dropped by rate limit */
+	unsigned long reported;		/* Drops already reported */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thid;
+};
+
+/* Messages logged within the current second by a call site */
+struct log_rate {
+	const char *msg;
+	time_t second;
+	unsigned int count;
+};
+
+static struct log_queue *log_queue = NULL;
+static unsigned int log_rate_limit = 0;
+static struct log_rate log_rates[LOG_RATE_SLOTS];
+
+static void log_write(int priority, const char *text)
+{
+	if (logging_to_syslog)
+		syslog(priority, "%s", text);
+	else {
+		fputs(text, stderr);
+		fputc('\n', stderr);
+	}
+}
+
+static void log_report_drops(struct log_queue *q)
+{
+	unsigned long dropped, limited;
+	char buf[80];
+
+	dropped = __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+	limited = __atomic_load_n(&q->limited, __ATOMIC_RELAXED);
+	if (dropped + limited == q->reported)
+		return;
+
+	snprintf(buf, sizeof(buf),
+		 "log messages dropped: %lu queue full, %lu rate limited",
+		 dropped, limited);
+	log_write(LOG_WARNING, buf);
+	q->reported = dropped + limited;
+}
+
+/* Write out queued messages, only the writer thread calls this */
+static void log_queue_flush(struct log_queue *q)
+{
+	while (1) {
+		struct log_msg *m = &q->msgs[q->dequeue & (q->size - 1)];
+		unsigned long seq;
+
+		seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+		if (seq != q->dequeue + 1)
+			break;
+
+		log_write(m->priority, m->text);
+
+		__atomic_store_n(&m->seq, q->dequeue + q->size, __ATOMIC_RELEASE);
+		q->dequeue++;
+	}
+	log_report_drops(q);
+}
+
+static int log_queue_empty(struct log_queue *q)
+{
+	struct log_msg *m = &q->msgs[q->dequeue & (q->size - 1)];
+
+	return __atomic_load_n(&m->seq, __ATOMIC_SEQ_CST) != q->dequeue + 1;
+}
+
+static void *log_writer(void *arg)
+{
+	struct log_queue *q = (struct log_queue *) arg;
+	int status;
+
+	while (1) {
+		log_queue_flush(q);
+
+		status = pthread_mutex_lock(&q->mutex);
+		if (status)
+			fatal(status);
+
+		__atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
+		while (log_queue_empty(q) &&
+		       !__atomic_load_n(&q->shutdown, __ATOMIC_SEQ_CST)) {
+			struct timespec wait;
+
+			clock_gettime(CLOCK_MONOTONIC, &wait);
+			wait.tv_sec++;
+			status = pthread_cond_timedwait(&q->cond, &q->mutex, &wait);
+			if (status && status != ETIMEDOUT)
+				fatal(status);
+		}
+		__atomic_store_n(&q->waiting, 0, __ATOMIC_SEQ_CST);
+
+		status = pthread_mutex_unlock(&q->mutex);
+		if (status)
+			fatal(status);
+
+		if (__atomic_load_n(&q->shutdown, __ATOMIC_SEQ_CST)) {
+			log_queue_flush(q);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Check if a call site has logged more than the limit this second */
+static int log_rate_limited(const char *msg)
+{
+	unsigned long slot = ((unsigned long) msg >> 3) % LOG_RATE_SLOTS;
+	struct log_rate *r = &log_rates[slot];
+	time_t now = monotonic_time(NULL);
+
+	if (__atomic_load_n(&r->msg, __ATOMIC_RELAXED) != msg ||
+	    __atomic_load_n(&r->second, __ATOMIC_RELAXED) != now) {
+		__atomic_store_n(&r->msg, msg, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->second, now, __ATOMIC_RELAXED);
+		__atomic_store_n(&r->count, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	return __atomic_add_fetch(&r->count, 1, __ATOMIC_RELAXED) > log_rate_limit;
+}
+
+/* Queue a message for the writer, returns 0 if it must be logged directly */
+static int log_queue_msg(int priority, int limit, const char *msg, va_list ap)
+{
+	struct log_queue *q = __atomic_load_n(&log_queue, __ATOMIC_ACQUIRE);
+	struct log_msg *m;
+	unsigned long pos;
+
+	if (!q)
+		return 0;
+
+	if (limit && log_rate_limit && log_rate_limited(msg)) {
+		__atomic_add_fetch(&q->limited, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+
+	pos = __atomic_load_n(&q->enqueue, __ATOMIC_RELAXED);
+	while (1) {
+		long diff;
+
+		m = &q->msgs[pos & (q->size - 1)];
+		diff = (long) (__atomic_load_n(&m->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->enqueue, &pos, pos + 1, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_add_fetch(&q->dropped, 1, __ATOMIC_RELAXED);
+			return 1;
+		} else
+			pos = __atomic_load_n(&q->enqueue, __ATOMIC_RELAXED);
+	}
+
+	m->priority = priority;
+	vsnprintf(m->text, LOG_MSG_SIZE, msg, ap);
+	__atomic_store_n(&m->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&q->waiting, __ATOMIC_SEQ_CST)) {
+		int status;
+
+		status = pthread_mutex_lock(&q->mutex);
+		if (status)
+			fatal(status);
+		pthread_cond_signal(&q->cond);
+		status = pthread_mutex_unlock(&q->mutex);
+		if (status)
+			fatal(status);
+	}
+
+	return 1;
+}
+
+static void log_msg(int priority, int limit, const char *msg, va_list ap)
+{
+	va_list aq;
+	int queued;
+
+	va_copy(aq, ap);
+	queued = log_queue_msg(priority, limit, msg, aq);
+	va_end(aq);
+	if (queued)
+		return;
+
+	if (logging_to_syslog)
+		vsyslog(priority, msg, ap);
+	else {
+		vfprintf(stderr, msg, ap);
+		fputc('\n', stderr);
+	}
+}
+
+/*
+ * Start the log writer thread. Messages are queued for it when
+ * queue_size is not 0 and, when rate_limit is not 0, messages
+ * below error priority from a call site are dropped after the
+ * first rate_limit in each second.
+ */
+int log_async_start(unsigned int queue_size, unsigned int rate_limit)
+{
+	pthread_condattr_t condattrs;
+	struct log_queue *q;
+	unsigned long size, i;
+	int status;
+
+	if (!queue_size || log_queue)
+		return 1;
+
+	size = 1;
+	while (size < queue_size)
+		size <<= 1;
+
+	q = malloc(sizeof(struct log_queue));
+	if (!q)
+		return 0;
+	memset(q, 0, sizeof(struct log_queue));
+
+	q->msgs = malloc(size * sizeof(struct log_msg));
+	if (!q->msgs) {
+		free(q);
+		return 0;
+	}
+	q->size = size;
+	for (i = 0; i < size; i++)
+		q->msgs[i].seq = i;
+
+	status = pthread_mutex_init(&q->mutex, NULL);
+	if (status)
+		fatal(status);
+
+	status = pthread_condattr_init(&condattrs);
+	if (status)
+		fatal(status);
+
+	status = pthread_condattr_setclock(&condattrs, CLOCK_MONOTONIC);
+	if (status)
+		fatal(status);
+
+	status = pthread_cond_init(&q->cond, &condattrs);
+	if (status)
+		fatal(status);
+
+	pthread_condattr_destroy(&condattrs);
+
+	status = pthread_create(&q->thid, NULL, log_writer, q);
+	if (status) {
+		pthread_cond_destroy(&q->cond);
+		pthread_mutex_destroy(&q->mutex);
+		free(q->msgs);
+		free(q);
+		return 0;
+	}
+
+	log_rate_limit = rate_limit;
+	__atomic_store_n(&log_queue, q, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/*
+ * Write out any queued messages and go back to logging directly.
+ * Only called at exit so the queue itself is left in place for
+ * any thread still logging through it.
+ */
+void log_async_stop(void)
+{
+	struct log_queue *q = __atomic_load_n(&log_queue, __ATOMIC_ACQUIRE);
+	int status;
+
+	if (!q)
+		return;
+
+	__atomic_store_n(&log_queue, NULL, __ATOMIC_RELEASE);
+
+	status = pthread_mutex_lock(&q->mutex);
+	if (status)
+		fatal(status);
+	__atomic_store_n(&q->shutdown, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_signal(&q->cond);
+	status = pthread_mutex_unlock(&q->mutex);
+	if (status)
+		fatal(status);
+
+	pthread_join(q->thid, NULL);
+}
+
+void log_async_log_stats(unsigned int logopt)
+{
+	struct log_queue *q = __atomic_load_n(&log_queue, __ATOMIC_ACQUIRE);
+
+	if (!q)
+		return;
+
+	log_debug(logopt,
+		  "log queue: size %lu queued %lu dropped %lu rate limited %lu",
+		  q->size, __atomic_load_n(&q->enqueue, __ATOMIC_RELAXED),
+		  __atomic_load_n(&q->dropped, __ATOMIC_RELAXED),
+		  __atomic_load_n(&q->limited, __ATOMIC_RELAXED));
+}
+
 void set_log_norm(void)
 {
 	do_verbose = 0;
@@ -78,12 +411,7 @@ void log_info(unsigned int logopt, const char *msg, ...)
 		return;
 
 	va_start(ap, msg);
-	if (logging_to_syslog)
-		vsyslog(LOG_INFO, msg, ap);
-	else {
-		vfprintf(stderr, msg, ap);
-		fputc('\n', stderr);
-	}
+	log_msg(LOG_INFO, 1, msg, ap);
 	va_end(ap);
 
 	return;
@@ -98,12 +426,7 @@ void log_notice(unsigned int logopt, const char *msg, ...)
 		return;
 
 	va_start(ap, msg);
-	if (logging_to_syslog)
-		vsyslog(LOG_NOTICE, msg, ap);
-	else {
-		vfprintf(stderr, msg, ap);
-		fputc('\n', stderr);
-	}
+	log_msg(LOG_NOTICE, 1, msg, ap);
 	va_end(ap);
 
 	return;
@@ -118,12 +441,7 @@ void log_warn(unsigned int logopt, const char *msg, ...)
 		return;
 
 	va_start(ap, msg);
-	if (logging_to_syslog)
-		vsyslog(LOG_WARNING, msg, ap);
-	else {
-		vfprintf(stderr, msg, ap);
-		fputc('\n', stderr);
-	}
+	log_msg(LOG_WARNING, 1, msg, ap);
 	va_end(ap);
 
 	return;
@@ -134,12 +452,7 @@ void log_error(unsigned logopt, const char *msg, ...)
 	va_list ap;
 
 	va_start(ap, msg);
-	if (logging_to_syslog)
-		vsyslog(LOG_ERR, msg, ap);
-	else {
-		vfprintf(stderr, msg, ap);
-		fputc('\n', stderr);
-	}
+	log_msg(LOG_ERR, 0, msg, ap);
 	va_end(ap);
 	return;
 }
@@ -149,12 +462,7 @@ void log_crit(unsigned logopt, const char *msg, ...)
 	va_list ap;
 
 	va_start(ap, msg);
-	if (logging_to_syslog)
-		vsyslog(LOG_CRIT, msg, ap);
-	else {
-		vfprintf(stderr, msg, ap);
-		fputc('\n', stderr);
-	}
+	log_msg(LOG_CRIT, 0, msg, ap);
 	va_end(ap);
 	return;
 }
@@ -168,12 +476,7 @@ void log_debug(unsigned int logopt, const char *msg, ...)
 		return;
 
 	va_start(ap, msg);
-	if (logging_to_syslog)
-		vsyslog(LOG_WARNING, msg, ap);
-	else {
-		vfprintf(stderr, msg, ap);
-		fputc('\n', stderr);
-	}
+	log_msg(LOG_WARNING, 1, msg, ap);
 	va_end(ap);
 
 	return;
@@ -183,6 +486,7 @@ void logmsg(const char *msg, ...)
 {
 	va_list ap;
 	va_start(ap, msg);
+	/* Used just before aborting so it isn't queued */
 	if (logging_to_syslog)
 		vsyslog(LOG_CRIT, msg, ap);
 	else {
@@ -54,6 +54,209 @@ static unsigned int macro_init_done = 0;
 static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t macro_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+#define MACRO_INDEX_MIN		64
+
+/*
+ * Open addressed hash index of the system table, rebuilt under the
+ * table mutex whenever a variable is added or removed and searched
+ * without taking it. Replaced indexes may still be in use so they
+ * are kept until the system table is freed.
+ */
+struct macro_index {
+	struct macro_index *next;
+	unsigned int size;
+	const struct substvar *slot[];
+};
+
+static struct macro_index *system_index = NULL;
+static struct macro_index *retired_index = NULL;
+
+#ifdef ENABLE_EXT_ENV
+/* Environment variable values seen by lookups, never changed */
+static struct substvar *env_table = NULL;
+#endif
+
+static u_int32_t macro_hash(const char *str, int len)
+{
+	u_int32_t hashval = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		hashval += (unsigned char) str[i];
+		hashval += (hashval << 10);
+		hashval ^= (hashval >> 6);
+	}
+
+	hashval += (hashval << 3);
+	hashval ^= (hashval >> 11);
+	hashval += (hashval << 15);
+
+	return hashval;
+}
+
+/* table_mutex must be held by caller */
+static void macro_index_rebuild(void)
+{
+	struct macro_index *index, *old;
+	const struct substvar *sv;
+	unsigned int count = 0, size = MACRO_INDEX_MIN;
+
+	for (sv = system_table; sv; sv = sv->next)
+		count++;
+	while (size < count * 2)
+		size <<= 1;
+
+	index = malloc(sizeof(struct macro_index) +
+		       size * sizeof(struct substvar *));
+	if (index) {
+		memset(index->slot, 0, size * sizeof(struct substvar *));
+		index->size = size;
+
+		/* Earlier definitions hide later ones of the same name */
+		for (sv = system_table; sv; sv = sv->next) {
+			unsigned int i;
+
+			i = macro_hash(sv->def, strlen(sv->def)) & (size - 1);
+			while (index->slot[i]) {
+				if (!strcmp(index->slot[i]->def, sv->def))
+					break;
+				i = (i + 1) & (size - 1);
+			}
+			if (!index->slot[i])
+				index->slot[i] = sv;
+		}
+	}
+
+	/* Without an index lookups search the table */
+	old = system_index;
+	__atomic_store_n(&system_index, index, __ATOMIC_RELEASE);
+	if (old) {
+		old->next = retired_index;
+		retired_index = old;
+	}
+}
+
+/* table_mutex must be held by caller */
+static void macro_index_free(void)
+{
+	struct macro_index *index = system_index;
+
+	system_index = NULL;
+	if (index) {
+		index->next = retired_index;
+		retired_index = index;
+	}
+
+	while (retired_index) {
+		index = retired_index;
+		retired_index = index->next;
+		free(index);
+	}
+}
+
+static const struct substvar *macro_index_find(const char *str, int len)
+{
+	const struct macro_index *index;
+	const struct substvar *sv;
+	unsigned int i;
+
+	index = __atomic_load_n(&system_index, __ATOMIC_ACQUIRE);
+	if (!index) {
+		for (sv = system_table; sv; sv = sv->next) {
+			if (!strncmp(str, sv->def, len) && sv->def[len] == '\0')
+				return sv;
+		}
+		return NULL;
+	}
+
+	i = macro_hash(str, len) & (index->size - 1);
+	while ((sv = index->slot[i])) {
+		if (!strncmp(str, sv->def, len) && sv->def[len] == '\0')
+			return sv;
+		i = (i + 1) & (index->size - 1);
+	}
+
+	return NULL;
+}
+
+#ifdef ENABLE_EXT_ENV
+static const struct substvar *env_find(const char *str, int len,
+				       const char *value)
+{
+	const struct substvar *ev;
+
+	ev = __atomic_load_n(&env_table, __ATOMIC_ACQUIRE);
+	while (ev) {
+		if (!strncmp(str, ev->def, len) && ev->def[len] == '\0' &&
+		    !strcmp(ev->val, value))
+			return ev;
+		ev = ev->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Look for an environment variable. Each name and value pair is
+ * added to a table the first time it's seen so the returned
+ * variable can be used for as long as the caller needs it.
+ */
+static const struct substvar *macro_env_findvar(const char *str, int len)
+{
+	const struct substvar *ev;
+	struct substvar *new;
+	char etmp[512];
+	char *value;
+	int status;
+
+	if (len >= sizeof(etmp))
+		return NULL;
+
+	memcpy(etmp, str, len);
+	etmp[len] = '\0';
+
+	value = getenv(etmp);
+	if (!value)
+		return NULL;
+
+	ev = env_find(str, len, value);
+	if (ev)
+		return ev;
+
+	status = pthread_mutex_lock(&table_mutex);
+	if (status)
+		fatal(status);
+
+	ev = env_find(str, len, value);
+	if (ev)
+		goto done;
+
+	new = malloc(sizeof(struct substvar));
+	if (!new)
+		goto done;
+	new->def = strdup(etmp);
+	new->val = strdup(value);
+	if (!new->def || !new->val) {
+		if (new->def)
+			free(new->def);
+		if (new->val)
+			free(new->val);
+		free(new);
+		goto done;
+	}
+	new->readonly = 1;
+	new->next = env_table;
+	__atomic_store_n(&env_table, new, __ATOMIC_RELEASE);
+	ev = new;
+done:
+	status = pthread_mutex_unlock(&table_mutex);
+	if (status)
+		fatal(status);
+
+	return ev;
+}
+#endif
+
 void dump_table(struct substvar *table)
 {
 	struct substvar *lv = table;
@@ -78,6 +281,7 @@ void dump_table(struct substvar *table)
 void macro_init(void)
 {
 	char *local_domain;
+	int status;
 
 	memset(hostname, 0, HOST_NAME_MAX + 1);
 	memset(host, 0, HOST_NAME_MAX);
@@ -135,36 +339,22 @@ void macro_init(void)
 
 	add_std_amd_vars(system_table);
 
-	macro_init_done = 1;
-	macro_unlock();
-	return;
-}
-
-int macro_is_systemvar(const char *str, int len)
-{
-	struct substvar *sv;
-	int found = 0;
-	int status;
-
 	status = pthread_mutex_lock(&table_mutex);
 	if (status)
 		fatal(status);
-
-	sv = system_table;
-
-	while (sv) {
-		if (!strncmp(str, sv->def, len) && sv->def[len] == '\0') {
-			found = 1;
-			break;
-		}
-		sv = sv->next;
-	}
-
+	macro_index_rebuild();
 	status = pthread_mutex_unlock(&table_mutex);
 	if (status)
 		fatal(status);
 
-	return found;
+	macro_init_done = 1;
+	macro_unlock();
+	return;
+}
+
+int macro_is_systemvar(const char *str, int len)
+{
+	return macro_index_find(str, len) != NULL;
 }
 
 int macro_global_addvar(const char *str, int len, const char *value)
@@ -218,6 +408,7 @@ int macro_global_addvar(const char *str, int len, const char *value)
 		new->readonly = 0;
 		new->next = system_table;
 		system_table = new;
+		macro_index_rebuild();
 		ret =1;
 	}
 done:
@@ -351,6 +542,7 @@ void macro_global_removevar(const char *str, int len)
 			last->next = sv->next;
 		else
 			system_table = sv->next;
+		macro_index_rebuild();
 		if (sv->def)
 			free(sv->def);
 		if (sv->val)
@@ -422,6 +614,17 @@ void macro_free_global_table(void)
 	}
 
 	system_table = &sv_osvers;
+	macro_index_free();
+
+#ifdef ENABLE_EXT_ENV
+	while (env_table) {
+		sv = env_table;
+		env_table = sv->next;
+		free(sv->def);
+		free(sv->val);
+		free(sv);
+	}
+#endif
 
 	status = pthread_mutex_unlock(&table_mutex);
 	if (status)
@@ -455,14 +658,8 @@ void macro_free_table(struct substvar *table)
 const struct substvar *
 macro_findvar(const struct substvar *table, const char *str, int len)
 {
-	const struct substvar *sv = system_table;
+	const struct substvar *sv;
 	const struct substvar *lv = table;
-#ifdef ENABLE_EXT_ENV
-	/* holds one env var */
-	static struct substvar *lv_var;
-	static char *value;
-	char etmp[512];
-#endif
 
 	/* First try the passed in local table */
 	while (lv) {
@@ -472,24 +669,16 @@ macro_findvar(const struct substvar *table, const char *str, int len)
 	}
 
 	/* Then look in the system wide table */
-	while (sv) {
-		if (!strncmp(str, sv->def, len) && sv->def[len] == '\0')
-			return sv;
-		sv = sv->next;
-	}
+	sv = macro_index_find(str, len);
+	if (sv)
+		return sv;
 
 #ifdef ENABLE_EXT_ENV
 	/* builtin and local map failed, try the $ENV */
-	memcpy(etmp, str, len);
-	etmp[len]='\0';
-
-	if ((value=getenv(etmp)) != NULL) {
-		lv_var = macro_addvar((struct substvar *) table, str, len, value);
-		return(lv_var);
-	}
-#endif
-
+	return macro_env_findvar(str, len);
+#else
 	return NULL;
+#endif
 }
 
 /* Set environment from macro variable table */
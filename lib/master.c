@@ -76,6 +76,7 @@ int master_add_autofs_point(struct master_mapent *entry, unsigned logopt,
 		return 0;
 
 	ap->state = ST_INIT;
+	memset(ap->stage_stats, 0, sizeof(ap->stage_stats));
 
 	ap->state_pipe[0] = -1;
 	ap->state_pipe[1] = -1;
@@ -215,6 +216,7 @@ master_add_map_source(struct master_mapent *entry,
 	if (source->argv[0])
 		source->name = strdup(source->argv[0]);
 
+	master_maps_lock(entry);
 	master_source_writelock(entry);
 
 	if (!entry->maps) {
@@ -222,6 +224,7 @@ master_add_map_source(struct master_mapent *entry,
 		if (!source->mc) {
 			master_free_map_source(source, 0);
 			master_source_unlock(entry);
+			master_maps_unlock(entry);
 			return NULL;
 		}
 		entry->maps = source;
@@ -235,6 +238,7 @@ master_add_map_source(struct master_mapent *entry,
 			this->age = age;
 			master_free_map_source(source, 0);
 			master_source_unlock(entry);
+			master_maps_unlock(entry);
 			return this;
 		}
 
@@ -242,6 +246,7 @@ master_add_map_source(struct master_mapent *entry,
 		if (!source->mc) {
 			master_free_map_source(source, 0);
 			master_source_unlock(entry);
+			master_maps_unlock(entry);
 			return NULL;
 		}
 
@@ -258,6 +263,7 @@ master_add_map_source(struct master_mapent *entry,
 	}
 
 	master_source_unlock(entry);
+	master_maps_unlock(entry);
 
 	return source;
 }
@@ -353,6 +359,8 @@ static void __master_free_map_source(struct map_source *source, unsigned int fre
 	}
 	if (source->argv)
 		free_argv(source->argc, source->argv);
+	if (source->lookup_stats)
+		free(source->lookup_stats);
 	if (source->instance) {
 		struct map_source *instance, *next;
 
@@ -631,6 +639,45 @@ void master_source_lock_cleanup(void *arg)
 	return;
 }
 
+/*
+ * The maps mutex serialises reading the map sources of a master map
+ * entry with changes to its map source list made when the master map
+ * is re-read. It's per entry so that a slow map read only holds up
+ * master map updates to the same entry.
+ */
+void master_maps_lock(struct master_mapent *entry)
+{
+	int status;
+
+	status = pthread_mutex_lock(&entry->maps_mutex);
+	if (status) {
+		logmsg("master_mapent maps lock failed");
+		fatal(status);
+	}
+	return;
+}
+
+void master_maps_unlock(struct master_mapent *entry)
+{
+	int status;
+
+	status = pthread_mutex_unlock(&entry->maps_mutex);
+	if (status) {
+		logmsg("master_mapent maps unlock failed");
+		fatal(status);
+	}
+	return;
+}
+
+void master_maps_lock_cleanup(void *arg)
+{
+	struct master_mapent *entry = (struct master_mapent *) arg;
+
+	master_maps_unlock(entry);
+
+	return;
+}
+
 void master_source_current_wait(struct master_mapent *entry)
 {
 	int status;
@@ -775,6 +822,10 @@ struct master_mapent *master_new_mapent(struct master *master, const char *path,
 	if (status)
 		fatal(status);
 
+	status = pthread_mutex_init(&entry->maps_mutex, NULL);
+	if (status)
+		fatal(status);
+
 	status = pthread_mutex_init(&entry->current_mutex, NULL);
 	if (status)
 		fatal(status);
@@ -839,6 +890,10 @@ void master_free_mapent(struct master_mapent *entry)
 	if (status)
 		fatal(status);
 
+	status = pthread_mutex_destroy(&entry->maps_mutex);
+	if (status)
+		fatal(status);
+
 	status = pthread_mutex_destroy(&entry->current_mutex);
 	if (status)
 		fatal(status);
@@ -1159,6 +1214,7 @@ static void check_update_map_sources(struct master_mapent *entry, int readall)
 
 	ap = entry->ap;
 
+	master_maps_lock(entry);
 	master_source_writelock(entry);
 
 	last = NULL;
@@ -1203,6 +1259,7 @@ static void check_update_map_sources(struct master_mapent *entry, int readall)
 	}
 
 	master_source_unlock(entry);
+	master_maps_unlock(entry);
 
 	/* The map sources have changed */
 	if (map_stale)
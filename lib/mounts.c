@@ -27,6 +27,7 @@
 #include <pwd.h>
 #include <grp.h>
 #include <libgen.h>
+#include <poll.h>
 
 #include "automount.h"
 
@@ -435,6 +436,61 @@ struct substvar *removestdenv(struct substvar *sv, const char *prefix)
 	return list;
 }
 
+static struct substvar *stdenv_push(struct stdenv_vars *env,
+				     struct substvar *list,
+				     const char *name, char *val)
+{
+	struct substvar *var = &env->vars[env->count++];
+
+	var->def = (char *) name;
+	var->val = val;
+	var->readonly = 1;
+	var->next = list;
+
+	return var;
+}
+
+/*
+ * Chain the standard environment variables of the requesting user
+ * in front of sv. Unlike addstdenv() the table isn't changed so
+ * it can be shared by concurrent requests without locking, the
+ * returned chain is only valid while env and sv are.
+ */
+struct substvar *stdenv_overlay(struct stdenv_vars *env, struct substvar *sv)
+{
+	struct substvar *list = sv;
+	struct thread_stdenv_vars *tsv;
+	const struct substvar *mv;
+
+	env->count = 0;
+
+	tsv = pthread_getspecific(key_thread_stdenv_vars);
+	if (!tsv)
+		return list;
+
+	if (sprintf(env->uid, "%ld", (long) tsv->uid) > 0)
+		list = stdenv_push(env, list, "UID", env->uid);
+	if (sprintf(env->gid, "%ld", (long) tsv->gid) > 0)
+		list = stdenv_push(env, list, "GID", env->gid);
+	list = stdenv_push(env, list, "USER", tsv->user);
+	list = stdenv_push(env, list, "GROUP", tsv->group);
+	list = stdenv_push(env, list, "HOME", tsv->home);
+
+	mv = macro_findvar(list, "HOST", 4);
+	if (mv) {
+		char *dot;
+
+		strncpy(env->shost, mv->val, sizeof(env->shost) - 1);
+		env->shost[sizeof(env->shost) - 1] = '\0';
+		dot = strchr(env->shost, '.');
+		if (dot)
+			*dot = '\0';
+		list = stdenv_push(env, list, "SHOST", env->shost);
+	}
+
+	return list;
+}
+
 void add_std_amd_vars(struct substvar *sv)
 {
 	char *tmp;
@@ -784,14 +840,371 @@ done:
 }
 
 /*
- * Get list of mounts under path in longest->shortest order
+ * Cached copy of the proc mount table. Parsing the mount table is
+ * expensive when there are many mounts so it's only parsed again
+ * when poll(2) on the mountinfo file says there has been a change
+ * to the mount namespace since it was last parsed. A table is not
+ * changed once made and each user holds a reference to it so it
+ * can be replaced while it's still in use.
  */
-struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
+#define _PROC_SELF_MOUNTINFO	"/proc/self/mountinfo"
+
+struct mnt_table {
+	unsigned int refs;
+	unsigned long generation;
+	unsigned int count;
+	unsigned int size;
+	struct mntent *ents;
+	int *hash;
+	int *next;
+};
+
+static pthread_mutex_t mnt_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct mnt_table *mnt_table = NULL;
+/* -1 not opened yet, -2 change notification not available */
+static int mnt_table_fd = -1;
+static unsigned long mnt_table_generation = 0;
+/* A change has been seen but the table not parsed again yet */
+static unsigned int mnt_table_stale = 0;
+static struct mnt_table_stats mnt_table_stats;
+
+static void mnt_table_lock(void)
+{
+	int status = pthread_mutex_lock(&mnt_table_mutex);
+	if (status)
+		fatal(status);
+}
+
+static void mnt_table_unlock(void)
+{
+	int status = pthread_mutex_unlock(&mnt_table_mutex);
+	if (status)
+		fatal(status);
+}
+
+static u_int32_t mnt_table_hash(const char *path, unsigned int size)
+{
+	const unsigned char *s = (const unsigned char *) path;
+	u_int32_t h = 0;
+
+	for (; *s; s++) {
+		h += *s;
+		h += (h << 10);
+		h ^= (h >> 6);
+	}
+	h += (h << 3);
+	h ^= (h >> 11);
+	h += (h << 15);
+
+	return h & (size - 1);
+}
+
+static void mnt_table_free(struct mnt_table *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->count; i++)
+		free(t->ents[i].mnt_fsname);
+	free(t->ents);
+	free(t->hash);
+	free(t->next);
+	free(t);
+}
+
+/* Called with mnt_table_mutex held */
+static void __mnt_table_put(struct mnt_table *t)
+{
+	if (--t->refs == 0)
+		mnt_table_free(t);
+}
+
+static void mnt_table_put(struct mnt_table *t)
 {
+	if (!t)
+		return;
+	mnt_table_lock();
+	__mnt_table_put(t);
+	mnt_table_unlock();
+}
+
+static int mnt_table_add(struct mnt_table *t, struct mntent *mnt)
+{
+	size_t fsname_len, dir_len, type_len, opts_len;
+	struct mntent *ent;
+	char *strings;
+
+	if (t->count == t->size) {
+		unsigned int size = t->size ? t->size * 2 : 64;
+		struct mntent *ents;
+
+		ents = realloc(t->ents, size * sizeof(struct mntent));
+		if (!ents)
+			return 0;
+		t->ents = ents;
+		t->size = size;
+	}
+
+	/* All the strings of an entry are in one allocation */
+	fsname_len = strlen(mnt->mnt_fsname) + 1;
+	dir_len = strlen(mnt->mnt_dir) + 1;
+	type_len = strlen(mnt->mnt_type) + 1;
+	opts_len = strlen(mnt->mnt_opts) + 1;
+
+	strings = malloc(fsname_len + dir_len + type_len + opts_len);
+	if (!strings)
+		return 0;
+
+	ent = &t->ents[t->count];
+	memset(ent, 0, sizeof(struct mntent));
+	ent->mnt_fsname = memcpy(strings, mnt->mnt_fsname, fsname_len);
+	strings += fsname_len;
+	ent->mnt_dir = memcpy(strings, mnt->mnt_dir, dir_len);
+	strings += dir_len;
+	ent->mnt_type = memcpy(strings, mnt->mnt_type, type_len);
+	strings += type_len;
+	ent->mnt_opts = memcpy(strings, mnt->mnt_opts, opts_len);
+	ent->mnt_freq = mnt->mnt_freq;
+	ent->mnt_passno = mnt->mnt_passno;
+	t->count++;
+
+	return 1;
+}
+
+static struct mnt_table *mnt_table_read(void)
+{
+	struct mnt_table *t;
+	struct mntent mnt_wrk;
+	char buf[PATH_MAX * 3];
+	struct mntent *mnt;
+	unsigned int i;
+	FILE *tab;
+
+	t = malloc(sizeof(struct mnt_table));
+	if (!t)
+		return NULL;
+	memset(t, 0, sizeof(struct mnt_table));
+
+	tab = open_setmntent_r(_PROC_MOUNTS);
+	if (!tab) {
+		free(t);
+		return NULL;
+	}
+
+	while ((mnt = getmntent_r(tab, &mnt_wrk, buf, PATH_MAX * 3))) {
+		if (!mnt_table_add(t, mnt)) {
+			endmntent(tab);
+			mnt_table_free(t);
+			return NULL;
+		}
+	}
+	endmntent(tab);
+
+	/* Index of the entries by mount point, about two per chain */
+	t->size = 64;
+	while (t->size < t->count / 2)
+		t->size <<= 1;
+
+	t->hash = malloc(t->size * sizeof(int));
+	t->next = malloc((t->count ? t->count : 1) * sizeof(int));
+	if (!t->hash || !t->next) {
+		mnt_table_free(t);
+		return NULL;
+	}
+
+	for (i = 0; i < t->size; i++)
+		t->hash[i] = -1;
+
+	/* Add in reverse so chains are in mount table order */
+	for (i = t->count; i > 0; i--) {
+		u_int32_t h = mnt_table_hash(t->ents[i - 1].mnt_dir, t->size);
+
+		t->next[i - 1] = t->hash[h];
+		t->hash[h] = i - 1;
+	}
+
+	t->refs = 1;
+
+	return t;
+}
+
+/*
+ * Check if the mount table has changed since the cached table was
+ * parsed. The change notification is cleared by the poll so it's
+ * remembered until the table is parsed again.
+ */
+/* Called with mnt_table_mutex held and cancellation disabled */
+static int mnt_table_changed(void)
+{
+	struct pollfd pfd;
+
+	if (mnt_table_stale)
+		return 1;
+
+	pfd.fd = mnt_table_fd;
+	pfd.events = POLLPRI;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 0) == -1 || pfd.revents & (POLLPRI|POLLERR))
+		mnt_table_stale = 1;
+
+	return mnt_table_stale;
+}
+
+/* Called with cancellation disabled */
+static struct mnt_table *__mnt_table_get(void)
+{
+	struct mnt_table *t;
+	int changed = 0;
+
+	mnt_table_lock();
+
+	if (mnt_table_fd == -2) {
+		mnt_table_unlock();
+		return NULL;
+	}
+
+	if (mnt_table_fd == -1) {
+		mnt_table_fd = open_fd(_PROC_SELF_MOUNTINFO, O_RDONLY);
+		if (mnt_table_fd == -1) {
+			mnt_table_fd = -2;
+			mnt_table_unlock();
+			return NULL;
+		}
+		changed = 1;
+	} else
+		changed = mnt_table_changed();
+
+	if (!changed && mnt_table) {
+		mnt_table_stats.avoided++;
+		t = mnt_table;
+		t->refs++;
+		mnt_table_unlock();
+		return t;
+	}
+
+	if (mnt_table) {
+		__mnt_table_put(mnt_table);
+		mnt_table = NULL;
+	}
+
+	t = mnt_table_read();
+	if (!t) {
+		mnt_table_unlock();
+		return NULL;
+	}
+	mnt_table_stats.reparses++;
+	mnt_table_stale = 0;
+	t->generation = ++mnt_table_generation;
+	mnt_table = t;
+	t->refs++;
+
+	mnt_table_unlock();
+
+	return t;
+}
+
+/*
+ * Get a reference to the cached proc mount table, updating it if
+ * the mount table has changed. Returns NULL if the table can't be
+ * cached, in which case the caller reads the mount table itself.
+ */
+static struct mnt_table *mnt_table_get(const char *table)
+{
+	struct mnt_table *t;
+	int cur_state;
+
+	if (strcmp(table, _PROC_MOUNTS) && strcmp(table, _PROC_SELF_MOUNTS))
+		return NULL;
+
+	/* poll(2) is a cancellation point and the mutex is held */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+	t = __mnt_table_get();
+	pthread_setcancelstate(cur_state, NULL);
+
+	return t;
+}
+
+void mnt_table_get_stats(struct mnt_table_stats *stats)
+{
+	mnt_table_lock();
+	memcpy(stats, &mnt_table_stats, sizeof(struct mnt_table_stats));
+	mnt_table_unlock();
+}
+
+void mnt_table_log_stats(unsigned int logopt)
+{
+	struct mnt_table_stats stats;
+
+	mnt_table_get_stats(&stats);
+	if (!stats.reparses)
+		return;
+
+	debug(logopt, "mount table: parsed %lu times, %lu parses avoided",
+	      stats.reparses, stats.avoided);
+	debug(logopt, "mount tree: built %lu times, %lu builds avoided",
+	      stats.tree_builds, stats.tree_reused);
+}
+
+/*
+ * Iterate over the entries of a mount table, using the cached
+ * copy of the proc mount table when possible. Entries returned
+ * must not be modified.
+ */
+struct mnt_iter {
+	struct mnt_table *t;
+	unsigned int i;
 	FILE *tab;
-	size_t pathlen = strlen(path);
 	struct mntent mnt_wrk;
 	char buf[PATH_MAX * 3];
+};
+
+static int mnt_iter_open(struct mnt_iter *it, const char *table)
+{
+	it->i = 0;
+	it->tab = NULL;
+	it->t = mnt_table_get(table);
+	if (it->t)
+		return 1;
+
+	it->tab = open_setmntent_r(table);
+	if (!it->tab) {
+		char *estr = strerror_r(errno, it->buf, PATH_MAX - 1);
+		logerr("setmntent: %s", estr);
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct mntent *mnt_iter_next(struct mnt_iter *it)
+{
+	if (it->t) {
+		if (it->i >= it->t->count)
+			return NULL;
+		return &it->t->ents[it->i++];
+	}
+	return getmntent_r(it->tab, &it->mnt_wrk, it->buf, PATH_MAX * 3);
+}
+
+static void mnt_iter_close(struct mnt_iter *it)
+{
+	if (it->t) {
+		mnt_table_put(it->t);
+		it->t = NULL;
+	}
+	if (it->tab) {
+		endmntent(it->tab);
+		it->tab = NULL;
+	}
+}
+
+/*
+ * Get list of mounts under path in longest->shortest order
+ */
+struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
+{
+	struct mnt_iter it;
+	size_t pathlen = strlen(path);
 	struct mntent *mnt;
 	struct mnt_list *ent, *mptr, *last;
 	struct mnt_list *list = NULL;
@@ -801,14 +1214,10 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 	if (!path || !pathlen || pathlen > PATH_MAX)
 		return NULL;
 
-	tab = open_setmntent_r(table);
-	if (!tab) {
-		char *estr = strerror_r(errno, buf, PATH_MAX - 1);
-		logerr("setmntent: %s", estr);
+	if (!mnt_iter_open(&it, table))
 		return NULL;
-	}
 
-	while ((mnt = getmntent_r(tab, &mnt_wrk, buf, PATH_MAX * 3))) {
+	while ((mnt = mnt_iter_next(&it))) {
 		len = strlen(mnt->mnt_dir);
 
 		if ((!include && len <= pathlen) ||
@@ -823,7 +1232,7 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 
 		ent = malloc(sizeof(*ent));
 		if (!ent) {
-			endmntent(tab);
+			mnt_iter_close(&it);
 			free_mnt_list(list);
 			return NULL;
 		}
@@ -847,7 +1256,7 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 
 		ent->path = malloc(len + 1);
 		if (!ent->path) {
-			endmntent(tab);
+			mnt_iter_close(&it);
 			free_mnt_list(list);
 			return NULL;
 		}
@@ -855,7 +1264,7 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 
 		ent->fs_name = malloc(strlen(mnt->mnt_fsname) + 1);
 		if (!ent->fs_name) {
-			endmntent(tab);
+			mnt_iter_close(&it);
 			free_mnt_list(list);
 			return NULL;
 		}
@@ -863,7 +1272,7 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 
 		ent->fs_type = malloc(strlen(mnt->mnt_type) + 1);
 		if (!ent->fs_type) {
-			endmntent(tab);
+			mnt_iter_close(&it);
 			free_mnt_list(list);
 			return NULL;
 		}
@@ -871,7 +1280,7 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 
 		ent->opts = malloc(strlen(mnt->mnt_opts) + 1);
 		if (!ent->opts) {
-			endmntent(tab);
+			mnt_iter_close(&it);
 			free_mnt_list(list);
 			return NULL;
 		}
@@ -879,14 +1288,10 @@ struct mnt_list *get_mnt_list(const char *table, const char *path, int include)
 
 		ent->owner = 0;
 		pgrp = strstr(mnt->mnt_opts, "pgrp=");
-		if (pgrp) {
-			char *end = strchr(pgrp, ',');
-			if (end)
-				*end = '\0';
+		if (pgrp)
 			sscanf(pgrp, "pgrp=%d", &ent->owner);
-		}
 	}
-	endmntent(tab);
+	mnt_iter_close(&it);
 
 	return list;
 }
@@ -986,18 +1391,57 @@ int contained_in_local_fs(const char *path)
 	return ret;
 }
 
+static int mnt_type_matches(struct mntent *mnt, unsigned int type)
+{
+	unsigned int autofs_fs;
+
+	if (!type)
+		return 1;
+
+	autofs_fs = !strcmp(mnt->mnt_type, "autofs");
+
+	if (type & MNTS_REAL)
+		if (autofs_fs)
+			return 0;
+
+	if (type & MNTS_AUTOFS)
+		if (!autofs_fs)
+			return 0;
+
+	return 1;
+}
+
 static int table_is_mounted(const char *table, const char *path, unsigned int type)
 {
 	struct mntent *mnt;
 	struct mntent mnt_wrk;
 	char buf[PATH_MAX * 3];
 	size_t pathlen = strlen(path);
+	struct mnt_table *t;
 	FILE *tab;
 	int ret = 0;
 
 	if (!path || !pathlen || pathlen >= PATH_MAX)
 		return 0;
 
+	t = mnt_table_get(table);
+	if (t) {
+		int i;
+
+		i = t->hash[mnt_table_hash(path, t->size)];
+		for (; i != -1; i = t->next[i]) {
+			mnt = &t->ents[i];
+			if (!strcmp(path, mnt->mnt_dir) &&
+			    mnt_type_matches(mnt, type)) {
+				ret = 1;
+				break;
+			}
+		}
+		mnt_table_put(t);
+
+		return ret;
+	}
+
 	tab = open_setmntent_r(table);
 	if (!tab) {
 		char *estr = strerror_r(errno, buf, PATH_MAX - 1);
@@ -1008,19 +1452,8 @@ static int table_is_mounted(const char *table, const char *path, unsigned int ty
 	while ((mnt = getmntent_r(tab, &mnt_wrk, buf, PATH_MAX * 3))) {
 		size_t len = strlen(mnt->mnt_dir);
 
-		if (type) {
-			unsigned int autofs_fs;
-
-			autofs_fs = !strcmp(mnt->mnt_type, "autofs");
-
-			if (type & MNTS_REAL)
-				if (autofs_fs)
-					continue;
-
-			if (type & MNTS_AUTOFS)
-				if (!autofs_fs)
-					continue;
-		}
+		if (!mnt_type_matches(mnt, type))
+			continue;
 
 		if (pathlen == len && !strncmp(path, mnt->mnt_dir, pathlen)) {
 			ret = 1;
@@ -1149,14 +1582,8 @@ void tree_free_mnt_tree(struct mnt_list *tree)
 	free(tree);
 }
 
-/*
- * Make tree of system mounts in /proc/mounts.
- */
-struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
+static struct mnt_list *mnt_iter_make_tree(struct mnt_iter *it, const char *path)
 {
-	FILE *tab;
-	struct mntent mnt_wrk;
-	char buf[PATH_MAX * 3];
 	struct mntent *mnt;
 	struct mnt_list *ent, *mptr;
 	struct mnt_list *tree = NULL;
@@ -1164,16 +1591,9 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 	size_t plen;
 	int eq;
 
-	tab = open_setmntent_r(table);
-	if (!tab) {
-		char *estr = strerror_r(errno, buf, PATH_MAX - 1);
-		logerr("setmntent: %s", estr);
-		return NULL;
-	}
-
 	plen = strlen(path);
 
-	while ((mnt = getmntent_r(tab, &mnt_wrk, buf, PATH_MAX * 3))) {
+	while ((mnt = mnt_iter_next(it))) {
 		size_t len = strlen(mnt->mnt_dir);
 
 		/* Not matching path */
@@ -1186,7 +1606,6 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 
 		ent = malloc(sizeof(*ent));
 		if (!ent) {
-			endmntent(tab);
 			tree_free_mnt_tree(tree);
 			return NULL;
 		}
@@ -1199,7 +1618,6 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 
 		ent->path = malloc(len + 1);
 		if (!ent->path) {
-			endmntent(tab);
 			free(ent);
 			tree_free_mnt_tree(tree);
 			return NULL;
@@ -1210,7 +1628,6 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 		if (!ent->fs_name) {
 			free(ent->path);
 			free(ent);
-			endmntent(tab);
 			tree_free_mnt_tree(tree);
 			return NULL;
 		}
@@ -1221,7 +1638,6 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 			free(ent->fs_name);
 			free(ent->path);
 			free(ent);
-			endmntent(tab);
 			tree_free_mnt_tree(tree);
 			return NULL;
 		}
@@ -1233,7 +1649,6 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 			free(ent->fs_name);
 			free(ent->path);
 			free(ent);
-			endmntent(tab);
 			tree_free_mnt_tree(tree);
 			return NULL;
 		}
@@ -1241,12 +1656,8 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 
 		ent->owner = 0;
 		pgrp = strstr(mnt->mnt_opts, "pgrp=");
-		if (pgrp) {
-			char *end = strchr(pgrp, ',');
-			if (end)
-				*end = '\0';
+		if (pgrp)
 			sscanf(pgrp, "pgrp=%d", &ent->owner);
-		}
 
 		mptr = tree;
 		while (mptr) {
@@ -1295,11 +1706,288 @@ struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
 		if (!tree)
 			tree = ent;
 	}
-	endmntent(tab);
+	return tree;
+}
+
+/*
+ * Make tree of system mounts in /proc/mounts.
+ */
+struct mnt_list *tree_make_mnt_tree(const char *table, const char *path)
+{
+	struct mnt_list *tree;
+	struct mnt_iter it;
+
+	if (!mnt_iter_open(&it, table))
+		return NULL;
+
+	tree = mnt_iter_make_tree(&it, path);
+	mnt_iter_close(&it);
 
 	return tree;
 }
 
+/*
+ * A tree of the whole proc mount table shared by the threads that
+ * use it until the mount table changes, so expire and map re-read
+ * runs of many direct mounts don't each build their own tree.
+ */
+static pthread_mutex_t mnt_snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct mnt_snapshot *mnt_snapshot = NULL;
+
+static void mnt_snapshot_lock(void)
+{
+	int status = pthread_mutex_lock(&mnt_snapshot_mutex);
+	if (status)
+		fatal(status);
+}
+
+static void mnt_snapshot_unlock(void)
+{
+	int status = pthread_mutex_unlock(&mnt_snapshot_mutex);
+	if (status)
+		fatal(status);
+}
+
+/* Called with mnt_snapshot_mutex held */
+static void __mnt_snapshot_put(struct mnt_snapshot *snap)
+{
+	if (--snap->refs)
+		return;
+	if (snap->index)
+		free(snap->index);
+	tree_free_mnt_tree(snap->tree);
+	free(snap);
+}
+
+void mnt_snapshot_put(struct mnt_snapshot *snap)
+{
+	if (!snap)
+		return;
+	mnt_snapshot_lock();
+	__mnt_snapshot_put(snap);
+	mnt_snapshot_unlock();
+}
+
+/*
+ * Get a reference to a snapshot of the mounts in the proc mount
+ * table, making a new one if the mount table has changed since the
+ * current one was made. If the mount table can't be cached the
+ * snapshot is made for the caller alone.
+ */
+/*
+ * Compare mount paths with '/' ordered before any other character
+ * so the mounts below a path directly follow it in the index.
+ */
+static int mnt_path_cmp(const char *p1, const char *p2)
+{
+	const unsigned char *s1 = (const unsigned char *) p1;
+	const unsigned char *s2 = (const unsigned char *) p2;
+
+	for (;; s1++, s2++) {
+		unsigned int c1 = *s1 == '/' ? 1 : *s1;
+		unsigned int c2 = *s2 == '/' ? 1 : *s2;
+
+		if (c1 != c2 || !c1)
+			return c1 < c2 ? -1 : c1 > c2;
+	}
+}
+
+static int mnt_index_cmp(const void *a, const void *b)
+{
+	const struct mnt_list *m1 = *(struct mnt_list * const *) a;
+	const struct mnt_list *m2 = *(struct mnt_list * const *) b;
+
+	return mnt_path_cmp(m1->path, m2->path);
+}
+
+/* Called with cancellation disabled */
+static struct mnt_snapshot *__mnt_snapshot_get(void)
+{
+	struct mnt_snapshot *snap;
+	unsigned long generation;
+	struct mnt_iter it;
+
+	snap = malloc(sizeof(struct mnt_snapshot));
+	if (!snap)
+		return NULL;
+	memset(snap, 0, sizeof(struct mnt_snapshot));
+	snap->refs = 1;
+
+	/* Only one thread makes the tree, the others wait and share it */
+	mnt_snapshot_lock();
+
+	if (!mnt_iter_open(&it, _PROC_MOUNTS)) {
+		mnt_snapshot_unlock();
+		return snap;
+	}
+
+	generation = it.t ? it.t->generation : 0;
+	if (generation && mnt_snapshot &&
+	    mnt_snapshot->generation == generation) {
+		mnt_iter_close(&it);
+		mnt_snapshot->refs++;
+		mnt_snapshot_unlock();
+		free(snap);
+		mnt_table_lock();
+		mnt_table_stats.tree_reused++;
+		mnt_table_unlock();
+		return mnt_snapshot;
+	}
+
+	snap->tree = mnt_iter_make_tree(&it, "/");
+	mnt_iter_close(&it);
+
+	mnt_table_lock();
+	mnt_table_stats.tree_builds++;
+	mnt_table_unlock();
+
+	if (generation && snap->tree) {
+		if (mnt_snapshot)
+			__mnt_snapshot_put(mnt_snapshot);
+		snap->generation = generation;
+		snap->refs++;
+		mnt_snapshot = snap;
+	}
+
+	mnt_snapshot_unlock();
+
+	return snap;
+}
+
+/*
+ * Get a reference to a snapshot of the mounts in the proc mount
+ * table, making a new one if the mount table has changed since the
+ * current one was made. If the mount table can't be cached the
+ * snapshot is made for the caller alone.
+ */
+struct mnt_snapshot *mnt_snapshot_get(void)
+{
+	struct mnt_snapshot *snap;
+	int cur_state;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+	snap = __mnt_snapshot_get();
+	pthread_setcancelstate(cur_state, NULL);
+
+	return snap;
+}
+
+/* Called with cancellation disabled */
+static unsigned long mnt_table_current_generation(void)
+{
+	unsigned long generation = 0;
+
+	mnt_table_lock();
+	if (mnt_table_fd >= 0 && mnt_table && !mnt_table_changed())
+		generation = mnt_table->generation;
+	mnt_table_unlock();
+
+	return generation;
+}
+
+/*
+ * Get a reference to the shared snapshot only if the mount table
+ * hasn't changed since it was made. A snapshot is never made here
+ * so callers that run just after a mount or umount don't pay for
+ * building one. Returns NULL if there's no current snapshot.
+ */
+struct mnt_snapshot *mnt_snapshot_get_current(void)
+{
+	struct mnt_snapshot *snap = NULL;
+	unsigned long generation;
+	int cur_state;
+
+	/* poll(2) is a cancellation point and the mutex is held */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+	generation = mnt_table_current_generation();
+	pthread_setcancelstate(cur_state, NULL);
+
+	if (!generation)
+		return NULL;
+
+	mnt_snapshot_lock();
+	if (mnt_snapshot && mnt_snapshot->generation == generation) {
+		snap = mnt_snapshot;
+		snap->refs++;
+	}
+	mnt_snapshot_unlock();
+
+	return snap;
+}
+
+/*
+ * Count the mounts below path that aren't themselves below another
+ * of the mounts counted, which are the mounts a walk of the directory
+ * tree under path would find. Mounts on path itself aren't counted.
+ * The index of the mounts by path is made the first time it's
+ * needed. Returns -1 if the index can't be made.
+ */
+int mnt_snapshot_count_mounts(struct mnt_snapshot *snap, const char *path)
+{
+	char prefix[PATH_MAX + 1];
+	const char *last = NULL;
+	unsigned int low, high;
+	size_t plen, llen = 0;
+	int count = 0;
+
+	mnt_snapshot_lock();
+	if (!snap->index && snap->tree) {
+		count = tree_get_mnt_array(snap->tree, "/", 1, &snap->index);
+		if (count > 0) {
+			qsort(snap->index, count,
+			      sizeof(struct mnt_list *), mnt_index_cmp);
+			snap->count = count;
+		}
+		count = 0;
+	}
+	mnt_snapshot_unlock();
+
+	if (!snap->index)
+		return -1;
+
+	plen = strlen(path);
+	if (plen >= PATH_MAX)
+		return -1;
+	strcpy(prefix, path);
+	if (!plen || prefix[plen - 1] != '/')
+		prefix[plen++] = '/';
+	prefix[plen] = '\0';
+
+	/* First mount in the index at or after the prefix */
+	low = 0;
+	high = snap->count;
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+
+		if (mnt_path_cmp(snap->index[mid]->path, prefix) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	for (; low < snap->count; low++) {
+		const char *mp = snap->index[low]->path;
+
+		if (strncmp(mp, prefix, plen))
+			break;
+
+		/* Mounted on path itself, when path is "/" */
+		if (mp[plen] == '\0')
+			continue;
+
+		/* Another mount on, or a mount below, the last one counted */
+		if (last && !strncmp(mp, last, llen) &&
+		    (mp[llen] == '\0' || mp[llen] == '/'))
+			continue;
+
+		last = mp;
+		llen = strlen(mp);
+		count++;
+	}
+
+	return count;
+}
+
 /*
  * Get list of mounts under "path" in longest->shortest order
  */
@@ -1347,6 +2035,104 @@ skip:
 	return 1;
 }
 
+struct mnt_array {
+	struct mnt_list **mnts;
+	int count;
+	int size;
+};
+
+static int mnt_array_add(struct mnt_array *ma, struct mnt_list *mnt)
+{
+	if (ma->count == ma->size) {
+		int size = ma->size ? ma->size * 2 : 64;
+		struct mnt_list **mnts;
+
+		mnts = realloc(ma->mnts, size * sizeof(struct mnt_list *));
+		if (!mnts)
+			return 0;
+		ma->mnts = mnts;
+		ma->size = size;
+	}
+	ma->mnts[ma->count++] = mnt;
+
+	return 1;
+}
+
+static int tree_fill_mnt_array(struct mnt_list *mnts, struct mnt_array *ma,
+			       const char *path, size_t plen, int include)
+{
+	size_t mlen;
+
+	if (!mnts)
+		return 1;
+
+	mlen = strlen(mnts->path);
+	if (mlen < plen)
+		return tree_fill_mnt_array(mnts->right, ma, path, plen, include);
+	else {
+		struct list_head *self, *p;
+
+		if (!tree_fill_mnt_array(mnts->left, ma, path, plen, include))
+			return 0;
+
+		if ((!include && mlen <= plen) ||
+				strncmp(mnts->path, path, plen))
+			goto skip;
+
+		if (plen > 1 && mlen > plen && mnts->path[plen] != '/')
+			goto skip;
+
+		if (!mnt_array_add(ma, mnts))
+			return 0;
+
+		self = &mnts->self;
+		list_for_each(p, self) {
+			struct mnt_list *this;
+
+			this = list_entry(p, struct mnt_list, self);
+			if (!mnt_array_add(ma, this))
+				return 0;
+		}
+skip:
+		return tree_fill_mnt_array(mnts->right, ma, path, plen, include);
+	}
+}
+
+/*
+ * Get an array of the mounts under "path" in longest->shortest
+ * order, the same mounts as tree_get_mnt_list(). The tree isn't
+ * changed so this can be used on a shared mount snapshot. Returns
+ * the number of mounts, the array must be freed by the caller, or
+ * -1 on failure.
+ */
+int tree_get_mnt_array(struct mnt_list *mnts, const char *path,
+		       int include, struct mnt_list ***array)
+{
+	struct mnt_array ma;
+	int i;
+
+	*array = NULL;
+
+	memset(&ma, 0, sizeof(struct mnt_array));
+	if (!tree_fill_mnt_array(mnts, &ma, path, strlen(path), include)) {
+		if (ma.mnts)
+			free(ma.mnts);
+		return -1;
+	}
+
+	/* Collected shortest first, the reverse of the order wanted */
+	for (i = 0; i < ma.count / 2; i++) {
+		struct mnt_list *tmp = ma.mnts[i];
+
+		ma.mnts[i] = ma.mnts[ma.count - i - 1];
+		ma.mnts[ma.count - i - 1] = tmp;
+	}
+
+	*array = ma.mnts;
+
+	return ma.count;
+}
+
 /*
  * Get list of mounts under "path" in longest->shortest order
  */
@@ -1409,55 +2195,86 @@ int tree_find_mnt_ents(struct mnt_list *mnts, struct list_head *list, const char
 		return tree_find_mnt_ents(mnts->left, list, path);
 	else {
 		struct list_head *self, *p;
+		int eq;
 
-		tree_find_mnt_ents(mnts->left, list, path);
+		/*
+		 * Paths of the same length are ordered by strcmp() and
+		 * mounts of the same path are on the self list so only
+		 * one branch needs to be searched.
+		 */
+		eq = strcmp(path, mnts->path);
+		if (eq < 0)
+			return tree_find_mnt_ents(mnts->left, list, path);
+		else if (eq > 0)
+			return tree_find_mnt_ents(mnts->right, list, path);
 
-		if (!strcmp(mnts->path, path)) {
-			INIT_LIST_HEAD(&mnts->entries);
-			list_add(&mnts->entries, list);
-		}
+		INIT_LIST_HEAD(&mnts->entries);
+		list_add(&mnts->entries, list);
 
 		self = &mnts->self;
 		list_for_each(p, self) {
 			struct mnt_list *this;
 
 			this = list_entry(p, struct mnt_list, self);
-
-			if (!strcmp(this->path, path)) {
-				INIT_LIST_HEAD(&this->entries);
-				list_add(&this->entries, list);
-			}
+			INIT_LIST_HEAD(&this->entries);
+			list_add(&this->entries, list);
 		}
 
-		tree_find_mnt_ents(mnts->right, list, path);
-
-		if (!list_empty(list))
-			return 1;
+		return 1;
 	}
 
 	return 0;
 }
 
+/* Find the tree node of path without changing the tree */
+static struct mnt_list *tree_find_mnt(struct mnt_list *mnts, const char *path)
+{
+	size_t plen = strlen(path);
+
+	while (mnts) {
+		size_t mlen = strlen(mnts->path);
+		int eq;
+
+		if (mlen < plen)
+			mnts = mnts->right;
+		else if (mlen > plen)
+			mnts = mnts->left;
+		else {
+			eq = strcmp(path, mnts->path);
+			if (eq < 0)
+				mnts = mnts->left;
+			else if (eq > 0)
+				mnts = mnts->right;
+			else
+				break;
+		}
+	}
+
+	return mnts;
+}
+
+/*
+ * Check if path is mounted. The tree isn't changed so this can be
+ * used on a shared mount snapshot.
+ */
 int tree_is_mounted(struct mnt_list *mnts, const char *path, unsigned int type)
 {
 	struct ioctl_ops *ops = get_ioctl_ops();
+	struct mnt_list *this, *mptr;
 	struct list_head *p;
-	struct list_head list;
 	int mounted = 0;
 
 	if (ops->ismountpoint)
 		return ioctl_is_mounted(_PROC_MOUNTS, path, type);
 
-	INIT_LIST_HEAD(&list);
-
-	if (!tree_find_mnt_ents(mnts, &list, path))
+	this = tree_find_mnt(mnts, path);
+	if (!this)
 		return 0;
 
-	list_for_each(p, &list) {
-		struct mnt_list *mptr;
-
-		mptr = list_entry(p, struct mnt_list, entries);
-
+	/* The node itself then the other mounts on the same path */
+	mptr = this;
+	p = &this->self;
+	do {
 		if (type) {
 			unsigned int autofs_fs;
 
@@ -1478,10 +2295,36 @@ int tree_is_mounted(struct mnt_list *mnts, const char *path, unsigned int type)
 				break;
 			}
 		}
-	}
+		p = p->next;
+		mptr = list_entry(p, struct mnt_list, self);
+	} while (p != &this->self);
 	return mounted;
 }
 
+/*
+ * Check if path is mounted using the shared mount snapshot, which
+ * is got on first use and must be put by the caller. Callers that
+ * check many paths can use this instead of is_mounted() to avoid
+ * reading the mount table for each check when the kernel can't
+ * tell us directly.
+ */
+int tree_snapshot_is_mounted(struct mnt_snapshot **snap,
+			     const char *path, unsigned int type)
+{
+	struct ioctl_ops *ops = get_ioctl_ops();
+
+	if (ops->ismountpoint)
+		return ioctl_is_mounted(_PROC_MOUNTS, path, type);
+
+	if (!*snap)
+		*snap = mnt_snapshot_get();
+
+	if (!*snap || !(*snap)->tree)
+		return table_is_mounted(_PROC_MOUNTS, path, type);
+
+	return tree_is_mounted((*snap)->tree, path, type);
+}
+
 void set_tsd_user_vars(unsigned int logopt, uid_t uid, gid_t gid)
 {
 	struct thread_stdenv_vars *tsv;
@@ -1607,6 +2450,25 @@ free_tsv:
 	return;
 }
 
+void clear_tsd_user_vars(void)
+{
+	struct thread_stdenv_vars *tsv;
+
+	tsv = pthread_getspecific(key_thread_stdenv_vars);
+	if (!tsv)
+		return;
+
+	pthread_setspecific(key_thread_stdenv_vars, NULL);
+
+	if (tsv->user)
+		free(tsv->user);
+	if (tsv->group)
+		free(tsv->group);
+	if (tsv->home)
+		free(tsv->home);
+	free(tsv);
+}
+
 const char *mount_type_str(const unsigned int type)
 {
 	static const char *str_type[] = {
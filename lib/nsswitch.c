@@ -23,9 +23,32 @@
 #include <string.h>
 #include <memory.h>
 #include <limits.h>
+#include <sys/stat.h>
 #include "automount.h"
 #include "nsswitch.h"
 
+/*
+ * The parsed nsswitch configuration is shared by all lookups and
+ * is only parsed again when the nsswitch configuration file has
+ * changed.
+ */
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct nss_config *config = NULL;
+
+static void config_mutex_lock(void)
+{
+	int status = pthread_mutex_lock(&config_mutex);
+	if (status)
+		fatal(status);
+}
+
+static void config_mutex_unlock(void)
+{
+	int status = pthread_mutex_unlock(&config_mutex);
+	if (status)
+		fatal(status);
+}
+
 int set_action(struct nss_action *act, char *status, char *action, int negated)
 {
 	enum nsswitch_action a;
@@ -150,6 +173,103 @@ int free_sources(struct list_head *list)
 	return 1;
 }
 
+/* Called with config_mutex held */
+static void __nsswitch_put_config(struct nss_config *conf)
+{
+	if (--conf->refs)
+		return;
+	free_sources(&conf->sources);
+	free(conf);
+}
+
+static int config_changed(struct nss_config *conf, struct stat *st)
+{
+	return conf->dev != st->st_dev ||
+	       conf->ino != st->st_ino ||
+	       conf->size != st->st_size ||
+	       conf->mtime.tv_sec != st->st_mtim.tv_sec ||
+	       conf->mtime.tv_nsec != st->st_mtim.tv_nsec;
+}
+
+/* Called with cancellation disabled */
+static struct nss_config *__nsswitch_get_config(void)
+{
+	struct nss_config *conf;
+	struct stat st;
+	int status;
+
+	config_mutex_lock();
+
+	status = stat(NSSWITCH_FILE, &st);
+	if (!status && config && !config_changed(config, &st)) {
+		conf = config;
+		conf->refs++;
+		config_mutex_unlock();
+		return conf;
+	}
+
+	if (config) {
+		__nsswitch_put_config(config);
+		config = NULL;
+	}
+
+	conf = malloc(sizeof(struct nss_config));
+	if (!conf) {
+		config_mutex_unlock();
+		return NULL;
+	}
+	memset(conf, 0, sizeof(struct nss_config));
+	INIT_LIST_HEAD(&conf->sources);
+
+	if (nsswitch_parse(&conf->sources)) {
+		free_sources(&conf->sources);
+		free(conf);
+		config_mutex_unlock();
+		return NULL;
+	}
+
+	/* Not kept if we couldn't tell when it changes */
+	conf->refs = 1;
+	if (!status) {
+		conf->dev = st.st_dev;
+		conf->ino = st.st_ino;
+		conf->size = st.st_size;
+		conf->mtime = st.st_mtim;
+		conf->refs++;
+		config = conf;
+	}
+
+	config_mutex_unlock();
+
+	return conf;
+}
+
+/*
+ * Get a reference to the parsed nsswitch configuration, parsing
+ * the configuration file if it has changed since it was last
+ * parsed. The sources list must not be modified and the reference
+ * must be released with nsswitch_put_config().
+ */
+struct nss_config *nsswitch_get_config(void)
+{
+	struct nss_config *conf;
+	int cur_state;
+
+	/* The parse has cancellation points and the mutex is held */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+	conf = __nsswitch_get_config();
+	pthread_setcancelstate(cur_state, NULL);
+
+	return conf;
+}
+
+void nsswitch_put_config(struct nss_config *conf)
+{
+	config_mutex_lock();
+	__nsswitch_put_config(conf);
+	config_mutex_unlock();
+}
+
 /*
 int main(void)
 {
@@ -17,6 +17,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -135,26 +136,28 @@ void sel_hash_init(void)
 	for (i = 0; i < SELECTOR_HASH_SIZE; i++)
 		sel_hash[i] = NULL;
 
-	for (i = 0; i < sel_count; i++)
+	for (i = 0; i < sel_count; i++) {
+		sel_table[i].index = ffs(sel_table[i].selector) - 1;
 		sel_add(&sel_table[i]);
+	}
 
 	sel_hash_init_done = 1;
 	pthread_mutex_unlock(&sel_hash_mutex);
 }
 
+/*
+ * The selector hash doesn't change once it has been initialized
+ * so it can be searched without holding the mutex.
+ */
 struct sel *sel_lookup(const char *name)
 {
 	u_int32_t hval = hash(name, SELECTOR_HASH_SIZE);
 	struct sel *sel;
 
-	pthread_mutex_lock(&sel_hash_mutex);
 	for (sel = sel_hash[hval]; sel != NULL; sel = sel->next) {
-		if (strcmp(name, sel->name) == 0) {
-			pthread_mutex_unlock(&sel_hash_mutex);
+		if (strcmp(name, sel->name) == 0)
 			return sel;
-		}
 	}
-	pthread_mutex_unlock(&sel_hash_mutex);
 	return NULL;
 }
 
@@ -1103,7 +1103,31 @@ int rpc_time(const char *host,
 	return status;
 }
 
-static int rpc_get_exports_proto(struct conn_info *info, exports *exp)
+/*
+ * Limit the RPC timeout to the time left before the deadline, if
+ * there is one. Returns 0 if the deadline has passed.
+ */
+static int rpc_timeout_left(struct conn_info *info, time_t deadline)
+{
+	time_t left;
+
+	if (!deadline)
+		return 1;
+
+	left = deadline - monotonic_time(NULL);
+	if (left <= 0)
+		return 0;
+
+	if (left < info->timeout.tv_sec) {
+		info->timeout.tv_sec = left;
+		info->timeout.tv_usec = 0;
+	}
+
+	return 1;
+}
+
+static int rpc_get_exports_proto(struct conn_info *info,
+				 exports *exp, time_t deadline)
 {
 	CLIENT *client;
 	enum clnt_stat status;
@@ -1132,6 +1156,12 @@ static int rpc_get_exports_proto(struct conn_info *info, exports *exp)
 
 	vers_entry = 0;
 	while (1) {
+		if (!rpc_timeout_left(info, deadline)) {
+			status = RPC_TIMEDOUT;
+			break;
+		}
+		clnt_control(client, CLSET_TIMEOUT, (char *) &info->timeout);
+
 		status = clnt_call(client, MOUNTPROC_EXPORT,
 				 (xdrproc_t) xdr_void, NULL,
 				 (xdrproc_t) xdr_exports, (caddr_t) exp,
@@ -1205,8 +1235,13 @@ exports rpc_get_exports(const char *host, long seconds, long micros, unsigned in
 	struct conn_info info;
 	exports exportlist;
 	struct pmap parms;
+	time_t deadline = 0;
 	int status;
 
+	/* The whole fetch, not each RPC, is limited to the timeout */
+	if (seconds > 0)
+		deadline = monotonic_time(NULL) + seconds;
+
 	info.host = host;
 	info.addr = NULL;
 	info.addr_len = 0;
@@ -1232,13 +1267,19 @@ exports rpc_get_exports(const char *host, long seconds, long micros, unsigned in
 	if (status < 0)
 		goto try_tcp;
 
+	if (!rpc_timeout_left(&info, deadline))
+		return NULL;
+
 	memset(&exportlist, '\0', sizeof(exportlist));
 
-	status = rpc_get_exports_proto(&info, &exportlist);
+	status = rpc_get_exports_proto(&info, &exportlist, deadline);
 	if (status)
 		return exportlist;
 
 try_tcp:
+	if (!rpc_timeout_left(&info, deadline))
+		return NULL;
+
 	info.proto = IPPROTO_TCP;
 
 	parms.pm_prot = info.proto;
@@ -1247,9 +1288,12 @@ try_tcp:
 	if (status < 0)
 		return NULL;
 
+	if (!rpc_timeout_left(&info, deadline))
+		return NULL;
+
 	memset(&exportlist, '\0', sizeof(exportlist));
 
-	status = rpc_get_exports_proto(&info, &exportlist);
+	status = rpc_get_exports_proto(&info, &exportlist, deadline);
 	if (!status)
 		return NULL;
 
@@ -553,11 +553,11 @@ static void add_selector(struct selector *selector)
 		return;
 	}
 
+	/* Selectors are evaluated in the order they're given */
 	while (s->next)
 		s = s->next;
 
-	selector->next = s;
-	entry.selector = selector;
+	s->next = selector;
 
 	return;
 }
@@ -581,11 +581,14 @@ static int make_selector(char *name,
 		if (!tmp)
 			goto error;
 		s->comp.value = tmp;
+		/* Numeric comparison values needn't be converted each time */
+		if (s->sel->flags & SEL_FLAG_NUM)
+			s->comp.num = atoi(tmp);
 	} else if (s->sel->flags & SEL_FLAG_FUNC1) {
 		if (!value1)
 			tmp = NULL;
 		else {
-			char *tmp = amd_strdup(value1);
+			tmp = amd_strdup(value1);
 			if (!tmp)
 				goto error;
 		}
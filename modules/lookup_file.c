@@ -41,15 +41,97 @@ typedef enum {
 typedef enum { got_nothing, got_star, got_real, got_plus } FOUND_STATE;
 typedef enum { esc_none, esc_char, esc_val, esc_all } ESCAPES;
 
+/*
+ * Index of the keys of a map file. It is rebuilt whenever the map
+ * file changes and allows a key lookup to parse only the map entry
+ * at the indexed offset.
+ */
+struct index_entry {
+	char *key;
+	off_t offset;
+	struct index_entry *next;
+};
+
+struct map_index {
+	pthread_mutex_t mutex;
+	dev_t dev;			/* Identity of the indexed file */
+	ino_t ino;
+	struct timespec mtime;
+	off_t len;
+	unsigned int valid;		/* Index matches the file */
+	unsigned int plus;		/* Map has plus included maps */
+	off_t wild;			/* Offset of wildcard entry or -1 */
+	unsigned int size;		/* Number of hash slots */
+	struct index_entry **hash;
+};
+
 struct lookup_context {
 	const char *mapname;
 	int opts_argc;
 	const char **opts_argv;
 	struct parse_mod *parse;
+	struct map_index *index;
 };
 
 int lookup_version = AUTOFS_LOOKUP_VERSION;	/* Required by protocol */
 
+static void map_index_clear(struct map_index *mi)
+{
+	struct index_entry *ie, *next;
+	unsigned int i;
+
+	if (mi->hash) {
+		for (i = 0; i < mi->size; i++) {
+			ie = mi->hash[i];
+			while (ie) {
+				next = ie->next;
+				free(ie->key);
+				free(ie);
+				ie = next;
+			}
+		}
+		free(mi->hash);
+		mi->hash = NULL;
+	}
+	mi->size = 0;
+	mi->len = 0;
+
+	mi->plus = 0;
+	mi->wild = -1;
+	mi->valid = 0;
+}
+
+static struct map_index *map_index_alloc(void)
+{
+	struct map_index *mi;
+	int status;
+
+	mi = malloc(sizeof(struct map_index));
+	if (!mi)
+		return NULL;
+	memset(mi, 0, sizeof(struct map_index));
+	mi->wild = -1;
+
+	status = pthread_mutex_init(&mi->mutex, NULL);
+	if (status)
+		fatal(status);
+
+	return mi;
+}
+
+static void map_index_free(struct map_index *mi)
+{
+	int status;
+
+	map_index_clear(mi);
+
+	status = pthread_mutex_destroy(&mi->mutex);
+	if (status)
+		fatal(status);
+
+	free(mi);
+}
+
 static int do_init(const char *mapfmt,
 		   int argc, const char *const *argv,
 		   struct lookup_context *ctxt, unsigned int reinit)
@@ -100,8 +182,18 @@ static int do_init(const char *mapfmt,
 		}
 	}
 
-	if (ret)
+	if (ret) {
 		free_argv(ctxt->opts_argc, ctxt->opts_argv);
+		return ret;
+	}
+
+	if (defaults_get_file_map_index()) {
+		ctxt->index = map_index_alloc();
+		if (!ctxt->index)
+			warn(LOGOPT_NONE, MODPREFIX
+			     "failed to allocate index for map %s, "
+			     "map will not be indexed", ctxt->mapname);
+	}
 
 	return ret;
 }
@@ -158,6 +250,8 @@ int lookup_reinit(const char *mapfmt,
 
 	*context = new;
 
+	if (ctxt->index)
+		map_index_free(ctxt->index);
 	free_argv(ctxt->opts_argc, ctxt->opts_argv);
 	free(ctxt);
 
@@ -397,6 +491,252 @@ static int read_one(unsigned logopt, FILE *f, char *key, unsigned int *k_len, ch
 	return 0;
 }
 
+static void map_index_lock(struct map_index *mi)
+{
+	int status = pthread_mutex_lock(&mi->mutex);
+	if (status)
+		fatal(status);
+}
+
+static void map_index_unlock(struct map_index *mi)
+{
+	int status = pthread_mutex_unlock(&mi->mutex);
+	if (status)
+		fatal(status);
+}
+
+/* Index must be locked by caller */
+static int map_index_add(struct map_index *mi, const char *key, off_t offset)
+{
+	u_int32_t hashval = hash(key, mi->size);
+	struct index_entry *ie;
+
+	/* A lookup always uses the first occurrence of a key */
+	for (ie = mi->hash[hashval]; ie != NULL; ie = ie->next) {
+		if (!strcmp(ie->key, key))
+			return 1;
+	}
+
+	ie = malloc(sizeof(struct index_entry));
+	if (!ie)
+		return 0;
+
+	ie->key = strdup(key);
+	if (!ie->key) {
+		free(ie);
+		return 0;
+	}
+	ie->offset = offset;
+
+	ie->next = mi->hash[hashval];
+	mi->hash[hashval] = ie;
+
+	return 1;
+}
+
+/* Index must be locked by caller */
+static int map_index_build(struct autofs_point *ap, struct map_index *mi,
+			   FILE *f, struct stat *st, struct lookup_context *ctxt)
+{
+	char mkey[KEY_MAX_LEN + 1];
+	char mapent[MAPENT_MAX_LEN + 1];
+	char buf[MAX_ERR_BUF];
+	unsigned int k_len, m_len;
+	unsigned int lines;
+	off_t offset;
+	size_t len;
+	int entry;
+
+	mi->dev = st->st_dev;
+	mi->ino = st->st_ino;
+	mi->mtime = st->st_mtim;
+	mi->len = st->st_size;
+
+	/* Size the index using the line count as an upper bound */
+	lines = 1;
+	while ((len = fread(buf, 1, MAX_ERR_BUF, f))) {
+		char *p = buf, *end = buf + len;
+
+		while ((p = memchr(p, '\n', end - p))) {
+			lines++;
+			p++;
+		}
+	}
+	if (ferror(f)) {
+		warn(ap->logopt,
+		     MODPREFIX "error reading map %s", ctxt->mapname);
+		return 0;
+	}
+	rewind(f);
+
+	mi->size = lines;
+	mi->hash = malloc(mi->size * sizeof(struct index_entry *));
+	if (!mi->hash) {
+		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+		error(ap->logopt, MODPREFIX "malloc: %s", estr);
+		return 0;
+	}
+	memset(mi->hash, 0, mi->size * sizeof(struct index_entry *));
+
+	while (1) {
+		char *s_key;
+
+		offset = ftello(f);
+
+		entry = read_one(ap->logopt, f, mkey, &k_len, mapent, &m_len);
+		if (!entry) {
+			if (feof(f))
+				break;
+			if (ferror(f)) {
+				warn(ap->logopt, MODPREFIX
+				      "error reading map %s", ctxt->mapname);
+				return 0;
+			}
+			continue;
+		}
+
+		/*
+		 * Plus included maps must be searched in map order
+		 * so the index can't be used for this map.
+		 */
+		if (*mkey == '+') {
+			mi->plus = 1;
+			break;
+		}
+
+		if (*mkey == '*' && k_len == 1 && mi->wild == -1)
+			mi->wild = offset;
+
+		s_key = sanitize_path(mkey, k_len, ap->type, ap->logopt);
+		if (s_key) {
+			if (!map_index_add(mi, s_key, offset)) {
+				char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+				error(ap->logopt, MODPREFIX "malloc: %s", estr);
+				free(s_key);
+				return 0;
+			}
+			free(s_key);
+		}
+
+		if (feof(f))
+			break;
+	}
+
+	mi->valid = 1;
+
+	return 1;
+}
+
+/*
+ * Get the map entry for key, or the wildcard entry if key is NULL,
+ * from the map index, rebuilding the index first if the map file
+ * has changed. Returns 1 if the entry is found, 0 if it isn't and
+ * -1 if the index can't be used so the map must be read through.
+ *
+ * The map file is read rather than mapped since it may be edited
+ * in place at any time. If it changes after it's checked the key
+ * read at the indexed offset won't match and the map is read
+ * through instead.
+ */
+static int map_index_lookup(struct autofs_point *ap,
+			    struct lookup_context *ctxt, const char *key,
+			    char *mkey, unsigned int *k_len,
+			    char *mapent, unsigned int *m_len)
+{
+	struct map_index *mi = ctxt->index;
+	struct index_entry *ie;
+	struct stat st;
+	off_t offset;
+	FILE *f;
+	int ret;
+
+	f = open_fopen_r(ctxt->mapname);
+	if (!f)
+		return -1;
+
+	if (fstat(fileno(f), &st)) {
+		fclose(f);
+		return -1;
+	}
+
+	map_index_lock(mi);
+
+	if (!mi->valid ||
+	    mi->dev != st.st_dev || mi->ino != st.st_ino ||
+	    mi->mtime.tv_sec != st.st_mtim.tv_sec ||
+	    mi->mtime.tv_nsec != st.st_mtim.tv_nsec ||
+	    mi->len != st.st_size) {
+		debug(ap->logopt,
+		      MODPREFIX "building index for map %s", ctxt->mapname);
+		map_index_clear(mi);
+		if (!map_index_build(ap, mi, f, &st, ctxt)) {
+			map_index_clear(mi);
+			map_index_unlock(mi);
+			fclose(f);
+			return -1;
+		}
+	}
+
+	if (mi->plus) {
+		map_index_unlock(mi);
+		fclose(f);
+		return -1;
+	}
+
+	offset = -1;
+	if (!key)
+		offset = mi->wild;
+	else {
+		ie = mi->hash[hash(key, mi->size)];
+		while (ie) {
+			if (!strcmp(ie->key, key)) {
+				offset = ie->offset;
+				break;
+			}
+			ie = ie->next;
+		}
+	}
+
+	map_index_unlock(mi);
+
+	if (offset == -1) {
+		fclose(f);
+		return 0;
+	}
+
+	ret = -1;
+	if (fseeko(f, offset, SEEK_SET) ||
+	    !read_one(ap->logopt, f, mkey, k_len, mapent, m_len))
+		goto done;
+
+	/* Check the entry read is still the one indexed */
+	if (!key) {
+		if (*mkey == '*' && *k_len == 1)
+			ret = 1;
+	} else {
+		char *s_key;
+
+		s_key = sanitize_path(mkey, *k_len, ap->type, ap->logopt);
+		if (s_key) {
+			if (!strcmp(s_key, key))
+				ret = 1;
+			free(s_key);
+		}
+	}
+done:
+	if (ret != 1) {
+		debug(ap->logopt,
+		      MODPREFIX "index for map %s is stale", ctxt->mapname);
+		map_index_lock(mi);
+		mi->valid = 0;
+		map_index_unlock(mi);
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
 static int check_master_self_include(struct master *master, struct lookup_context *ctxt)
 {
 	char *m_path, *m_base, *i_path, *i_base;
@@ -865,6 +1205,19 @@ static int lookup_one(struct autofs_point *ap,
 	unsigned int k_len, m_len;
 	int entry, ret;
 
+	if (ctxt->index && !(source->flags & MAP_FLAG_FORMAT_AMD)) {
+		entry = map_index_lookup(ap, ctxt,
+					 key, mkey, &k_len, mapent, &m_len);
+		if (entry == 0)
+			return CHE_MISSING;
+		if (entry > 0) {
+			cache_writelock(mc);
+			ret = cache_update(mc, source, key, mapent, age);
+			cache_unlock(mc);
+			return ret;
+		}
+	}
+
 	f = open_fopen_r(ctxt->mapname);
 	if (!f) {
 		error(ap->logopt,
@@ -973,6 +1326,19 @@ static int lookup_wild(struct autofs_point *ap,
 
 	mc = source->mc;
 
+	if (ctxt->index && !(source->flags & MAP_FLAG_FORMAT_AMD)) {
+		entry = map_index_lookup(ap, ctxt,
+					 NULL, mkey, &k_len, mapent, &m_len);
+		if (entry == 0)
+			return CHE_MISSING;
+		if (entry > 0) {
+			cache_writelock(mc);
+			ret = cache_update(mc, source, "*", mapent, age);
+			cache_unlock(mc);
+			return ret;
+		}
+	}
+
 	f = open_fopen_r(ctxt->mapname);
 	if (!f) {
 		error(ap->logopt,
@@ -1309,6 +1675,8 @@ int lookup_done(void *context)
 {
 	struct lookup_context *ctxt = (struct lookup_context *) context;
 	int rv = close_parse(ctxt->parse);
+	if (ctxt->index)
+		map_index_free(ctxt->index);
 	free_argv(ctxt->opts_argc, ctxt->opts_argv);
 	free(ctxt);
 	return rv;
@@ -35,6 +35,9 @@
 #define MAPFMT_DEFAULT "sun"
 #define MODPREFIX "lookup(hosts): "
 
+/* Attribute to create a joinable thread */
+extern pthread_attr_t th_attr;
+
 pthread_mutex_t hostent_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct lookup_context {
@@ -95,7 +98,7 @@ int lookup_read_master(struct master *master, time_t age, void *context)
 	return NSS_STATUS_UNKNOWN;
 }
 
-static char *get_exports(struct autofs_point *ap, const char *host)
+static char *get_exports(struct autofs_point *ap, const char *host, long seconds)
 {
 	char buf[MAX_ERR_BUF];
 	char *mapent;
@@ -103,7 +106,7 @@ static char *get_exports(struct autofs_point *ap, const char *host)
 
 	debug(ap->logopt, MODPREFIX "fetchng export list for %s", host);
 
-	exp = rpc_get_exports(host, 10, 0, RPC_CLOSE_NOLINGER);
+	exp = rpc_get_exports(host, seconds, 0, RPC_CLOSE_NOLINGER);
 
 	mapent = NULL;
 	this = exp;
@@ -179,47 +182,205 @@ static int do_parse_mount(struct autofs_point *ap, struct map_source *source,
 	return NSS_STATUS_SUCCESS;
 }
 
+/* The export list of an expanded host being updated */
+struct host_exports {
+	char *host;
+	char *mapent;		/* Export list in the cache */
+	char *exports;		/* Export list fetched, if it could be */
+};
+
+/* Hosts whose export lists are being fetched, shared by the workers */
+struct exports_update {
+	struct autofs_point *ap;
+	struct host_exports *hosts;
+	unsigned int count;
+	unsigned int next;
+	long timeout;
+	time_t deadline;
+};
+
+static void *do_get_exports(void *arg)
+{
+	struct exports_update *eu = (struct exports_update *) arg;
+	unsigned int n;
+
+	while ((n = __atomic_fetch_add(&eu->next, 1, __ATOMIC_RELAXED)) < eu->count) {
+		struct host_exports *this = &eu->hosts[n];
+		time_t left = eu->deadline - monotonic_time(NULL);
+
+		if (left <= 0) {
+			warn(eu->ap->logopt, MODPREFIX
+			     "deadline passed, export list of %s not updated",
+			     this->host);
+			continue;
+		}
+		if (left > eu->timeout)
+			left = eu->timeout;
+
+		this->exports = get_exports(eu->ap, this->host, left);
+	}
+
+	return NULL;
+}
+
+/*
+ * Fetch the export lists of the hosts, several at a time. Each fetch
+ * is limited to the time left before the deadline for the update.
+ */
+static void get_hosts_exports(struct exports_update *eu)
+{
+	unsigned int max_threads, started = 0;
+	pthread_t *thids;
+	int cur_state;
+
+	eu->next = 0;
+	eu->timeout = defaults_get_hosts_exports_timeout();
+	eu->deadline = monotonic_time(NULL) +
+		       defaults_get_hosts_exports_deadline();
+
+	max_threads = defaults_get_hosts_exports_threads();
+	if (max_threads > eu->count)
+		max_threads = eu->count;
+
+	thids = NULL;
+	if (max_threads > 1) {
+		thids = malloc((max_threads - 1) * sizeof(pthread_t));
+		if (!thids)
+			max_threads = 1;
+	}
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+
+	/* This thread fetches export lists too */
+	while (started + 1 < max_threads) {
+		if (pthread_create(&thids[started], &th_attr,
+				   do_get_exports, eu))
+			break;
+		started++;
+	}
+
+	do_get_exports(eu);
+
+	while (started)
+		pthread_join(thids[--started], NULL);
+
+	pthread_setcancelstate(cur_state, NULL);
+
+	if (thids)
+		free(thids);
+}
+
+static void exports_update_cleanup(void *arg)
+{
+	struct exports_update *eu = (struct exports_update *) arg;
+	unsigned int i;
+
+	for (i = 0; i < eu->count; i++) {
+		free(eu->hosts[i].host);
+		if (eu->hosts[i].mapent)
+			free(eu->hosts[i].mapent);
+		if (eu->hosts[i].exports)
+			free(eu->hosts[i].exports);
+	}
+	if (eu->hosts)
+		free(eu->hosts);
+}
+
+/*
+ * Update the export lists of the hosts that have been mounted. The
+ * lists are fetched without holding the cache lock, so lookups on
+ * the map aren't held up by hosts that don't respond, then the cache
+ * is updated in one go. Only hosts whose export list has changed
+ * need their mounts updated.
+ */
 static void update_hosts_mounts(struct autofs_point *ap,
 				struct map_source *source, time_t age,
 				struct lookup_context *ctxt)
 {
+	struct exports_update eu;
+	struct host_exports *tmp;
+	unsigned int size = 0, i;
 	struct mapent_cache *mc;
 	struct mapent *me;
-	char *mapent;
 	int ret;
 
 	mc = source->mc;
 
+	memset(&eu, 0, sizeof(struct exports_update));
+	eu.ap = ap;
+
+	/* Frees the hosts and their export lists */
+	pthread_cleanup_push(exports_update_cleanup, &eu);
+
 	pthread_cleanup_push(cache_lock_cleanup, mc);
-	cache_writelock(mc);
+	cache_readlock(mc);
 	me = cache_lookup_first(mc);
 	while (me) {
+		struct host_exports *this;
+
 		/* Hosts map entry not yet expanded or already expired */
-		if (!me->multi)
+		if (!me->multi || me->multi != me)
 			goto next;
 
-		debug(ap->logopt, MODPREFIX "get list of exports for %s", me->key);
-
-		mapent = get_exports(ap, me->key);
-		if (mapent) {
-			cache_update(mc, source, me->key, mapent, age);
-			free(mapent);
+		if (eu.count == size) {
+			size = size ? size * 2 : 16;
+			tmp = realloc(eu.hosts, size * sizeof(struct host_exports));
+			if (!tmp) {
+				error(ap->logopt, MODPREFIX
+				      "failed to allocate export list storage");
+				break;
+			}
+			eu.hosts = tmp;
 		}
+
+		this = &eu.hosts[eu.count];
+		this->host = strdup(me->key);
+		if (!this->host)
+			goto next;
+		this->mapent = me->mapent ? strdup(me->mapent) : NULL;
+		this->exports = NULL;
+		eu.count++;
 next:
 		me = cache_lookup_next(mc, me);
 	}
 	pthread_cleanup_pop(1);
 
+	if (eu.count) {
+		debug(ap->logopt, MODPREFIX
+		      "get list of exports for %u hosts", eu.count);
+
+		get_hosts_exports(&eu);
+
+		pthread_cleanup_push(cache_lock_cleanup, mc);
+		cache_writelock(mc);
+		for (i = 0; i < eu.count; i++) {
+			struct host_exports *this = &eu.hosts[i];
+
+			if (this->exports)
+				cache_update(mc, source,
+					     this->host, this->exports, age);
+		}
+		pthread_cleanup_pop(1);
+	}
+
 	pthread_cleanup_push(cache_lock_cleanup, mc);
 	cache_readlock(mc);
-	me = cache_lookup_first(mc);
-	while (me) {
-		/*
-		 * Hosts map entry not yet expanded, already expired
-		 * or not the base of the tree
-		 */
-		if (!me->multi || me->multi != me)
-			goto cont;
+	for (i = 0; i < eu.count; i++) {
+		struct host_exports *this = &eu.hosts[i];
+
+		if (!this->exports)
+			continue;
+
+		if (this->mapent && !strcmp(this->mapent, this->exports)) {
+			debug(ap->logopt, MODPREFIX
+			      "exports unchanged for %s", this->host);
+			continue;
+		}
+
+		me = cache_lookup_distinct(mc, this->host);
+		/* Expired while the exports were being fetched */
+		if (!me || !me->multi || me->multi != me)
+			continue;
 
 		debug(ap->logopt, MODPREFIX
 		      "attempt to update exports for %s", me->key);
@@ -233,10 +394,10 @@ next:
 			warn(ap->logopt, MODPREFIX
 			     "failed to parse mount %s", me->mapent);
 		ap->flags &= ~MOUNT_FLAG_REMOUNT;
-cont:
-		me = cache_lookup_next(mc, me);
 	}
 	pthread_cleanup_pop(1);
+
+	pthread_cleanup_pop(1);
 }
 
 int lookup_read_map(struct autofs_point *ap, time_t age, void *context)
@@ -389,7 +550,8 @@ done:
 
 	if (!mapent) {
 		/* We need to get the exports list and update the cache. */
-		mapent = get_exports(ap, name);
+		mapent = get_exports(ap, name,
+				     defaults_get_hosts_exports_timeout());
 
 		/* Exports lookup failed so we're outa here */
 		if (!mapent)
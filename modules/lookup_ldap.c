@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <signal.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/nameser.h>
 #include <resolv.h>
@@ -1042,6 +1043,169 @@ find_server:
 	return ret;
 }
 
+static void conns_mutex_lock(struct lookup_context *ctxt)
+{
+	int status = pthread_mutex_lock(&ctxt->conns_mutex);
+	if (status)
+		fatal(status);
+	return;
+}
+
+static void conns_mutex_unlock(struct lookup_context *ctxt)
+{
+	int status = pthread_mutex_unlock(&ctxt->conns_mutex);
+	if (status)
+		fatal(status);
+	return;
+}
+
+/*
+ * An idle connection shouldn't have anything to read, if it does
+ * or the socket has an error the server has most likely closed it.
+ */
+static int ldap_connection_alive(struct ldap_conn *conn)
+{
+	struct pollfd pfd;
+	int fd = -1;
+
+	if (ldap_get_option(conn->ldap, LDAP_OPT_DESC, &fd) != LDAP_OPT_SUCCESS)
+		return 0;
+	if (fd < 0)
+		return 0;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 0) == -1)
+		return 0;
+
+	return !pfd.revents;
+}
+
+/*
+ * Get a bound connection for a lookup, reusing an idle connection
+ * from the context connection pool if there's a usable one.
+ */
+static int get_ldap_connection(unsigned logopt,
+			       struct ldap_conn *conn, struct lookup_context *ctxt)
+{
+	time_t now = monotonic_time(NULL);
+
+	conns_mutex_lock(ctxt);
+	while (!list_empty(&ctxt->conns)) {
+		struct ldap_conn *this;
+
+		this = list_entry(ctxt->conns.next, struct ldap_conn, list);
+		list_del(&this->list);
+		ctxt->conns_count--;
+		conns_mutex_unlock(ctxt);
+
+		if ((ctxt->conns_idle_timeout &&
+		     now - this->last_used > ctxt->conns_idle_timeout) ||
+		    !ldap_connection_alive(this)) {
+			debug(logopt, MODPREFIX "closing stale pooled connection");
+			unbind_ldap_connection(logopt, this, ctxt);
+			free(this);
+			conns_mutex_lock(ctxt);
+			continue;
+		}
+
+		memcpy(conn, this, sizeof(struct ldap_conn));
+		INIT_LIST_HEAD(&conn->list);
+		free(this);
+		return NSS_STATUS_SUCCESS;
+	}
+	conns_mutex_unlock(ctxt);
+
+	return do_reconnect(logopt, conn, ctxt);
+}
+
+/*
+ * Return a connection to the context connection pool once a lookup
+ * is done with it. Connections that had an error must be released
+ * with unbind_ldap_connection() instead.
+ */
+static void put_ldap_connection(unsigned logopt,
+				struct ldap_conn *conn, struct lookup_context *ctxt)
+{
+	struct ldap_conn *this;
+
+	if (!conn->ldap)
+		return;
+
+	conns_mutex_lock(ctxt);
+	if (ctxt->conns_count >= ctxt->conns_max) {
+		conns_mutex_unlock(ctxt);
+		unbind_ldap_connection(logopt, conn, ctxt);
+		return;
+	}
+
+	this = malloc(sizeof(struct ldap_conn));
+	if (!this) {
+		conns_mutex_unlock(ctxt);
+		unbind_ldap_connection(logopt, conn, ctxt);
+		return;
+	}
+	memcpy(this, conn, sizeof(struct ldap_conn));
+	this->last_used = monotonic_time(NULL);
+
+	/* Most recently used first, they're the least likely to be stale */
+	list_add(&this->list, &ctxt->conns);
+	ctxt->conns_count++;
+	conns_mutex_unlock(ctxt);
+
+	conn->ldap = NULL;
+#ifdef WITH_SASL
+	conn->sasl_conn = NULL;
+#endif
+}
+
+/*
+ * Search using a connection from get_ldap_connection(). A pooled
+ * connection can be closed by the server while it's idle so try
+ * once more with a new connection if the server has gone away.
+ */
+static int search_ldap_connection(unsigned logopt,
+				  struct ldap_conn *conn, struct lookup_context *ctxt,
+				  const char *base, int scope, const char *query,
+				  char **attrs, LDAPMessage **result)
+{
+	int rv;
+
+	rv = ldap_search_s(conn->ldap, base, scope, query, attrs, 0, result);
+	if (rv != LDAP_SERVER_DOWN || !ctxt->conns_max)
+		return rv;
+
+	if (*result) {
+		ldap_msgfree(*result);
+		*result = NULL;
+	}
+	unbind_ldap_connection(logopt, conn, ctxt);
+
+	debug(logopt, MODPREFIX "server down, retrying with new connection");
+
+	if (do_reconnect(logopt, conn, ctxt) != NSS_STATUS_SUCCESS)
+		return rv;
+
+	return ldap_search_s(conn->ldap, base, scope, query, attrs, 0, result);
+}
+
+static void free_ldap_connections(struct lookup_context *ctxt)
+{
+	conns_mutex_lock(ctxt);
+	while (!list_empty(&ctxt->conns)) {
+		struct ldap_conn *this;
+
+		this = list_entry(ctxt->conns.next, struct ldap_conn, list);
+		list_del(&this->list);
+		unbind_ldap_connection(LOGOPT_NONE, this, ctxt);
+		free(this);
+	}
+	ctxt->conns_count = 0;
+	conns_mutex_unlock(ctxt);
+}
+
 int get_property(unsigned logopt, xmlNodePtr node, const char *prop, char **value)
 {
 	xmlChar *ret;
@@ -1605,6 +1769,10 @@ static void free_context(struct lookup_context *ctxt)
 {
 	int ret;
 
+	/* Pooled connections need the authentication details */
+	if (ctxt->mutexes_init)
+		free_ldap_connections(ctxt);
+
 	if (ctxt->schema) {
 		free(ctxt->schema->map_class);
 		free(ctxt->schema->map_attr);
@@ -1637,9 +1805,14 @@ static void free_context(struct lookup_context *ctxt)
 		free(ctxt->base);
 	if (ctxt->uris)
 		defaults_free_uris(ctxt->uris);
-	ret = pthread_mutex_destroy(&ctxt->uris_mutex);
-	if (ret)
-		fatal(ret);
+	if (ctxt->mutexes_init) {
+		ret = pthread_mutex_destroy(&ctxt->uris_mutex);
+		if (ret)
+			fatal(ret);
+		ret = pthread_mutex_destroy(&ctxt->conns_mutex);
+		if (ret)
+			fatal(ret);
+	}
 	if (ctxt->sdns)
 		defaults_free_searchdns(ctxt->sdns);
 	if (ctxt->dclist)
@@ -1684,12 +1857,22 @@ static int do_init(const char *mapfmt,
 	unsigned int is_amd_format;
 	int ret;
 
+	INIT_LIST_HEAD(&ctxt->conns);
+
 	ret = pthread_mutex_init(&ctxt->uris_mutex, NULL);
 	if (ret) {
 		error(LOGOPT_ANY, MODPREFIX "failed to init uris mutex");
 		return 1;
 	}
 
+	ret = pthread_mutex_init(&ctxt->conns_mutex, NULL);
+	if (ret) {
+		error(LOGOPT_ANY, MODPREFIX "failed to init connections mutex");
+		pthread_mutex_destroy(&ctxt->uris_mutex);
+		return 1;
+	}
+	ctxt->mutexes_init = 1;
+
 	/* If a map type isn't explicitly given, parse it like sun entries. */
 	if (mapfmt == NULL)
 		mapfmt = MAPFMT_DEFAULT;
@@ -1703,6 +1886,8 @@ static int do_init(const char *mapfmt,
 
 	ctxt->timeout = defaults_get_ldap_timeout();
 	ctxt->network_timeout = defaults_get_ldap_network_timeout();
+	ctxt->conns_max = defaults_get_ldap_connection_pool_size();
+	ctxt->conns_idle_timeout = defaults_get_ldap_connection_idle_timeout();
 
 	if (!is_amd_format) {
 		/*
@@ -2810,7 +2995,7 @@ static int read_one_map(struct autofs_point *ap,
 
 	/* Initialize the LDAP context. */
 	memset(&conn, 0, sizeof(struct ldap_conn));
-	rv = do_reconnect(ap->logopt, &conn, ctxt);
+	rv = get_ldap_connection(ap->logopt, &conn, ctxt);
 	if (rv)
 		return rv;
 	sp.ldap = conn.ldap;
@@ -2910,7 +3095,7 @@ static int read_one_map(struct autofs_point *ap,
 
 	debug(ap->logopt, MODPREFIX "done updating map");
 
-	unbind_ldap_connection(ap->logopt, &conn, ctxt);
+	put_ldap_connection(ap->logopt, &conn, ctxt);
 
 	source->age = age;
 	if (sp.cookie)
@@ -2980,7 +3165,7 @@ static int lookup_one(struct autofs_point *ap, struct map_source *source,
 
 	/* Initialize the LDAP context. */
 	memset(&conn, 0, sizeof(struct ldap_conn));
-	rv = do_reconnect(ap->logopt, &conn, ctxt);
+	rv = get_ldap_connection(ap->logopt, &conn, ctxt);
 	if (rv == NSS_STATUS_UNAVAIL)
 		return CHE_UNAVAIL;
 	if (rv == NSS_STATUS_NOTFOUND)
@@ -3069,7 +3254,9 @@ static int lookup_one(struct autofs_point *ap, struct map_source *source,
 	debug(ap->logopt,
 	      MODPREFIX "searching for \"%s\" under \"%s\"", query, ctxt->qdn);
 
-	rv = ldap_search_s(ldap, ctxt->qdn, scope, query, attrs, 0, &result);
+	rv = search_ldap_connection(ap->logopt, &conn, ctxt,
+				    ctxt->qdn, scope, query, attrs, &result);
+	ldap = conn.ldap;
 
 	if ((rv != LDAP_SUCCESS) || !result) {
 		crit(ap->logopt, MODPREFIX "query failed for %s", query);
@@ -3088,7 +3275,7 @@ static int lookup_one(struct autofs_point *ap, struct map_source *source,
 		debug(ap->logopt,
 		     MODPREFIX "got answer, but no entry for %s", query);
 		ldap_msgfree(result);
-		unbind_ldap_connection(ap->logopt, &conn, ctxt);
+		put_ldap_connection(ap->logopt, &conn, ctxt);
 		free(query);
 		return CHE_MISSING;
 	}
@@ -3274,7 +3461,7 @@ next:
 	}
 
 	ldap_msgfree(result);
-	unbind_ldap_connection(ap->logopt, &conn, ctxt);
+	put_ldap_connection(ap->logopt, &conn, ctxt);
 
 	/* Failed to find wild entry, update cache if needed */
 	cache_writelock(mc);
@@ -3335,7 +3522,7 @@ static int lookup_one_amd(struct autofs_point *ap,
 
 	/* Initialize the LDAP context. */
 	memset(&conn, 0, sizeof(struct ldap_conn));
-	rv = do_reconnect(ap->logopt, &conn, ctxt);
+	rv = get_ldap_connection(ap->logopt, &conn, ctxt);
 	if (rv == NSS_STATUS_UNAVAIL)
 		return CHE_UNAVAIL;
 	if (rv == NSS_STATUS_NOTFOUND)
@@ -3379,7 +3566,9 @@ static int lookup_one_amd(struct autofs_point *ap,
 	debug(ap->logopt,
 	      MODPREFIX "searching for \"%s\" under \"%s\"", query, ctxt->base);
 
-	rv = ldap_search_s(ldap, ctxt->base, scope, query, attrs, 0, &result);
+	rv = search_ldap_connection(ap->logopt, &conn, ctxt,
+				    ctxt->base, scope, query, attrs, &result);
+	ldap = conn.ldap;
 	if ((rv != LDAP_SUCCESS) || !result) {
 		crit(ap->logopt, MODPREFIX "query failed for %s", query);
 		unbind_ldap_connection(ap->logopt, &conn, ctxt);
@@ -3397,7 +3586,7 @@ static int lookup_one_amd(struct autofs_point *ap,
 		debug(ap->logopt,
 		     MODPREFIX "got answer, but no entry for %s", query);
 		ldap_msgfree(result);
-		unbind_ldap_connection(ap->logopt, &conn, ctxt);
+		put_ldap_connection(ap->logopt, &conn, ctxt);
 		free(query);
 		return CHE_MISSING;
 	}
@@ -3459,7 +3648,7 @@ next:
 	}
 
 	ldap_msgfree(result);
-	unbind_ldap_connection(ap->logopt, &conn, ctxt);
+	put_ldap_connection(ap->logopt, &conn, ctxt);
 	free(query);
 
 	return ret;
@@ -3814,6 +4003,7 @@ int lookup_done(void *context)
 {
 	struct lookup_context *ctxt = (struct lookup_context *) context;
 	int rv = close_parse(ctxt->parse);
+	free_ldap_connections(ctxt);
 #ifdef WITH_SASL
 	ldapinit_mutex_lock();
 	autofs_sasl_dispose(NULL, ctxt);
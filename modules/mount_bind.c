@@ -163,12 +163,15 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 		if (!status)
 			existed = 0;
 
-		debug(ap->logopt, MODPREFIX
-		      "calling mount --bind -o %s %s %s",
-		      options, what, fullpath);
-
-		err = spawn_bind_mount(ap->logopt, "-o",
-				       options, what, fullpath, NULL);
+		err = native_mount(ap->logopt, what, fullpath, "bind", options);
+		if (err == MNT_NATIVE_UNSUPPORTED) {
+			debug(ap->logopt, MODPREFIX
+			      "calling mount --bind -o %s %s %s",
+			      options, what, fullpath);
+
+			err = spawn_bind_mount(ap->logopt, "-o",
+					       options, what, fullpath, NULL);
+		}
 
 		if (err) {
 			if (ap->type != LKP_INDIRECT)
@@ -120,17 +120,20 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 		return 1;
 	}
 
-	if (options) {
-		debug(ap->logopt, MODPREFIX
-		      "calling mount -t %s -o %s %s %s",
-		      fstype, options, what, fullpath);
-		err = spawn_mount(ap->logopt, "-t", fstype,
-			          "-o", options, what, fullpath, NULL);
-	} else {
-		debug(ap->logopt,
-		      MODPREFIX "calling mount -t %s %s %s",
-		      fstype, what, fullpath);
-		err = spawn_mount(ap->logopt, "-t", fstype, what, fullpath, NULL);
+	err = native_mount(ap->logopt, what, fullpath, fstype, options);
+	if (err == MNT_NATIVE_UNSUPPORTED) {
+		if (options) {
+			debug(ap->logopt, MODPREFIX
+			      "calling mount -t %s -o %s %s %s",
+			      fstype, options, what, fullpath);
+			err = spawn_mount(ap->logopt, "-t", fstype,
+				          "-o", options, what, fullpath, NULL);
+		} else {
+			debug(ap->logopt,
+			      MODPREFIX "calling mount -t %s %s %s",
+			      fstype, what, fullpath);
+			err = spawn_mount(ap->logopt, "-t", fstype, what, fullpath, NULL);
+		}
 	}
 
 	if (err) {
@@ -79,17 +79,20 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 	if (!status)
 		existed = 0;
 
-	if (options && options[0]) {
-		debug(ap->logopt,
-		      MODPREFIX "calling mount -t %s -o %s %s %s",
-		      fstype, options, what, fullpath);
-
-		err = spawn_mount(ap->logopt, "-t", fstype,
-				  "-o", options, what, fullpath, NULL);
-	} else {
-		debug(ap->logopt, MODPREFIX "calling mount -t %s %s %s",
-		      fstype, what, fullpath);
-		err = spawn_mount(ap->logopt, "-t", fstype, what, fullpath, NULL);
+	err = native_mount(ap->logopt, what, fullpath, fstype, options);
+	if (err == MNT_NATIVE_UNSUPPORTED) {
+		if (options && options[0]) {
+			debug(ap->logopt,
+			      MODPREFIX "calling mount -t %s -o %s %s %s",
+			      fstype, options, what, fullpath);
+
+			err = spawn_mount(ap->logopt, "-t", fstype,
+					  "-o", options, what, fullpath, NULL);
+		} else {
+			debug(ap->logopt, MODPREFIX "calling mount -t %s %s %s",
+			      fstype, what, fullpath);
+			err = spawn_mount(ap->logopt, "-t", fstype, what, fullpath, NULL);
+		}
 	}
 
 	if (err) {
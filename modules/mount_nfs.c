@@ -59,6 +59,51 @@ int mount_reinit(void **context)
 	return 0;
 }
 
+/*
+ * A mount(2) NFS mount needs the server address option which
+ * mount.nfs(8) would otherwise add for us.
+ */
+static int nfs_native_mount(struct autofs_point *ap, struct host *host,
+			    const char *loc, const char *fstype,
+			    const char *options, const char *fullpath)
+{
+	socklen_t len = INET6_ADDRSTRLEN;
+	char n_buf[len + 1];
+	const char *n_addr;
+	char *nfsoptions;
+	size_t size;
+	int err;
+
+	if (!defaults_get_mount_native())
+		return MNT_NATIVE_UNSUPPORTED;
+
+	n_addr = get_addr_string(host->addr, n_buf, len);
+	if (!n_addr)
+		return MNT_NATIVE_UNSUPPORTED;
+
+	size = strlen(n_addr) + 7;
+	if (options)
+		size += strlen(options);
+
+	nfsoptions = malloc(size);
+	if (!nfsoptions)
+		return MNT_NATIVE_UNSUPPORTED;
+
+	*nfsoptions = '\0';
+	if (options && *options) {
+		strcpy(nfsoptions, options);
+		strcat(nfsoptions, ",");
+	}
+	strcat(nfsoptions, "addr=");
+	strcat(nfsoptions, n_addr);
+
+	err = native_mount(ap->logopt, loc, fullpath, fstype, nfsoptions);
+
+	free(nfsoptions);
+
+	return err;
+}
+
 int mount_mount(struct autofs_point *ap, const char *root, const char *name, int name_len,
 		const char *what, const char *fstype, const char *options,
 		void *context)
@@ -75,6 +120,8 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 	int len, status, err, existed = 1;
 	int nosymlink = 0;
 	int port = -1;
+	struct timespec start;
+	int vers_opt = 0;      /* Set if an NFS version has been given */
 	int ro = 0;            /* Set if mount bind should be read-only */
 	int rdma = 0;
 
@@ -87,9 +134,10 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 
 	mount_default_proto = defaults_get_mount_nfs_default_proto();
 	vers = NFS_VERS_MASK | NFS_PROTO_MASK;
-	if (strcmp(fstype, "nfs4") == 0)
+	if (strcmp(fstype, "nfs4") == 0) {
 		vers = NFS4_VERS_MASK | TCP_SUPPORTED;
-	else if (mount_default_proto == 4)
+		vers_opt = 1;
+	} else if (mount_default_proto == 4)
 		vers = vers | NFS4_VERS_MASK;
 
 	/* Extract "nosymlink" pseudo-option which stops local filesystems
@@ -148,6 +196,10 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 			} else if (_strncmp("use-weight-only", cp, o_len) == 0) {
 				flags |= MOUNT_FLAG_USE_WEIGHT_ONLY;
 			} else {
+				if (strstr(cp, "vers=") == cp ||
+				    strstr(cp, "nfsvers=") == cp)
+					vers_opt = 1;
+
 				if (_strncmp("vers=4", cp, o_len) == 0 ||
 				    _strncmp("nfsvers=4", cp, o_len) == 0)
 					vers = NFS4_VERS_MASK | TCP_SUPPORTED;
@@ -213,6 +265,7 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 	 * to NFSv3 (if it can). If the NFSv4 probe fails then probe as
 	 * normal.
 	 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	if ((hosts && !hosts->next) &&
 	    mount_default_proto == 4 &&
 	    (vers & NFS_VERS_MASK) != 0 &&
@@ -237,6 +290,7 @@ int mount_mount(struct autofs_point *ap, const char *root, const char *name, int
 	} else {
 		prune_host_list(ap->logopt, &hosts, vers, port);
 	}
+	mount_stage_record(ap, MOUNT_STAGE_PROBE, &start);
 
 dont_probe:
 	if (!hosts) {
@@ -347,20 +401,31 @@ dont_probe:
 		strcat(loc, ":");
 		strcat(loc, this->path);
 
-		if (nfsoptions && *nfsoptions) {
-			debug(ap->logopt,
-			      MODPREFIX "calling mount -t %s " SLOPPY 
-			      "-o %s %s %s", fstype, nfsoptions, loc, fullpath);
-
-			err = spawn_mount(ap->logopt,
-					  "-t", fstype, SLOPPYOPT "-o",
-					  nfsoptions, loc, fullpath, NULL);
-		} else {
-			debug(ap->logopt,
-			      MODPREFIX "calling mount -t %s %s %s",
-			      fstype, loc, fullpath);
-			err = spawn_mount(ap->logopt,
-					  "-t", fstype, loc, fullpath, NULL);
+		/*
+		 * The kernel doesn't negotiate the NFS version like
+		 * mount.nfs(8) does so a native mount needs a version
+		 * as well as the server address.
+		 */
+		err = MNT_NATIVE_UNSUPPORTED;
+		if (vers_opt && this->addr)
+			err = nfs_native_mount(ap, this, loc, fstype,
+					       nfsoptions, fullpath);
+		if (err == MNT_NATIVE_UNSUPPORTED) {
+			if (nfsoptions && *nfsoptions) {
+				debug(ap->logopt,
+				      MODPREFIX "calling mount -t %s " SLOPPY 
+				      "-o %s %s %s", fstype, nfsoptions, loc, fullpath);
+
+				err = spawn_mount(ap->logopt,
+						  "-t", fstype, SLOPPYOPT "-o",
+						  nfsoptions, loc, fullpath, NULL);
+			} else {
+				debug(ap->logopt,
+				      MODPREFIX "calling mount -t %s %s %s",
+				      fstype, loc, fullpath);
+				err = spawn_mount(ap->logopt,
+						  "-t", fstype, loc, fullpath, NULL);
+			}
 		}
 
 		if (!err) {
@@ -370,6 +435,9 @@ dont_probe:
 			return 0;
 		}
 
+		/* Probe the host again next time rather than use the cache */
+		probe_cache_invalidate(this->addr, this->addr_len);
+
 		free(loc);
 		this = this->next;
 	}
@@ -313,10 +313,30 @@ out:
 	return rv;
 }
 
-static int eval_selector(unsigned int logopt,
-			 struct amd_entry *this, struct substvar *sv)
+/*
+ * Values of the macro selectors used by the entries of a mount
+ * request, each is looked up at most once per request.
+ */
+struct sel_values {
+	unsigned long resolved;		/* Selector bits looked up */
+	const struct substvar *val[SEL_MAX];
+};
+
+static const struct substvar *sel_value(struct sel *sel,
+					const struct substvar *sv,
+					struct sel_values *vals)
+{
+	if (!(vals->resolved & sel->selector)) {
+		vals->val[sel->index] =
+			macro_findvar(sv, sel->name, strlen(sel->name));
+		vals->resolved |= sel->selector;
+	}
+	return vals->val[sel->index];
+}
+
+static int eval_selector(unsigned int logopt, struct selector *s,
+			 struct substvar *sv, struct sel_values *vals)
 {
-	struct selector *s = this->selector;
 	const struct substvar *v;
 	unsigned int s_type;
 	unsigned int v_type;
@@ -328,7 +348,7 @@ static int eval_selector(unsigned int logopt,
 
 	switch (s_type) {
 	case SEL_FLAG_MACRO:
-		v = macro_findvar(sv, s->sel->name, strlen(s->sel->name));
+		v = sel_value(s->sel, sv, vals);
 		if (!v) {
 			error(logopt, "failed to get selector %s", s->sel->name);
 			return 0;
@@ -366,7 +386,7 @@ static int eval_selector(unsigned int logopt,
 				val = 0;
 			} else {
 				res = atoi(v->val);
-				val = atoi(s->comp.value);
+				val = s->comp.num;
 			}
 			if (s->compare & SEL_COMP_EQUAL && res == val) {
 				debug(logopt, MODPREFIX
@@ -1567,11 +1587,10 @@ static void update_prefix(struct autofs_point *ap,
 	return;
 }
 
-static int match_selectors(unsigned int logopt,
-			   struct amd_entry *entry, struct substvar *sv)
+static int match_selectors(unsigned int logopt, struct amd_entry *entry,
+			   struct substvar *sv, struct sel_values *vals)
 {
 	struct selector *s = entry->selector;
-	int ret;
 
 	/* No selectors, always match */
 	if (!s) {
@@ -1579,19 +1598,14 @@ static int match_selectors(unsigned int logopt,
 		return 1;
 	}
 
-	ret = 0;
-
 	/* All selectors must match */
 	while (s) {
-		ret = eval_selector(logopt, entry, sv);
-		if (!ret)
-			break;
+		if (!eval_selector(logopt, s, sv, vals))
+			return 0;
 		s = s->next;
 	}
-	if (!s)
-		ret = 1;
 
-	return ret;
+	return 1;
 }
 
 static struct amd_entry *dup_defaults_entry(struct amd_entry *defaults)
@@ -1706,11 +1720,14 @@ static struct amd_entry *select_default_entry(struct autofs_point *ap,
 	unsigned long flags = conf_amd_get_flags(ap->path);
 	struct amd_entry *defaults_entry = NULL;
 	struct amd_entry *entry_default = NULL;
+	struct sel_values vals;
 	struct list_head *p, *head;
 
 	if (!(flags & CONF_SELECTORS_IN_DEFAULTS))
 		goto no_sel;
 
+	vals.resolved = 0;
+
 	head = entries;
 	p = head->next;
 	while (p != head) {
@@ -1743,7 +1760,7 @@ static struct amd_entry *select_default_entry(struct autofs_point *ap,
 		if (!this->selector)
 			continue;
 
-		if (match_selectors(ap->logopt, this, sv)) {
+		if (match_selectors(ap->logopt, this, sv, &vals)) {
 			if (entry_default) {
 				/*update_with_defaults(entry_default, this, sv);*/
 				free_amd_entry(entry_default);
@@ -1830,8 +1847,8 @@ out:
 	return make_default_entry(ap, sv);
 }
 
-int parse_mount(struct autofs_point *ap, const char *name,
-		int name_len, const char *mapent, void *context)
+static int do_parse_mount(struct autofs_point *ap, const char *name,
+			  int name_len, const char *mapent, void *context)
 {
 	struct parse_context *ctxt = (struct parse_context *) context;
 	unsigned int flags = conf_amd_get_flags(ap->path);
@@ -1843,6 +1860,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 	struct list_head entries, *p, *head;
 	struct amd_entry *defaults_entry;
 	struct amd_entry *cur_defaults;
+	struct sel_values vals;
 	char *defaults;
 	char *pmapent;
 	int len, rv = 1;
@@ -1932,6 +1950,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 		goto done;
 	}
 
+	vals.resolved = 0;
 	at_least_one = 0;
 	head = &entries;
 	p = head->next;
@@ -1963,11 +1982,14 @@ int parse_mount(struct autofs_point *ap, const char *name,
 			break;
 		}
 
-		if (!match_selectors(ap->logopt, this, sv))
+		if (!match_selectors(ap->logopt, this, sv, &vals))
 			continue;
 
 		at_least_one = 1;
 
+		/* The variables can change for the next location tried */
+		vals.resolved = 0;
+
 		update_with_defaults(cur_defaults, this, sv);
 		sv = expand_entry(ap, this, flags, sv);
 		sv = merge_entry_options(ap, this, sv);
@@ -2009,6 +2031,19 @@ done:
 	return rv;
 }
 
+int parse_mount(struct autofs_point *ap, const char *name,
+		int name_len, const char *mapent, void *context)
+{
+	struct timespec start;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = do_parse_mount(ap, name, name_len, mapent, context);
+	mount_stage_record(ap, MOUNT_STAGE_PARSE, &start);
+
+	return ret;
+}
+
 int parse_done(void *context)
 {
 	int rv = 0;
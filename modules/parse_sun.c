@@ -1236,86 +1236,25 @@ static int mount_subtree(struct autofs_point *ap, struct mapent *me,
 }
 
 /*
- * syntax is:
- *	[-options] location [location] ...
- *	[-options] [mountpoint [-options] location [location] ... ]...
- *
- * There are three ways this routine can be called. One where we parse
- * offsets in a multi-mount entry adding them to the cache for later lookups.
- * Another where we parse a multi-mount entry looking for a root offset mount
- * and mount it if it exists and also mount its offsets down to the first
- * level nexting point. Finally to mount non multi-mounts and to mount a
- * lower level multi-mount nesting point and its offsets.
+ * Gather the options at the start of an expanded map entry and
+ * merge them with the global options. ent is left pointing at the
+ * text following the options.
  */
-int parse_mount(struct autofs_point *ap, const char *name,
-		int name_len, const char *mapent, void *context)
+static int gather_options(struct autofs_point *ap, const char **ent,
+			  const char *optstr, unsigned int append_options,
+			  char **opts)
 {
-	struct parse_context *ctxt = (struct parse_context *) context;
 	char buf[MAX_ERR_BUF];
-	struct map_source *source;
-	struct mapent_cache *mc;
-	struct mapent *me;
-	char *pmapent, *options;
-	const char *p;
-	int mapent_len, rv = 0;
-	int cur_state;
-	int slashify = ctxt->slashify_colons;
-	unsigned int append_options;
-
-	source = ap->entry->current;
-	ap->entry->current = NULL;
-	master_source_current_signal(ap->entry);
-
-	mc = source->mc;
-
-	if (!mapent) {
-		warn(ap->logopt, MODPREFIX "error: empty map entry");
-		return 1;
-	}
-
-	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
-	macro_lock();
-
-	ctxt->subst = addstdenv(ctxt->subst, NULL);
-
-	mapent_len = expandsunent(mapent, NULL, name, ctxt->subst, slashify);
-	if (mapent_len == 0) {
-		error(ap->logopt, MODPREFIX "failed to expand map entry");
-		ctxt->subst = removestdenv(ctxt->subst, NULL);
-		macro_unlock();
-		pthread_setcancelstate(cur_state, NULL);
-		return 1;
-	}
-
-	pmapent = alloca(mapent_len + 1);
-	if (!pmapent) {	
-		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
-		logerr(MODPREFIX "alloca: %s", estr);
-		ctxt->subst = removestdenv(ctxt->subst, NULL);
-		macro_unlock();
-		pthread_setcancelstate(cur_state, NULL);
-		return 1;
-	}
-	pmapent[mapent_len] = '\0';
-
-	expandsunent(mapent, pmapent, name, ctxt->subst, slashify);
-	ctxt->subst = removestdenv(ctxt->subst, NULL);
-
-	macro_unlock();
-	pthread_setcancelstate(cur_state, NULL);
-
-	debug(ap->logopt, MODPREFIX "expanded entry: %s", pmapent);
+	const char *p = *ent;
+	char *options;
 
-	append_options = defaults_get_append_options();
-	options = strdup(ctxt->optstr ? ctxt->optstr : "");
+	options = strdup(optstr ? optstr : "");
 	if (!options) {
 		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
 		logerr(MODPREFIX "strdup: %s", estr);
-		return 1;
+		return 0;
 	}
 
-	p = skipspace(pmapent);
-
 	/* Deal with 0 or more options */
 	if (*p == '-') {
 		char *tmp, *mnt_options = NULL;
@@ -1338,7 +1277,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 					if (mnt_options)
 						free(mnt_options);
 					free(options);
-					return 1;
+					return 0;
 				}
 				mnt_options = tmp;
 			}
@@ -1364,7 +1303,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 						free(options);
 					if (mnt_options)
 						free(mnt_options);
-					return 1;
+					return 0;
 				}
 				options = tmp;
 			}
@@ -1372,13 +1311,375 @@ int parse_mount(struct autofs_point *ap, const char *name,
 			options = mnt_options;
 	}
 
-	debug(ap->logopt, MODPREFIX "gathered options: %s", options);
+	*ent = p;
+	*opts = options;
+
+	return 1;
+}
+
+/*
+ * Get the location of a normal map entry from the text following
+ * its options. The location of a hosts map mount is NULL.
+ */
+static int parse_location(struct autofs_point *ap, const char *name,
+			  const char *p, const char *options, char **location)
+{
+	char *loc;
+	int l;
+
+	*location = NULL;
+
+	l = chunklen(p, check_colon(p));
+	loc = dequote(p, l, ap->logopt);
+	if (!loc) {
+		warn(ap->logopt, MODPREFIX "null location or out of memory");
+		return 0;
+	}
+
+	/* Location can't begin with a '/' */
+	if (*p == '/') {
+		free(loc);
+		warn(ap->logopt,
+		      MODPREFIX "error location begins with \"/\"");
+		return 0;
+	}
+
+	if (!validate_location(ap->logopt, loc)) {
+		free(loc);
+		return 0;
+	}
+
+	debug(ap->logopt,
+	      MODPREFIX "dequote(\"%.*s\") -> %s", l, p, loc);
+
+	p += l;
+	p = skipspace(p);
+
+	while (*p) {
+		char *tmp, *ent;
+
+		l = chunklen(p, check_colon(p));
+		ent = dequote(p, l, ap->logopt);
+		if (!ent) {
+			free(loc);
+			warn(ap->logopt,
+			     MODPREFIX "null location or out of memory");
+			return 0;
+		}
+
+		if (!validate_location(ap->logopt, ent)) {
+			free(ent);
+			free(loc);
+			return 0;
+		}
+
+		debug(ap->logopt,
+		      MODPREFIX "dequote(\"%.*s\") -> %s", l, p, ent);
+
+		tmp = realloc(loc, strlen(loc) + l + 2);
+		if (!tmp) {
+			free(ent);
+			free(loc);
+			error(ap->logopt, MODPREFIX "out of memory");
+			return 0;
+		}
+		loc = tmp;
+
+		strcat(loc, " ");
+		strcat(loc, ent);
+
+		free(ent);
+
+		p += l;
+		p = skipspace(p);
+	}
+
+	/*
+	 * If options are asking for a hosts map loc should be
+	 * NULL but we see it can contain junk, so ....
+	 */
+	if ((strstr(options, "fstype=autofs") &&
+	     strstr(options, "hosts"))) {
+		free(loc);
+		return 1;
+	}
+
+	if (!strlen(loc)) {
+		free(loc);
+		error(ap->logopt, MODPREFIX "entry %s is empty!", name);
+		return 0;
+	}
+
+	*location = loc;
+
+	return 1;
+}
+
+/*
+ * Parse an expanded map entry into its options and either the
+ * offsets of a multi-mount or the location of a normal entry.
+ * The location isn't needed for a multi-mount offset since the
+ * offset entry text is used as is when it's mounted.
+ */
+static struct mapent_parse *parse_entry(struct autofs_point *ap,
+					const char *name, const char *entry,
+					const char *optstr,
+					unsigned int append_options,
+					unsigned int offset, int *multi)
+{
+	char buf[MAX_ERR_BUF];
+	struct mapent_parse *parsed;
+	const char *p;
+	int len;
+
+	parsed = malloc(sizeof(struct mapent_parse));
+	if (!parsed) {
+		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+		logerr(MODPREFIX "malloc: %s", estr);
+		return NULL;
+	}
+	memset(parsed, 0, sizeof(struct mapent_parse));
+	parsed->refs = 1;
+	parsed->append = append_options;
+	parsed->offset = offset;
+	INIT_LIST_HEAD(&parsed->offsets);
+
+	parsed->entry = strdup(entry);
+	parsed->optstr = strdup(optstr ? optstr : "");
+	if (!parsed->entry || !parsed->optstr) {
+		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+		logerr(MODPREFIX "strdup: %s", estr);
+		goto fail;
+	}
+	len = strlen(parsed->entry);
+
+	p = skipspace(parsed->entry);
+
+	if (!gather_options(ap, &p, optstr, append_options, &parsed->options))
+		goto fail;
+
+	debug(ap->logopt, MODPREFIX "gathered options: %s", parsed->options);
+
+	parsed->rest = p;
+
+	if (!check_is_multi(p)) {
+		if (!offset &&
+		    !parse_location(ap, name, p, parsed->options, &parsed->loc))
+			goto fail;
+		return parsed;
+	}
+
+	parsed->multi = *multi = 1;
+
+	do {
+		struct mapent_offset *mo;
+		char *path;
+		int l;
+
+		if ((*p == '"' && *(p + 1) != '/') || (*p != '"' && *p != '/')) {
+			l = 0;
+			path = dequote("/", 1, ap->logopt);
+			debug(ap->logopt,
+			      MODPREFIX "dequote(\"/\") -> %s", path);
+		} else {
+			l = span_space(p, len - (p - parsed->entry));
+			path = sanitize_path(p, l, LKP_MULTI, ap->logopt);
+			debug(ap->logopt, MODPREFIX
+			      "dequote(\"%.*s\") -> %s", l, p, path);
+		}
+
+		if (!path) {
+			warn(ap->logopt, MODPREFIX "null path or out of memory");
+			goto fail;
+		}
+
+		p += l;
+		p = skipspace(p);
+
+		mo = malloc(sizeof(struct mapent_offset));
+		if (!mo) {
+			char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+			logerr(MODPREFIX "malloc: %s", estr);
+			free(path);
+			goto fail;
+		}
+		mo->path = path;
+
+		l = parse_mapent(p, parsed->options,
+				 &mo->options, &mo->loc, ap->logopt);
+		if (!l) {
+			free(path);
+			free(mo);
+			goto fail;
+		}
+		list_add_tail(&mo->list, &parsed->offsets);
+
+		p += l;
+		p = skipspace(p);
+	} while (*p == '/' || (*p == '"' && *(p + 1) == '/'));
+
+	return parsed;
+
+fail:
+	cache_put_parsed(parsed);
+	return NULL;
+}
+
+/*
+ * Get the parsed form of the map entry for name if it was parsed
+ * from the same expanded entry with the same global options and
+ * the entry hasn't been updated since. Cache must be read locked.
+ */
+static struct mapent_parse *get_parsed(struct mapent_cache *mc,
+				       const char *name, const char *entry,
+				       const char *optstr,
+				       unsigned int append_options,
+				       unsigned int offset)
+{
+	struct mapent_parse *parsed;
+	struct mapent *me;
 
-	if (check_is_multi(p)) {
+	me = cache_lookup(mc, name);
+	if (!me)
+		return NULL;
+
+	parsed = cache_get_parsed(me);
+	if (!parsed)
+		return NULL;
+
+	if (parsed->age != me->age ||
+	    parsed->append != append_options ||
+	    parsed->offset != offset ||
+	    strcmp(parsed->optstr, optstr ? optstr : "") ||
+	    strcmp(parsed->entry, entry)) {
+		cache_put_parsed(parsed);
+		return NULL;
+	}
+
+	return parsed;
+}
+
+/*
+ * syntax is:
+ *	[-options] location [location] ...
+ *	[-options] [mountpoint [-options] location [location] ... ]...
+ *
+ * There are three ways this routine can be called. One where we parse
+ * offsets in a multi-mount entry adding them to the cache for later lookups.
+ * Another where we parse a multi-mount entry looking for a root offset mount
+ * and mount it if it exists and also mount its offsets down to the first
+ * level nexting point. Finally to mount non multi-mounts and to mount a
+ * lower level multi-mount nesting point and its offsets.
+ */
+static int do_parse_mount(struct autofs_point *ap, const char *name,
+			  int name_len, const char *mapent, void *context)
+{
+	struct parse_context *ctxt = (struct parse_context *) context;
+	char buf[MAX_ERR_BUF];
+	struct map_source *source;
+	struct mapent_cache *mc;
+	struct mapent *me;
+	struct mapent_parse *parsed;
+	struct stdenv_vars env;
+	struct substvar *subst;
+	char *pmapent;
+	int mapent_len, rv = 0;
+	int cur_state;
+	int slashify = ctxt->slashify_colons;
+	unsigned int append_options, offset = 0;
+
+	source = ap->entry->current;
+	ap->entry->current = NULL;
+	master_source_current_signal(ap->entry);
+
+	mc = source->mc;
+
+	if (!mapent) {
+		warn(ap->logopt, MODPREFIX "error: empty map entry");
+		return 1;
+	}
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cur_state);
+
+	/*
+	 * The requesting user's variables are looked up ahead of
+	 * the context table without changing it, so concurrent
+	 * requests don't need to hold the macro lock.
+	 */
+	subst = stdenv_overlay(&env, ctxt->subst);
+
+	mapent_len = expandsunent(mapent, NULL, name, subst, slashify);
+	if (mapent_len == 0) {
+		error(ap->logopt, MODPREFIX "failed to expand map entry");
+		pthread_setcancelstate(cur_state, NULL);
+		return 1;
+	}
+
+	pmapent = alloca(mapent_len + 1);
+	if (!pmapent) {	
+		char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
+		logerr(MODPREFIX "alloca: %s", estr);
+		pthread_setcancelstate(cur_state, NULL);
+		return 1;
+	}
+	pmapent[mapent_len] = '\0';
+
+	expandsunent(mapent, pmapent, name, subst, slashify);
+
+	pthread_setcancelstate(cur_state, NULL);
+
+	debug(ap->logopt, MODPREFIX "expanded entry: %s", pmapent);
+
+	append_options = defaults_get_append_options();
+
+	/*
+	 * The options and locations only need to be parsed again if
+	 * the map entry or the values substituted into it change.
+	 */
+	cache_readlock(mc);
+	if (*name == '/' &&
+	   (me = cache_lookup_distinct(mc, name)) && me->multi)
+		offset = 1;
+	parsed = get_parsed(mc, name, pmapent,
+			    ctxt->optstr, append_options, offset);
+	cache_unlock(mc);
+
+	if (parsed)
+		debug(ap->logopt,
+		      MODPREFIX "using parsed entry for %s", name);
+	else {
+		int multi = 0;
+
+		parsed = parse_entry(ap, name, pmapent, ctxt->optstr,
+				     append_options, offset, &multi);
+		if (!parsed) {
+			if (multi) {
+				cache_readlock(mc);
+				me = cache_lookup_distinct(mc, name);
+				if (me) {
+					cache_multi_writelock(me);
+					cache_delete_offset_list(mc, name);
+					cache_multi_unlock(me);
+				}
+				cache_unlock(mc);
+			}
+			return 1;
+		}
+
+		cache_readlock(mc);
+		me = cache_lookup(mc, name);
+		if (me) {
+			parsed->age = me->age;
+			cache_set_parsed(me, parsed);
+		}
+		cache_unlock(mc);
+	}
+
+	if (parsed->multi) {
+		struct list_head *pos;
 		char *m_root = NULL;
 		int m_root_len;
 		time_t age;
-		int l;
 
 		/* If name starts with "/" it's a direct mount */
 		if (*name == '/') {
@@ -1386,7 +1687,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 			m_root = alloca(m_root_len + 1);
 			if (!m_root) {
 				char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
-				free(options);
+				cache_put_parsed(parsed);
 				logerr(MODPREFIX "alloca: %s", estr);
 				return 1;
 			}
@@ -1396,7 +1697,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 			m_root = alloca(m_root_len + 1);
 			if (!m_root) {
 				char *estr = strerror_r(errno, buf, MAX_ERR_BUF);
-				free(options);
+				cache_put_parsed(parsed);
 				logerr(MODPREFIX "alloca: %s", estr);
 				return 1;
 			}
@@ -1409,7 +1710,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 		cache_readlock(mc);
 		me = cache_lookup_distinct(mc, name);
 		if (!me) {
-			free(options);
+			cache_put_parsed(parsed);
 			cache_unlock(mc);
 			pthread_setcancelstate(cur_state, NULL);
 			error(ap->logopt,
@@ -1440,7 +1741,7 @@ int parse_mount(struct autofs_point *ap, const char *name,
 			 * allowed for amd mounts.
 			 */
 			if (source->flags & MAP_FLAG_FORMAT_AMD) {
-				free(options);
+				cache_put_parsed(parsed);
 				cache_multi_unlock(me);
 				cache_unlock(mc);
 				pthread_setcancelstate(cur_state, NULL);
@@ -1451,75 +1752,30 @@ int parse_mount(struct autofs_point *ap, const char *name,
 		age = me->age;
 
 		/* It's a multi-mount; deal with it */
-		do {
-			char *path, *myoptions, *loc;
+		list_for_each(pos, &parsed->offsets) {
+			struct mapent_offset *mo;
 			int status;
 
-			if ((*p == '"' && *(p + 1) != '/') || (*p != '"' && *p != '/')) {
-				l = 0;
-				path = dequote("/", 1, ap->logopt);
-				debug(ap->logopt,
-				      MODPREFIX "dequote(\"/\") -> %s", path);
-			} else {
-				l = span_space(p, mapent_len - (p - pmapent));
-				path = sanitize_path(p, l, LKP_MULTI, ap->logopt);
-				debug(ap->logopt, MODPREFIX
-				      "dequote(\"%.*s\") -> %s", l, p, path);
-			}
-
-			if (!path) {
-				warn(ap->logopt, MODPREFIX "null path or out of memory");
-				cache_delete_offset_list(mc, name);
-				cache_multi_unlock(me);
-				cache_unlock(mc);
-				free(options);
-				pthread_setcancelstate(cur_state, NULL);
-				return 1;
-			}
-
-			p += l;
-			p = skipspace(p);
-
-			l = parse_mapent(p, options, &myoptions, &loc, ap->logopt);
-			if (!l) {
-				cache_delete_offset_list(mc, name);
-				cache_multi_unlock(me);
-				cache_unlock(mc);
-				free(path);
-				free(options);
-				pthread_setcancelstate(cur_state, NULL);
-				return 1;
-			}
-
-			p += l;
-			p = skipspace(p);
+			mo = list_entry(pos, struct mapent_offset, list);
 
 			master_source_current_wait(ap->entry);
 			ap->entry->current = source;
 
 			status = update_offset_entry(ap, name,
 						     m_root, m_root_len,
-						     path, myoptions, loc, age);
+						     mo->path, mo->options,
+						     mo->loc, age);
 
 			if (status != CHE_OK) {
 				warn(ap->logopt, MODPREFIX "error adding multi-mount");
 				cache_delete_offset_list(mc, name);
 				cache_multi_unlock(me);
 				cache_unlock(mc);
-				free(path);
-				free(options);
-				free(myoptions);
-				if (loc)
-					free(loc);
+				cache_put_parsed(parsed);
 				pthread_setcancelstate(cur_state, NULL);
 				return 1;
 			}
-
-			if (loc)
-				free(loc);
-			free(path);
-			free(myoptions);
-		} while (*p == '/' || (*p == '"' && *(p + 1) == '/'));
+		}
 
 		/*
 		 * We've got the ordered list of multi-mount entries so go
@@ -1530,20 +1786,19 @@ int parse_mount(struct autofs_point *ap, const char *name,
 			clean_stale_multi_triggers(ap, me, NULL, NULL);
 		cache_set_parents(me);
 
-		rv = mount_subtree(ap, me, name, NULL, options, ctxt);
+		rv = mount_subtree(ap, me, name, NULL, parsed->options, ctxt);
 
 		cache_multi_unlock(me);
 		cache_unlock(mc);
 
-		free(options);
+		cache_put_parsed(parsed);
 		pthread_setcancelstate(cur_state, NULL);
 
 		return rv;
 	} else {
 		/* Normal (and non-root multi-mount) entries */
-		char *loc;
+		char *loc, *offset_loc = NULL;
 		int loclen;
-		int l;
 
 		/*
 		 * If this is an offset belonging to a multi-mount entry
@@ -1553,135 +1808,67 @@ int parse_mount(struct autofs_point *ap, const char *name,
 		cache_readlock(mc);
 		if (*name == '/' &&
 		   (me = cache_lookup_distinct(mc, name)) && me->multi) {
-			loc = strdup(p);
+			loc = strdup(parsed->rest);
 			if (!loc) {
-				free(options);
+				cache_put_parsed(parsed);
 				cache_unlock(mc);
 				warn(ap->logopt, MODPREFIX "out of memory");
 				return 1;
 			}
 			cache_multi_writelock(me);
-			rv = mount_subtree(ap, me, name, loc, options, ctxt);
+			rv = mount_subtree(ap, me, name, loc, parsed->options, ctxt);
 			cache_multi_unlock(me);
 			cache_unlock(mc);
 			free(loc);
-			free(options);
+			cache_put_parsed(parsed);
 			return rv;
 		}
 		cache_unlock(mc);
 
-		l = chunklen(p, check_colon(p));
-		loc = dequote(p, l, ap->logopt);
-		if (!loc) {
-			free(options);
-			warn(ap->logopt, MODPREFIX "null location or out of memory");
-			return 1;
-		}
-
-		/* Location can't begin with a '/' */
-		if (*p == '/') {
-			free(options);
-			free(loc);
-			warn(ap->logopt,
-			      MODPREFIX "error location begins with \"/\"");
-			return 1;
-		}
-
-		if (!validate_location(ap->logopt, loc)) {
-			free(loc);
-			free(options);
-			return 1;
-		}
-
-		debug(ap->logopt,
-		      MODPREFIX "dequote(\"%.*s\") -> %s", l, p, loc);
-
-		p += l;
-		p = skipspace(p);
-
-		while (*p) {
-			char *tmp, *ent;
-
-			l = chunklen(p, check_colon(p));
-			ent = dequote(p, l, ap->logopt);
-			if (!ent) {
-				free(loc);
-				free(options);
-				warn(ap->logopt,
-				     MODPREFIX "null location or out of memory");
-				return 1;
-			}
-
-			if (!validate_location(ap->logopt, ent)) {
-				free(ent);
-				free(loc);
-				free(options);
-				return 1;
-			}
-
-			debug(ap->logopt,
-			      MODPREFIX "dequote(\"%.*s\") -> %s", l, p, ent);
-
-			tmp = realloc(loc, strlen(loc) + l + 2);
-			if (!tmp) {
-				free(ent);
-				free(loc);
-				free(options);
-				error(ap->logopt, MODPREFIX "out of memory");
+		/* The offset has gone away since the entry was parsed */
+		if (parsed->offset) {
+			if (!parse_location(ap, name, parsed->rest,
+					    parsed->options, &offset_loc)) {
+				cache_put_parsed(parsed);
 				return 1;
 			}
-			loc = tmp;
-
-			strcat(loc, " ");
-			strcat(loc, ent);
-
-			free(ent);
-
-			p += l;
-			p = skipspace(p);
-		}
-
-		/*
-		 * If options are asking for a hosts map loc should be
-		 * NULL but we see it can contain junk, so ....
-		 */
-		if ((strstr(options, "fstype=autofs") &&
-		     strstr(options, "hosts"))) {
-			if (loc) {
-				free(loc);
-				loc = NULL;
-			}
-			loclen = 0;
-		} else {
-			loclen = strlen(loc);
-			if (loclen == 0) {
-				free(loc);
-				free(options);
-				error(ap->logopt,
-				      MODPREFIX "entry %s is empty!", name);
-				return 1;
-			}
-		}
+			loc = offset_loc;
+		} else
+			loc = parsed->loc;
+		loclen = loc ? strlen(loc) : 0;
 
 		debug(ap->logopt,
 		      MODPREFIX "core of entry: options=%s, loc=%.*s",
-		      options, loclen, loc);
+		      parsed->options, loclen, loc);
 
 		if (!strcmp(ap->path, "/-"))
 			rv = sun_mount(ap, name, name, name_len,
-				       loc, loclen, options, ctxt);
+				       loc, loclen, parsed->options, ctxt);
 		else
 			rv = sun_mount(ap, ap->path, name, name_len,
-				       loc, loclen, options, ctxt);
+				       loc, loclen, parsed->options, ctxt);
 
-		if (loc)
-			free(loc);
-		free(options);
+		if (offset_loc)
+			free(offset_loc);
+		cache_put_parsed(parsed);
 		pthread_setcancelstate(cur_state, NULL);
 	}
 	return rv;
 }
 
+int parse_mount(struct autofs_point *ap, const char *name,
+		int name_len, const char *mapent, void *context)
+{
+	struct timespec start;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = do_parse_mount(ap, name, name_len, mapent, context);
+	mount_stage_record(ap, MOUNT_STAGE_PARSE, &start);
+
+	return ret;
+}
+
 int parse_done(void *context)
 {
 	int rv = 0;
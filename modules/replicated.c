@@ -55,6 +55,9 @@
 #include "replicated.h"
 #include "automount.h"
 
+/* Attribute to create detached thread */
+extern pthread_attr_t th_attr_detached;
+
 #ifndef MAX_ERR_BUF
 #define MAX_ERR_BUF		512
 #endif
@@ -222,6 +225,264 @@ void free_host_list(struct host **list)
 	*list = NULL;
 }
 
+/*
+ * Cache of successful host probe results so that bursts of mounts
+ * from the same servers don't probe them again for every mount.
+ * Results are keyed by host address and the probe parameters and
+ * are kept for the configured time or until a mount from the host
+ * fails.
+ */
+#define PROBE_CACHE_SIZE	64
+
+#define PROBE_VERS_AND_COST	0x0001
+#define PROBE_SUPPORTED_VER	0x0002
+
+struct probe_cache_entry {
+	struct sockaddr_storage addr;
+	size_t addr_len;
+	unsigned int type;
+	unsigned int version;
+	int port;
+	unsigned int weight;
+	unsigned int options;
+	unsigned int supported;
+	unsigned long cost;
+	time_t expire;
+	struct list_head list;
+};
+
+static pthread_mutex_t probe_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head probe_cache[PROBE_CACHE_SIZE];
+static unsigned int probe_cache_init = 0;
+static unsigned long probe_cache_hits = 0;
+static unsigned long probe_cache_misses = 0;
+static unsigned long probe_cache_invalidated = 0;
+
+static void probe_cache_lock(void)
+{
+	int status = pthread_mutex_lock(&probe_cache_mutex);
+	if (status)
+		fatal(status);
+	if (!probe_cache_init) {
+		unsigned int i;
+
+		for (i = 0; i < PROBE_CACHE_SIZE; i++)
+			INIT_LIST_HEAD(&probe_cache[i]);
+		probe_cache_init = 1;
+	}
+	return;
+}
+
+static void probe_cache_unlock(void)
+{
+	int status = pthread_mutex_unlock(&probe_cache_mutex);
+	if (status)
+		fatal(status);
+	return;
+}
+
+static u_int32_t probe_cache_hash(struct sockaddr *addr, size_t addr_len)
+{
+	const unsigned char *s;
+	u_int32_t h = 0;
+	size_t i, len;
+
+	if (addr->sa_family == AF_INET) {
+		s = (unsigned char *) &((struct sockaddr_in *) addr)->sin_addr;
+		len = sizeof(struct in_addr);
+	} else if (addr->sa_family == AF_INET6) {
+		s = (unsigned char *) &((struct sockaddr_in6 *) addr)->sin6_addr;
+		len = sizeof(struct in6_addr);
+	} else {
+		s = (unsigned char *) addr;
+		len = addr_len;
+	}
+
+	for (i = 0; i < len; i++) {
+		h += s[i];
+		h += (h << 10);
+		h ^= (h >> 6);
+	}
+	h += (h << 3);
+	h ^= (h >> 11);
+	h += (h << 15);
+
+	return h % PROBE_CACHE_SIZE;
+}
+
+static int probe_cache_usable(struct host *host)
+{
+	/* A random selection must be made for each mount */
+	if (host->options & MOUNT_FLAG_RANDOM_SELECT)
+		return 0;
+
+	if (!host->addr || host->addr_len > sizeof(struct sockaddr_storage))
+		return 0;
+
+	return defaults_get_mount_nfs_probe_cache_timeout() != 0;
+}
+
+static struct probe_cache_entry *probe_cache_find(struct host *host,
+				unsigned int type, unsigned int version, int port)
+{
+	struct list_head *head, *p;
+	time_t now = monotonic_time(NULL);
+
+	head = &probe_cache[probe_cache_hash(host->addr, host->addr_len)];
+	p = head->next;
+	while (p != head) {
+		struct probe_cache_entry *this;
+
+		this = list_entry(p, struct probe_cache_entry, list);
+		p = p->next;
+
+		if (this->expire <= now) {
+			list_del(&this->list);
+			free(this);
+			continue;
+		}
+
+		if (this->addr_len == host->addr_len &&
+		    !memcmp(&this->addr, host->addr, host->addr_len) &&
+		    this->type == type &&
+		    this->version == version &&
+		    this->port == port &&
+		    this->weight == host->weight &&
+		    this->options == host->options)
+			return this;
+	}
+
+	return NULL;
+}
+
+static int probe_cache_lookup(unsigned logopt, struct host *host,
+			      unsigned int type, unsigned int version, int port)
+{
+	struct probe_cache_entry *this;
+
+	if (!probe_cache_usable(host))
+		return 0;
+
+	probe_cache_lock();
+	this = probe_cache_find(host, type, version, port);
+	if (!this) {
+		probe_cache_misses++;
+		probe_cache_unlock();
+		return 0;
+	}
+	probe_cache_hits++;
+	host->version |= this->supported;
+	host->cost = this->cost;
+	debug(logopt, "host %s probe cache hit, cost %ld "
+	      "(hits %lu misses %lu invalidated %lu)",
+	      host->name, host->cost, probe_cache_hits,
+	      probe_cache_misses, probe_cache_invalidated);
+	probe_cache_unlock();
+
+	return 1;
+}
+
+static void probe_cache_add(struct host *host,
+			    unsigned int type, unsigned int version, int port,
+			    unsigned int supported)
+{
+	struct probe_cache_entry *this;
+	unsigned int timeout;
+
+	if (!probe_cache_usable(host))
+		return;
+
+	timeout = defaults_get_mount_nfs_probe_cache_timeout();
+
+	probe_cache_lock();
+	this = probe_cache_find(host, type, version, port);
+	if (!this) {
+		this = malloc(sizeof(struct probe_cache_entry));
+		if (!this) {
+			probe_cache_unlock();
+			return;
+		}
+		memset(this, 0, sizeof(struct probe_cache_entry));
+		memcpy(&this->addr, host->addr, host->addr_len);
+		this->addr_len = host->addr_len;
+		this->type = type;
+		this->version = version;
+		this->port = port;
+		this->weight = host->weight;
+		this->options = host->options;
+		list_add(&this->list,
+			 &probe_cache[probe_cache_hash(host->addr, host->addr_len)]);
+	}
+	this->supported = supported;
+	this->cost = host->cost;
+	this->expire = monotonic_time(NULL) + timeout;
+	probe_cache_unlock();
+}
+
+/* A mount from the host failed so it needs to be probed again */
+void probe_cache_invalidate(struct sockaddr *addr, size_t addr_len)
+{
+	struct list_head *head, *p;
+
+	if (!addr)
+		return;
+
+	probe_cache_lock();
+	head = &probe_cache[probe_cache_hash(addr, addr_len)];
+	p = head->next;
+	while (p != head) {
+		struct probe_cache_entry *this;
+
+		this = list_entry(p, struct probe_cache_entry, list);
+		p = p->next;
+
+		if (this->addr_len == addr_len &&
+		    !memcmp(&this->addr, addr, addr_len)) {
+			list_del(&this->list);
+			free(this);
+			probe_cache_invalidated++;
+		}
+	}
+	probe_cache_unlock();
+}
+
+static time_t get_probe_timeout(struct host *host)
+{
+	time_t timeout = RPC_TIMEOUT;
+
+	if (host->proximity == PROXIMITY_NET)
+		timeout = RPC_TIMEOUT * 2;
+	else if (host->proximity == PROXIMITY_OTHER)
+		timeout = RPC_TIMEOUT * 8;
+
+	return timeout;
+}
+
+/*
+ * The most RPC calls, each of which can take the probe timeout,
+ * get_vers_and_cost() can make for the versions and protocols
+ * requested. That's a portmap client and then a port lookup, a
+ * client and a ping for each version over each protocol.
+ */
+static unsigned int get_probe_calls(unsigned int version)
+{
+	unsigned int vers = 0, protos = 0;
+
+	if (version & NFS4_REQUESTED)
+		vers++;
+	if (version & NFS3_REQUESTED)
+		vers++;
+	if (version & NFS2_REQUESTED)
+		vers++;
+
+	if (version & TCP_REQUESTED)
+		protos++;
+	if (version & UDP_REQUESTED)
+		protos++;
+
+	return protos * (1 + 3 * vers);
+}
+
 static unsigned int get_nfs_info(unsigned logopt, struct host *host,
 			 struct conn_info *pm_info, struct conn_info *rpc_info,
 			 int proto, unsigned int version, int port)
@@ -462,18 +723,13 @@ static int get_vers_and_cost(unsigned logopt, struct host *host,
 			     unsigned int version, int port)
 {
 	struct conn_info pm_info, rpc_info;
-	time_t timeout = RPC_TIMEOUT;
+	time_t timeout = get_probe_timeout(host);
 	unsigned int supported, vers = (NFS_VERS_MASK | NFS4_VERS_MASK);
 	int ret = 0;
 
 	memset(&pm_info, 0, sizeof(struct conn_info));
 	memset(&rpc_info, 0, sizeof(struct conn_info));
 
-	if (host->proximity == PROXIMITY_NET)
-		timeout = RPC_TIMEOUT * 2;
-	else if (host->proximity == PROXIMITY_OTHER)
-		timeout = RPC_TIMEOUT * 8;
-
 	rpc_info.host = host->name;
 	rpc_info.addr = host->addr;
 	rpc_info.addr_len = host->addr_len;
@@ -484,6 +740,9 @@ static int get_vers_and_cost(unsigned logopt, struct host *host,
 
 	vers &= version;
 
+	if (probe_cache_lookup(logopt, host, PROBE_VERS_AND_COST, version, port))
+		return 1;
+
 	if (version & TCP_REQUESTED) {
 		supported = get_nfs_info(logopt, host,
 				   &pm_info, &rpc_info, IPPROTO_TCP, vers, port);
@@ -509,6 +768,10 @@ static int get_vers_and_cost(unsigned logopt, struct host *host,
 		}
 	}
 
+	if (ret)
+		probe_cache_add(host, PROBE_VERS_AND_COST,
+				version, port, host->version);
+
 	return ret;
 }
 
@@ -524,7 +787,8 @@ static int get_supported_ver_and_cost(unsigned logopt, struct host *host,
 	unsigned int vers;
 	struct timespec start, end;
 	double taken = 0;
-	time_t timeout = RPC_TIMEOUT;
+	time_t timeout = get_probe_timeout(host);
+	unsigned int selected = version;
 	int status = 0;
 
 	if (host->addr)
@@ -538,11 +802,6 @@ static int get_supported_ver_and_cost(unsigned logopt, struct host *host,
 	memset(&pm_info, 0, sizeof(struct conn_info));
 	memset(&rpc_info, 0, sizeof(struct conn_info));
 
-	if (host->proximity == PROXIMITY_NET)
-		timeout = RPC_TIMEOUT * 2;
-	else if (host->proximity == PROXIMITY_OTHER)
-		timeout = RPC_TIMEOUT * 8;
-
 	rpc_info.host = host->name;
 	rpc_info.addr = host->addr;
 	rpc_info.addr_len = host->addr_len;
@@ -551,6 +810,9 @@ static int get_supported_ver_and_cost(unsigned logopt, struct host *host,
 	rpc_info.close_option = RPC_CLOSE_DEFAULT;
 	rpc_info.client = NULL;
 
+	if (probe_cache_lookup(logopt, host, PROBE_SUPPORTED_VER, selected, port))
+		return 1;
+
 	/*
 	 *  The version passed in is the version as defined in
 	 *  include/replicated.h.  However, the version we want to send
@@ -644,12 +906,326 @@ done:
 
 		debug(logopt, "cost %ld weight %d", host->cost, host->weight);
 
+		if (status > 0)
+			probe_cache_add(host, PROBE_SUPPORTED_VER,
+					selected, port, 0);
+
 		return 1;
 	}
 
 	return 0;
 }
 
+/*
+ * Hosts are probed concurrently so that a mount doesn't have to
+ * wait out the RPC timeouts of unavailable hosts one after the
+ * other. Probe threads work on a private copy of the host and
+ * hold a reference to the probe group so the caller can give up
+ * on hosts that don't respond before the deadline.
+ */
+struct probe_host {
+	struct host *host;
+	unsigned int done;
+	int status;
+};
+
+struct probe_group {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned logopt;
+	unsigned int vers;
+	int port;
+	int (*probe)(unsigned, struct host *, unsigned int, int);
+	unsigned int refs;
+	unsigned int pending;
+	unsigned int count;
+	struct probe_host *hosts;
+};
+
+struct probe_args {
+	struct probe_group *group;
+	struct probe_host *ph;
+};
+
+static struct host *probe_host_copy(struct host *host)
+{
+	struct host *new;
+
+	new = malloc(sizeof(struct host));
+	if (!new)
+		return NULL;
+	memset(new, 0, sizeof(struct host));
+
+	new->name = strdup(host->name);
+	if (!new->name) {
+		free(new);
+		return NULL;
+	}
+
+	if (host->addr) {
+		new->addr = malloc(host->addr_len);
+		if (!new->addr) {
+			free(new->name);
+			free(new);
+			return NULL;
+		}
+		memcpy(new->addr, host->addr, host->addr_len);
+		new->addr_len = host->addr_len;
+	}
+
+	new->rr = host->rr;
+	new->options = host->options;
+	new->proximity = host->proximity;
+	new->weight = host->weight;
+
+	return new;
+}
+
+static void probe_group_put(struct probe_group *group)
+{
+	unsigned int i;
+	int status;
+
+	status = pthread_mutex_lock(&group->mutex);
+	if (status)
+		fatal(status);
+	if (--group->refs) {
+		status = pthread_mutex_unlock(&group->mutex);
+		if (status)
+			fatal(status);
+		return;
+	}
+	status = pthread_mutex_unlock(&group->mutex);
+	if (status)
+		fatal(status);
+
+	for (i = 0; i < group->count; i++) {
+		if (group->hosts[i].host)
+			free_host(group->hosts[i].host);
+	}
+	pthread_cond_destroy(&group->cond);
+	pthread_mutex_destroy(&group->mutex);
+	free(group->hosts);
+	free(group);
+}
+
+static void probe_host_done(struct probe_group *group,
+			    struct probe_host *ph, int status)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&group->mutex);
+	if (ret)
+		fatal(ret);
+	ph->status = status;
+	ph->done = 1;
+	group->pending--;
+	ret = pthread_cond_signal(&group->cond);
+	if (ret)
+		fatal(ret);
+	ret = pthread_mutex_unlock(&group->mutex);
+	if (ret)
+		fatal(ret);
+}
+
+static void *probe_host_thread(void *arg)
+{
+	struct probe_args *pa = (struct probe_args *) arg;
+	struct probe_group *group = pa->group;
+	struct probe_host *ph = pa->ph;
+	int status;
+
+	free(pa);
+
+	status = group->probe(group->logopt, ph->host, group->vers, group->port);
+	probe_host_done(group, ph, status);
+	probe_group_put(group);
+
+	return NULL;
+}
+
+static struct probe_group *probe_group_new(unsigned logopt,
+				int (*probe)(unsigned, struct host *, unsigned int, int),
+				unsigned int vers, int port, unsigned int count)
+{
+	struct probe_group *group;
+	pthread_condattr_t condattrs;
+	int status;
+
+	group = malloc(sizeof(struct probe_group));
+	if (!group)
+		return NULL;
+	memset(group, 0, sizeof(struct probe_group));
+
+	group->hosts = malloc(count * sizeof(struct probe_host));
+	if (!group->hosts) {
+		free(group);
+		return NULL;
+	}
+	memset(group->hosts, 0, count * sizeof(struct probe_host));
+
+	status = pthread_mutex_init(&group->mutex, NULL);
+	if (status)
+		fatal(status);
+
+	status = pthread_condattr_init(&condattrs);
+	if (status)
+		fatal(status);
+
+	status = pthread_condattr_setclock(&condattrs, CLOCK_MONOTONIC);
+	if (status)
+		fatal(status);
+
+	status = pthread_cond_init(&group->cond, &condattrs);
+	if (status)
+		fatal(status);
+
+	pthread_condattr_destroy(&condattrs);
+
+	group->logopt = logopt;
+	group->count = count;
+	group->probe = probe;
+	group->vers = vers;
+	group->port = port;
+	group->refs = 1;
+
+	return group;
+}
+
+/* Start a thread to probe a host, returns 0 if the thread was started */
+static int probe_host_start(struct probe_group *group,
+			    struct probe_host *ph, struct host *host)
+{
+	struct probe_args *pa;
+	pthread_t thid;
+	int status;
+
+	ph->host = probe_host_copy(host);
+	if (!ph->host)
+		return -1;
+
+	pa = malloc(sizeof(struct probe_args));
+	if (!pa) {
+		free_host(ph->host);
+		ph->host = NULL;
+		return -1;
+	}
+	pa->group = group;
+	pa->ph = ph;
+
+	status = pthread_mutex_lock(&group->mutex);
+	if (status)
+		fatal(status);
+	group->refs++;
+	group->pending++;
+	status = pthread_mutex_unlock(&group->mutex);
+	if (status)
+		fatal(status);
+
+	if (!pthread_create(&thid, &th_attr_detached, probe_host_thread, pa))
+		return 0;
+
+	status = pthread_mutex_lock(&group->mutex);
+	if (status)
+		fatal(status);
+	group->refs--;
+	group->pending--;
+	status = pthread_mutex_unlock(&group->mutex);
+	if (status)
+		fatal(status);
+
+	free(pa);
+	free_host(ph->host);
+	ph->host = NULL;
+
+	return -1;
+}
+
+/*
+ * Probe the hosts from first up to, but not including, last
+ * concurrently and wait until they have all responded or the
+ * deadline has passed. The deadline allows calls RPC calls each
+ * taking the longest probe timeout of the hosts so it only cuts
+ * off probes that would have failed anyway. The result of each
+ * probe is returned in the status array, hosts that don't respond
+ * in time get 0. If a thread can't be used the host is probed by
+ * the caller.
+ */
+static void probe_hosts(unsigned logopt, struct host *first, struct host *last,
+			int (*probe)(unsigned, struct host *, unsigned int, int),
+			unsigned int vers, int port, unsigned int calls,
+			int *status)
+{
+	struct probe_group *group;
+	struct timespec deadline;
+	struct host *this;
+	time_t timeout = 0;
+	unsigned int i, count = 0;
+	int ret;
+
+	for (this = first; this != last; this = this->next)
+		count++;
+
+	group = probe_group_new(logopt, probe, vers, port, count);
+
+	for (i = 0, this = first; this != last; i++, this = this->next) {
+		status[i] = 0;
+
+		if (!this->name)
+			continue;
+
+		if (get_probe_timeout(this) > timeout)
+			timeout = get_probe_timeout(this);
+
+		if (!group || probe_host_start(group, &group->hosts[i], this))
+			status[i] = probe(logopt, this, vers, port);
+	}
+
+	if (!group)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout * calls;
+
+	ret = pthread_mutex_lock(&group->mutex);
+	if (ret)
+		fatal(ret);
+
+	while (group->pending) {
+		ret = pthread_cond_timedwait(&group->cond,
+					     &group->mutex, &deadline);
+		if (ret == ETIMEDOUT)
+			break;
+		if (ret)
+			fatal(ret);
+	}
+
+	for (i = 0, this = first; this != last; i++, this = this->next) {
+		struct probe_host *ph = &group->hosts[i];
+
+		if (!ph->host)
+			continue;
+
+		if (!ph->done) {
+			debug(logopt, "host %s didn't respond before deadline",
+			      this->name);
+			continue;
+		}
+
+		status[i] = ph->status;
+		if (ph->status) {
+			this->version |= ph->host->version;
+			this->cost = ph->host->cost;
+		}
+	}
+
+	ret = pthread_mutex_unlock(&group->mutex);
+	if (ret)
+		fatal(ret);
+
+	probe_group_put(group);
+}
+
 int prune_host_list(unsigned logopt, struct host **list,
 		    unsigned int vers, int port)
 {
@@ -659,7 +1235,8 @@ int prune_host_list(unsigned logopt, struct host **list,
 	unsigned int v2_tcp_count, v3_tcp_count, v4_tcp_count;
 	unsigned int v2_udp_count, v3_udp_count, v4_udp_count;
 	unsigned int max_udp_count, max_tcp_count, max_count;
-	int status;
+	unsigned int i, count;
+	int *status;
 	int kern_vers;
 
 	if (!*list)
@@ -706,25 +1283,40 @@ int prune_host_list(unsigned logopt, struct host **list,
 			return 1;
 	}
 
-	proximity = this->proximity;
-	while (this) {
-		struct host *next = this->next;
+	/*
+	 * Probe the hosts of the closest proximity together, moving
+	 * on to the next proximity if none of them are available.
+	 */
+	count = 0;
+	for (this = first; this; this = this->next)
+		count++;
+	status = alloca(count * sizeof(int));
+
+	while (first) {
+		proximity = first->proximity;
+		for (last = first; last; last = last->next) {
+			if (last->proximity != proximity)
+				break;
+		}
 
-		if (this->proximity != proximity)
-			break;
+		probe_hosts(logopt, first, last, get_vers_and_cost,
+			    vers, port, get_probe_calls(vers), status);
 
-		if (this->name) {
-			status = get_vers_and_cost(logopt, this, vers, port);
-			if (!status) {
-				if (this == first) {
-					first = next;
-					if (next)
-						proximity = next->proximity;
-				}
+		this = first;
+		first = NULL;
+		for (i = 0; this != last; i++) {
+			struct host *next = this->next;
+
+			if (this->name && !status[i])
 				delete_host(list, this);
-			}
+			else if (!first)
+				first = this;
+			this = next;
 		}
-		this = next;
+
+		if (first)
+			break;
+		first = last;
 	}
 
 	/*
@@ -736,8 +1328,6 @@ int prune_host_list(unsigned logopt, struct host **list,
 	if (!first)
 		return 1;
 
-	last = this;
-
 	/* Select NFS version of highest number of closest servers */
 
 	v4_tcp_count = v3_tcp_count = v2_tcp_count = 0;
@@ -815,20 +1405,21 @@ int prune_host_list(unsigned logopt, struct host **list,
 	 */ 
 
 	first = last;
+	/* A portmap client, port lookup, client and ping at most */
+	if (first)
+		probe_hosts(logopt, first, NULL, get_supported_ver_and_cost,
+			    selected_version, port, 4, status);
+
 	this = first;
-	while (this) {
+	for (i = 0; this; i++) {
 		struct host *next = this->next;
 		if (!this->name) {
 			remove_host(list, this);
 			add_host(&new, this);
-		} else {
-			status = get_supported_ver_and_cost(logopt, this,
-						selected_version, port);
-			if (status) {
-				this->version = selected_version;
-				remove_host(list, this);
-				add_host(&new, this);
-			}
+		} else if (status[i]) {
+			this->version = selected_version;
+			remove_host(list, this);
+			add_host(&new, this);
 		}
 		this = next;
 	}